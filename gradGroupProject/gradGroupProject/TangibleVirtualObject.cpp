@@ -1,6 +1,8 @@
 #include <stdlib.h>
 #include <math.h>
 #include <assert.h>
+#include <string.h>
+#include <thread>
 
 #if defined(WIN32)
 #include <windows.h>
@@ -15,7 +17,13 @@
 #include <HLU/hlu.h>
 
 
+#include "backgroundwriter.h"
+#include "interaction.h"
 #include "objloader.h"
+#include "profiler.h"
+#include "sampledlog.h"
+#include "scene.h"
+#include "sessiontrace.h"
 
 using namespace std;
 
@@ -35,7 +43,6 @@ static GLuint gPencilDisplayList = 0;
 struct HapticObject
 {
     HLuint shapeId;
-    GLuint displayList;
     hduMatrix transform;
 	float hap_stiffness;
     float hap_damping;
@@ -43,7 +50,6 @@ struct HapticObject
     float hap_dynamic_friction;
 };
 std::vector<HapticObject> hapticObjects;
-set<int>nearestNeighbour;
 
 
 
@@ -59,38 +65,35 @@ long int gCurrentDragObj = -1;
 //Display list for model
 GLuint objList;
 
-vector<glm::vec3> vertices;
-vector<int> indices;
-vector<glm::vec3> normals;
-vector<double> surfaceFriction;
-vector<Triangle> triContainer;
-vector<OBJLoader> loaderVec;
+//the objects and their meshes, read from the scene file; hapticObjects[i] is scene object i
+Scene scene;
+//--scene file picks the scene, default.scene beside the meshes otherwise
+const char *sceneFile = "default.scene";
 
 float stiffnessCoefficient = 1.0;
 
-HDboolean bRenderForce = HD_FALSE;
 HLboolean isAnchoredEditing = false;
 HLboolean toggleCursor = false;
 HLboolean isProxyConstrained = false;
 static HDdouble gSpringStiffness = 0.1;
 static HDdouble gMaxStiffness = 1.0;
-OBJLoader loaderOne;
-OBJLoader loaderTwo;
 OBJLoader pencilLoader;
-hduVector3Dd newProxyPosition;
 
 hduMatrix initProxyTransform;
 hduMatrix initObjTransform;
-int nearestID;
-
-int loaderIndex; 
-double currentFriction;
 HDSchedulerHandle gCallbackHandle = 0;
-hduVector3Dd anchor;
 hduVector3Dd trueDevicePosition;
-hduVector3Dd anchorProxyPosition;
-hduVector3Dd anchorInitDevicePosition;
-int anchorTouchPoint;
+
+//contact, anchored editing and the servo force; the HL callbacks below only translate for it
+Interaction interaction;
+//written when started with --record file, for replaying with the headless driver
+TraceWriter trace;
+//with --profile file, the timers are written there as a Chrome trace on exit
+const char *profileFile = 0;
+//--haptic-triangles n and --visual-triangles n cap the triangles of the haptic shape and of the
+//drawn mesh by picking a coarser LOD level; 0 draws the full mesh
+size_t hapticTriangles = kDefaultHapticTriangles;
+size_t visualTriangles = 0;
 
 hduVector3Dd transformedProxyPosition;
 
@@ -126,7 +129,8 @@ void HLCALLBACK hlMotionCB (HLenum event, HLuint object, HLenum thread, HLcache*
 HDCallbackCode HDCALLBACK AnchoredSpringForceCallback(void *pUserData);
 void updateObjTransform();
 void updateDragObjectTransform();
-int findNearestVertex(vec3 proxyPosition);
+vec3 toVec3(hduVector3Dd const &v);
+void traceTransforms();
 
 /*******************************************************************************
  Initializes GLUT for displaying a simple haptic scene.
@@ -134,6 +138,25 @@ int findNearestVertex(vec3 proxyPosition);
 int main(int argc, char *argv[])
 {
     glutInit(&argc, argv);
+	PROFILE_THREAD("graphics");
+
+	for (int i = 1; i < argc; i++){
+		if (!strcmp(argv[i], "--record") && i + 1 < argc){
+			if (!trace.open(argv[++i]))
+				printf("Could not open %s for recording\n", argv[i]);
+		}
+		else if (!strcmp(argv[i], "--profile") && i + 1 < argc)
+			profileFile = argv[++i];
+		//--log n prints every nth touch and motion message, none by default
+		else if (!strcmp(argv[i], "--log") && i + 1 < argc)
+			SampledLog::setInterval(atoi(argv[++i]));
+		else if (!strcmp(argv[i], "--scene") && i + 1 < argc)
+			sceneFile = argv[++i];
+		else if (!strcmp(argv[i], "--haptic-triangles") && i + 1 < argc)
+			hapticTriangles = (size_t)atol(argv[++i]);
+		else if (!strcmp(argv[i], "--visual-triangles") && i + 1 < argc)
+			visualTriangles = (size_t)atol(argv[++i]);
+	}
     
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
 
@@ -167,6 +190,27 @@ void glutDisplay()
     drawSceneHaptics();
     drawSceneGraphics();
     glutSwapBuffers();
+
+	//only what an edit changed is re-sent to the vertex buffers, report how much that was;
+	//the counter gets every frame, the console a sample
+	size_t uploadBytes = 0;
+	for (size_t i = 0; i < scene.meshCount(); i++)
+		uploadBytes += scene.mesh(i).takeUploadBytes();
+	if (uploadBytes){
+		PROFILE_COUNTER("upload bytes", uploadBytes);
+		SAMPLED_LOG("Buffer upload: %d bytes\n", (int)uploadBytes);
+	}
+
+	//one line per second of servo ticks, to check the loop keeps to its budget
+	ServoSummary servo;
+	while (interaction.servoTiming().takeSummary(servo))
+		printf("Servo: %d ticks, mean period %.1f us, max jitter %lld us, max busy %lld us, %d over budget, %d dropped\n",
+			servo.ticks, servo.meanPeriod, servo.maxJitter, servo.maxBusy, servo.overruns, servo.dropped);
+
+	trace.flush();
+	//empties the threads' timer rings before they fill up
+	if (profileFile)
+		Profiler::collect();
 }
 
 /*******************************************************************************
@@ -242,33 +286,56 @@ void keyboard(unsigned char key, int x, int y) {
 	
 	case 'a':
 	case 'A':
+		trace.key('A', toVec3(trueDevicePosition), toVec3(proxyPosition));
 		isAnchoredEditing = !isAnchoredEditing;
 		if(isAnchoredEditing && (gCurrentTouchObj != -1 && isProxyConstrained)){
-			anchor = trueDevicePosition;//device in physical space
-			anchorProxyPosition = proxyPosition;//proxy
-			anchorTouchPoint = nearestID;//the point being touched
-			anchorInitDevicePosition = devicePosition; // device in virtual space
-			bRenderForce = HD_TRUE;
-
-			for(set<int>::iterator cur_b= loaderVec[loaderIndex].net[anchorTouchPoint].begin(); cur_b!= loaderVec[loaderIndex].net[anchorTouchPoint].end(); cur_b++)
-						nearestNeighbour.insert(*cur_b);
-					}
+			//anchors the vertex being touched: the device in physical and in virtual space, and the proxy
+			hduMatrix worldToModel = hapticObjects[interaction.object()].transform.getInverse();
+			interaction.beginAnchor(toVec3(trueDevicePosition), toVec3(devicePosition), toVec3(proxyPosition), worldToModel);
+		}
 
 		
 		else{
-			nearestNeighbour.clear();
-			bRenderForce = HD_FALSE;
+			interaction.endAnchor();
 			}
 		break;
 
+	//undo and redo the current object's anchored edits, one 'A' on to 'A' off at a time
+	case 'z':
+	case 'Z':
+		trace.key('Z', toVec3(trueDevicePosition), toVec3(proxyPosition));
+		if(!interaction.undo())
+			printf("Nothing to undo\n");
+		break;
+	case 'y':
+	case 'Y':
+		trace.key('Y', toVec3(trueDevicePosition), toVec3(proxyPosition));
+		if(!interaction.redo())
+			printf("Nothing to redo\n");
+		break;
+
+	//save every mesh as it is now, in the background: savedN.obj, and savedN.mesh for load() to read back as is
+	case 's':
+	case 'S':
+		for(size_t i = 0; i < scene.meshCount(); i++){
+			char name[32];
+			sprintf(name, "saved%d.obj", (int)i);
+			scene.mesh(i).saveOBJ(name, true);
+			sprintf(name, "saved%d.mesh", (int)i);
+			scene.mesh(i).saveBinary(name, true);
+			printf("Saving %s to saved%d.obj and saved%d.mesh\n", scene.meshPath(i).c_str(), (int)i, (int)i);
+		}
+		break;
+
 	case 't':
 	case 'T':
-		
+		trace.key('T', toVec3(trueDevicePosition), toVec3(proxyPosition));
 		toggleCursor = !toggleCursor;
 		
 		break;
 	case 'e':
 	case 'E':
+		trace.key('E', toVec3(trueDevicePosition), toVec3(proxyPosition));
 		isProxyConstrained = !isProxyConstrained;
 		if(isProxyConstrained){
 			constrainedProxy = proxyPosition;
@@ -282,7 +349,25 @@ void keyboard(unsigned char key, int x, int y) {
 			maxPoint[2] = constrainedProxy[2]+.25;
 		}
 		updateWorkspace();
-		
+		break;
+
+	//brush size, falloff distance and mode for anchored edits, used from the next 'A' on
+	case '[':
+	case ']':
+	case 'g':
+	case 'G':
+	case 'r':
+	case 'R':{
+		char brushKey = key == 'g' || key == 'r' ? key - 'a' + 'A' : key;
+		trace.key(brushKey, toVec3(trueDevicePosition), toVec3(proxyPosition));
+		Brush brush = interaction.brush();
+		adjustBrush(brush, brushKey);
+		interaction.setBrush(brush);
+		printf("Brush radius %.3f, %s distance, %s\n", brush.radius,
+			brush.metric == BrushGeodesic ? "geodesic" : "Euclidean",
+			brush.mode == BrushFalloff ? "falloff" : "as rigid as possible");
+		break;
+		}
 	}
 
 }
@@ -306,37 +391,30 @@ void initPROXYModel(){
 
 	bool loadpencilFile = pencilLoader.load("pencil.obj");
 
-	printf("Number of vertices is: %d\n", (pencilLoader.getVertices()).size());
+	printf("Number of vertices is: %d\n", (int)pencilLoader.view().positions.size());
 
 }
 
+//reads the scene and loads each distinct mesh once, the meshes side by side on every hardware thread
 void initOBJModel(){
-	
-
-
-	bool loadfileOne = loaderOne.load("WavySurface.obj");
-	vertices = loaderOne.getVertices();
-	normals = loaderOne.getNormals();
-	surfaceFriction = loaderOne.getFriction();
-	indices = loaderOne.getVertexIndices();
-	triContainer = loaderOne.getTriangles();
-
-	loaderVec.push_back(loaderOne);
-
-	vertices.clear();
-	normals.clear();
-	surfaceFriction.clear();
-	indices.clear();
-	triContainer.clear();
-
-	bool loadfilTwo = loaderTwo.load("swq.obj");
-	vertices = loaderTwo.getVertices();
-	normals = loaderTwo.getNormals();
-	surfaceFriction = loaderTwo.getFriction();
-	indices = loaderTwo.getVertexIndices();
-	triContainer = loaderTwo.getTriangles();
-
-	loaderVec.push_back(loaderTwo);
+	if(!scene.read(sceneFile)){
+		if(scene.errorLine())
+			fprintf(stderr, "%s:%d: not an object\n", sceneFile, scene.errorLine());
+		else
+			fprintf(stderr, "Could not read %s\n", sceneFile);
+		exit(-1);
+	}
+	if(scene.objectCount() == 0){
+		fprintf(stderr, "%s has no objects\n", sceneFile);
+		exit(-1);
+	}
+	if(!scene.loadMeshes((int)std::thread::hardware_concurrency())){
+		fprintf(stderr, "Could not load %s\n", scene.failedMesh().c_str());
+		exit(-1);
+	}
+	for(size_t i = 0; i < scene.meshCount(); i++)
+		scene.mesh(i).setTriangleBudgets(hapticTriangles, visualTriangles);
+	printf("%d objects, %d meshes\n", (int)scene.objectCount(), (int)scene.meshCount());
 }
 
 /*******************************************************************************
@@ -389,6 +467,14 @@ void initHL()
         exit(-1);
     }
 	
+	//the servo timing budgets each tick by the scheduler's rate
+	HDint servoRate = 0;
+	hdGetIntegerv(HD_UPDATE_RATE, &servoRate);
+	interaction.servoTiming().setServoRate(servoRate);
+
+	interaction.setScene(&scene);
+	interaction.setStiffness(gSpringStiffness);
+	interaction.start();
 	gCallbackHandle = hdScheduleAsynchronous(AnchoredSpringForceCallback, 0, HD_DEFAULT_SCHEDULER_PRIORITY);
     hdEnable(HD_FORCE_OUTPUT);
 
@@ -407,7 +493,7 @@ void exitHandler()
 {
     // Deallocate the sphere shape id we reserved in initHL.
     
-	for(int i=0; hapticObjects.size(); i++ )
+	for(size_t i=0; i < hapticObjects.size(); i++ )
 		hlDeleteShapes(hapticObjects[i].shapeId, 1);
 
     // Free up the haptic rendering context.
@@ -418,6 +504,11 @@ void exitHandler()
     }
 
     hdUnschedule(gCallbackHandle);
+	interaction.stop();
+	BackgroundWriter::shared().flush();
+	trace.close();
+	if (profileFile && !Profiler::writeChromeTrace(profileFile))
+		printf("Could not write %s\n", profileFile);
     // Free up the haptic device.
     if (ghHD != HD_INVALID_HANDLE)
     {
@@ -454,57 +545,29 @@ void updateWorkspace()
 
 /*******************************************************************************/
 void createHapticObject(){
-	//I don't this the problem is here.
-
-	HapticObject hapticObject;
-    hapticObject.hap_stiffness = 0.8;
-    hapticObject.hap_damping = 0.0;
-    hapticObject.hap_static_friction = 0.5;
-    hapticObject.hap_dynamic_friction = 0.0;
-    
-	hapticObject.shapeId = hlGenShapes(1);
-    hapticObject.transform = hduMatrix::createTranslation(0,0,0);
-    hapticObject.displayList = glGenLists(1);
-	hapticObjects.push_back(hapticObject); //first object
-	
-
-	//multiple objects code
-	
-	
-	//printf("%f\n", hapticObjects.size());
-	
-	/*glNewList(hapticObject.displayList, GL_COMPILE);
-        glutSolidCube(40);
-    glEndList();
-	*/
-	hapticObject.hap_stiffness = 0.8;
-    hapticObject.hap_damping = 0.0;
-    hapticObject.hap_static_friction = 0.5;
-    hapticObject.hap_dynamic_friction = 0.0;
-
-	hapticObject.shapeId = hlGenShapes(1);
-    hapticObject.transform = hduMatrix::createTranslation(1,1,-2);
-    hapticObject.displayList = glGenLists(1);
-	
-	
-	hapticObjects.push_back(hapticObject);
-
-	//printf("%f\n", hapticObjects.size());
-
-
-
-
-	// loop for multiple objects, works with original code
-   	for ( int i = 0; i < hapticObjects.size(); i++){
-		//cout<<i;
-	      printf("%d\n", hapticObjects[i].shapeId);
-	      hlAddEventCallback(HL_EVENT_1BUTTONDOWN, hapticObjects[i].shapeId, HL_CLIENT_THREAD, buttonDownClientThreadCallback,0);
-	      hlAddEventCallback(HL_EVENT_1BUTTONUP, HL_OBJECT_ANY, HL_CLIENT_THREAD, buttonUpClientThreadCallback, 0); 
-	      hlAddEventCallback(HL_EVENT_TOUCH, hapticObjects[i].shapeId, HL_COLLISION_THREAD, hlTouchCB, 0); 
-	      hlAddEventCallback(HL_EVENT_UNTOUCH, HL_OBJECT_ANY, HL_COLLISION_THREAD, hlUnTouchCB, 0);
-	      hlAddEventCallback(HL_EVENT_MOTION, hapticObjects[i].shapeId, HL_COLLISION_THREAD, hlMotionCB, 0);
+	//one shape per scene object, placed and given its material as the scene says
+	for (size_t i = 0; i < scene.objectCount(); i++){
+		SceneObject const &object = scene.object(i);
+		HapticObject hapticObject;
+		hapticObject.hap_stiffness = object.material.stiffness;
+		hapticObject.hap_damping = object.material.damping;
+		hapticObject.hap_static_friction = object.material.staticFriction;
+		hapticObject.hap_dynamic_friction = object.material.dynamicFriction;
+
+		hapticObject.shapeId = hlGenShapes(1);
+		for (int row = 0; row < 4; row++)
+			for (int col = 0; col < 4; col++)
+				hapticObject.transform[row][col] = object.transform[4 * row + col];
+		hapticObjects.push_back(hapticObject);
+
+		hlAddEventCallback(HL_EVENT_1BUTTONDOWN, hapticObject.shapeId, HL_CLIENT_THREAD, buttonDownClientThreadCallback, 0);
+		hlAddEventCallback(HL_EVENT_TOUCH, hapticObject.shapeId, HL_COLLISION_THREAD, hlTouchCB, 0);
+		hlAddEventCallback(HL_EVENT_MOTION, hapticObject.shapeId, HL_COLLISION_THREAD, hlMotionCB, 0);
 	}
-
+	//these fire for any object, so they are added once rather than once per object
+	hlAddEventCallback(HL_EVENT_1BUTTONUP, HL_OBJECT_ANY, HL_CLIENT_THREAD, buttonUpClientThreadCallback, 0);
+	hlAddEventCallback(HL_EVENT_UNTOUCH, HL_OBJECT_ANY, HL_COLLISION_THREAD, hlUnTouchCB, 0);
+	traceTransforms();
 
 }
 /*******************************************************************************
@@ -513,6 +576,7 @@ void createHapticObject(){
 *******************************************************************************/
 void drawSceneGraphics()
 {
+	PROFILE_SCOPE("drawSceneGraphics");
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);           
 	glEnable(GL_COLOR_MATERIAL);
     // Draw 3D cursor at haptic device position.
@@ -538,14 +602,14 @@ void drawSceneGraphics()
 			glPushMatrix();
 			glMultMatrixd(hapticObjects[i].transform);
 			
-				loaderVec[i].drawColorObj();
+				scene.loader(i).drawColorObj();
 			
 			glPopMatrix();
 
 	}
 
 	glPushMatrix();
-	glMultMatrixd(hapticObjects[loaderIndex].transform);
+	glMultMatrixd(hapticObjects[interaction.object()].transform);
 		drawPoint();
 		
 		glPopMatrix();
@@ -562,6 +626,7 @@ void drawSceneGraphics()
 *******************************************************************************/
 void drawSceneHaptics()
 {    
+	PROFILE_SCOPE("drawSceneHaptics");
 	
     // Start haptic frame.  (Must do this before rendering any haptic shapes.)
     hlBeginFrame();
@@ -617,9 +682,14 @@ void drawSceneHaptics()
             hlMaterialf(HL_FRONT, HL_STATIC_FRICTION, hapticObjects[i].hap_static_friction);
             hlMaterialf(HL_FRONT, HL_DYNAMIC_FRICTION, hapticObjects[i].hap_dynamic_friction);
 			
+			//size the feedback buffer for the LOD level within the haptic budget, and tell HL when the
+			//surface is being edited so the proxy is kept on it instead of falling through
+			hlHinti(HL_SHAPE_FEEDBACK_BUFFER_VERTICES, (HLint)(3 * scene.loader(i).hapticTriangles()));
+			hlHintb(HL_SHAPE_DYNAMIC_SURFACE_CHANGE, interaction.anchored() && i == interaction.object());
             hlBeginShape(HL_SHAPE_FEEDBACK_BUFFER, hapticObjects[i].shapeId);
 
-			loaderVec[i].drawColorObj();
+			//geometry only, from a display list that is rebuilt only after the mesh is deformed
+			scene.loader(i).drawHapticObj();
 
             //glCallList(hapticObjects[i].displayList);
 
@@ -685,10 +755,11 @@ void drawCursor()
     // Get the proxy transform in world coordinates.
 	hlGetDoublev(HL_PROXY_TRANSFORM, proxyxform);
     // Get the proxy transform in world coordinates.
-	if(bRenderForce){
-		proxyxform[12] = newProxyPosition[0];
-		proxyxform[13] = newProxyPosition[1];
-		proxyxform[14] = newProxyPosition[2];
+	if(interaction.anchored()){
+		vec3 proxyTarget = interaction.proxyTarget();
+		proxyxform[12] = proxyTarget[0];
+		proxyxform[13] = proxyTarget[1];
+		proxyxform[14] = proxyTarget[2];
 	}
     glMultMatrixd(proxyxform);
 
@@ -717,7 +788,7 @@ void HLCALLBACK buttonDownClientThreadCallback (HLenum event, HLuint object, HLe
 	//if(gCurrentTouchObj != -1){
 	for (int i = 0; i < hapticObjects.size(); i++){
 		if (hapticObjects[i].shapeId == object)
-			loaderIndex = i;
+			interaction.select(i);
 
 	}
 
@@ -730,30 +801,35 @@ void HLCALLBACK buttonDownClientThreadCallback (HLenum event, HLuint object, HLe
 	hlGetDoublev(HL_PROXY_TRANSFORM, initProxyTransform);
 	//initObjTransform = hapticObject.transform;
 
-	initObjTransform = hapticObjects[loaderIndex].transform;
-	printf("Loader Index: %i\n", loaderIndex);
+	initObjTransform = hapticObjects[interaction.object()].transform;
+	printf("Loader Index: %i\n", interaction.object());
 
 	
 }
 void HLCALLBACK buttonUpClientThreadCallback (HLenum event, HLuint object, HLenum thread, HLcache*cache, void*userdata){
-	if(gCurrentDragObj != -1)
+	if(gCurrentDragObj != -1){
 		gCurrentDragObj = -1;
+		//the drag moved an object, the replay needs its new transform
+		traceTransforms();
+	}
 }
 void HLCALLBACK hlTouchCB (HLenum event, HLuint object, HLenum thread, HLcache*cache, void*userdata){
+	PROFILE_THREAD("collision");
+	PROFILE_SCOPE("hlTouchCB");
 	gCurrentTouchObj = object;
-	cout<<"Current touch obj= "<< gCurrentTouchObj << endl;
+	SAMPLED_LOG("Current touch obj= %ld\n", gCurrentTouchObj);
 	
 	
 
 	vec3 tProxyPos;
+	int touched = -1;
 
 	hduMatrix mat;
 	for (int i = 0; i < hapticObjects.size(); i++){
 		
 		if (hapticObjects[i].shapeId == object){
-			loaderIndex = i;
+			touched = i;
 			mat = (hapticObjects[i].transform).getInverse();
-			cout<< "We made into the if statement for touch obj"<< endl;
 			mat.multVecMatrix(proxyPosition, transformedProxyPosition);
 			tProxyPos[0] = transformedProxyPosition[0];
 			tProxyPos[1] = transformedProxyPosition[1];
@@ -761,26 +837,32 @@ void HLCALLBACK hlTouchCB (HLenum event, HLuint object, HLenum thread, HLcache*c
 		}
 	}
 
-	printf("Touch Transformed Proxy Position x: %d, y: %d, z: %d\n", tProxyPos[0], tProxyPos[1], tProxyPos[2]);
-	printf("Touch Proxy Position x: %d, y: %d, z: %d\n", proxyPosition[0], proxyPosition[1], proxyPosition[2]);
+	SAMPLED_LOG("Touch Transformed Proxy Position x: %f, y: %f, z: %f\n", tProxyPos[0], tProxyPos[1], tProxyPos[2]);
+	SAMPLED_LOG("Touch Proxy Position x: %f, y: %f, z: %f\n", proxyPosition[0], proxyPosition[1], proxyPosition[2]);
 
-	nearestID = findNearestVertex(tProxyPos);
-	
-	currentFriction =loaderVec[loaderIndex].getFriction()[nearestID];
+	if (touched != -1){
+		trace.touch(touched, tProxyPos);
+		interaction.touch(touched, tProxyPos);
+	}
 }
 void HLCALLBACK hlUnTouchCB (HLenum event, HLuint object, HLenum thread, HLcache*cache, void*userdata){
 	if(gCurrentTouchObj != -1)
 		gCurrentTouchObj = -1;
+	trace.untouch();
+	interaction.untouch();
 }
 void HLCALLBACK hlMotionCB (HLenum event, HLuint object, HLenum thread, HLcache*cache, void*userdata){
+	PROFILE_THREAD("collision");
+	PROFILE_SCOPE("hlMotionCB");
 	gCurrentTouchObj = object;
 	//printf ("%i", touch);
 	//hduVector3Dd transformedProxyPosition;
 	hduMatrix mat;
 	vec3 tProxyPos;
+	int touched = -1;
 	for (int i = 0; i < hapticObjects.size(); i++){
 		if (hapticObjects[i].shapeId == object){
-			loaderIndex= i;
+			touched = i;
 			mat = (hapticObjects[i].transform).getInverse();
 			mat.multVecMatrix(proxyPosition, transformedProxyPosition);
 			tProxyPos[0] = transformedProxyPosition[0];
@@ -792,10 +874,12 @@ void HLCALLBACK hlMotionCB (HLenum event, HLuint object, HLenum thread, HLcache*
 	
 	//hduMatrix mat = (hapticObject.transform).getInverse();
 
-	printf("Motion Transformed Proxy Position x: %d, y: %d, z: %d\n", tProxyPos[0], tProxyPos[1], tProxyPos[2]);
+	SAMPLED_LOG("Motion Transformed Proxy Position x: %f, y: %f, z: %f\n", tProxyPos[0], tProxyPos[1], tProxyPos[2]);
 	
-	nearestID = findNearestVertex(tProxyPos);
-	currentFriction = loaderVec[loaderIndex].getFriction()[nearestID];
+	if (touched != -1){
+		trace.motion(touched, tProxyPos);
+		interaction.motion(touched, tProxyPos);
+	}
 	
 	//printf("%d ", nearestID);
 	
@@ -912,35 +996,31 @@ void updateDragObjectTransform(){
 
 }
 
-int findNearestVertex(vec3 proxyPosition){
-	int nearestPoint = -1;//we're going to return this later when we find the closest point
-	double distance;
-	double shortestDistance = 1000000;
-	int i;
-	vector<vec3> vContainer = loaderVec[loaderIndex].getVertices();
+vec3 toVec3(hduVector3Dd const &v){
+	return vec3((float)v[0], (float)v[1], (float)v[2]);
+}
 
-	for(i=0; i< vContainer.size(); i++)//outer loop
-	{ 
-		
-			vec3 myNeighbouringPoint = vContainer[i];
-			
-			//distance formula YAY!!
-			distance=sqrt(pow(proxyPosition.x-myNeighbouringPoint.x,2)+pow(proxyPosition.y-myNeighbouringPoint.y,2)+pow(proxyPosition.z-myNeighbouringPoint.z,2));
-			if(distance < shortestDistance){
-				shortestDistance = distance;
-				nearestPoint=i;
-		}
+//records where every object is, so a replay can map the device into model space
+void traceTransforms(){
+	for (int i = 0; i < hapticObjects.size(); i++){
+		hduMatrix worldToModel = hapticObjects[i].transform.getInverse();
+		trace.transform(i, worldToModel);
 	}
-	return nearestPoint;
 }
 
 void drawPoint(){
+	//read the object and vertex together so the index is always for this mesh
+	int object;
+	int vertex = interaction.nearestVertex(object);
+	MeshView view = scene.loader(object).view();
+	if (vertex < 0 || vertex >= (int)view.positions.size())
+		return;
+
 	glPointSize(10.0f);
 	glBegin(GL_POINTS);
 	{
 		glColor3f(1.0,1.0,0.0);
-		vec3 vert = loaderVec[loaderIndex].getVertices()[nearestID];
-		//vec3 vert = loaderVec[loaderIndex].getVertices()[nearestID];
+		vec3 vert = view.positions[vertex];
 		glVertex3f(vert[0],vert[1],vert[2]);
 	}
 
@@ -1011,41 +1091,30 @@ void drawBox(){
 	glPopAttrib();
 }
 
+//runs every servo tick, so it only does constant work: the deformation itself is queued for the solver thread
 HDCallbackCode HDCALLBACK AnchoredSpringForceCallback(void *pUserData){
-	hduVector3Dd force(0, 0, 0);
-	hduVector3Dd newModelPosition;
+	PROFILE_THREAD("servo");
+	PROFILE_SCOPE("servo tick");
+	interaction.servoTiming().beginTick();
 	HDErrorInfo error;
 	hdBeginFrame(hdGetCurrentDevice());
 	hdGetDoublev(HD_CURRENT_POSITION, trueDevicePosition);
-	vec3 newVEC3ProxyPosition;
-	hduVector3Dd devDifference;
-	hduMatrix mat;
-	if (bRenderForce){
-		// Compute force to be sent to the device here!!
-		devDifference = devicePosition - anchorInitDevicePosition;
-		newProxyPosition = anchorProxyPosition + devDifference;
-		
-		
-			
-				mat= (hapticObjects[loaderIndex].transform).getInverse();
-				mat.multVecMatrix(newProxyPosition, newModelPosition);
-
-				newVEC3ProxyPosition[0] = newModelPosition[0];
-				newVEC3ProxyPosition[1] = newModelPosition[1];
-				newVEC3ProxyPosition[2] = newModelPosition[2];
-				
-		
-				loaderVec[loaderIndex].deformSurface(anchorTouchPoint, newVEC3ProxyPosition, nearestNeighbour);
-			
-		force = (anchor-trueDevicePosition)*gSpringStiffness;//compute the force
-
-		hdSetDoublev(HD_CURRENT_FORCE, force);	
+	if (trace.isOpen()){
+		HDint buttons;
+		hdGetIntegerv(HD_CURRENT_BUTTONS, &buttons);
+		trace.servo(toVec3(trueDevicePosition), toVec3(devicePosition), buttons);
+	}
+	vec3 force;
+	if (interaction.servoTick(toVec3(trueDevicePosition), toVec3(devicePosition), force)){
+		hduVector3Dd hdForce(force[0], force[1], force[2]);
+		hdSetDoublev(HD_CURRENT_FORCE, hdForce);
 	}
 	hdEndFrame(hdGetCurrentDevice());
+	interaction.servoTiming().endTick();
 
 	if (HD_DEVICE_ERROR(error = hdGetError())) {
 		if (hduIsForceError(&error)) {
-			bRenderForce= HD_FALSE;
+			interaction.endAnchor();
 	}
 	else if (hduIsSchedulerError(&error)) {
 		return HD_CALLBACK_DONE;
@@ -0,0 +1,70 @@
+#include "backgroundwriter.h"
+#include "profiler.h"
+
+BackgroundWriter::BackgroundWriter() :
+mBusy(false),
+mStopping(false),
+mFailures(0)
+{
+}
+
+BackgroundWriter::~BackgroundWriter()
+{
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		mStopping = true;
+	}
+	mWake.notify_one();
+	if (mThread.joinable())
+		mThread.join();
+}
+
+void BackgroundWriter::post(std::function<bool()> const &job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		mJobs.push_back(job);
+		if (!mThread.joinable())
+			mThread = std::thread(&BackgroundWriter::run, this);
+	}
+	mWake.notify_one();
+}
+
+void BackgroundWriter::flush()
+{
+	std::unique_lock<std::mutex> lock(mLock);
+	mIdle.wait(lock, [this] { return mJobs.empty() && !mBusy; });
+}
+
+int BackgroundWriter::failures() const
+{
+	return mFailures.load();
+}
+
+BackgroundWriter &BackgroundWriter::shared()
+{
+	static BackgroundWriter writer;
+	return writer;
+}
+
+void BackgroundWriter::run()
+{
+	PROFILE_THREAD("writer");
+	std::unique_lock<std::mutex> lock(mLock);
+	for (;;) {
+		mWake.wait(lock, [this] { return mStopping || !mJobs.empty(); });
+		if (mJobs.empty())
+			return;
+		std::function<bool()> job;
+		job.swap(mJobs.front());
+		mJobs.pop_front();
+		mBusy = true;
+		lock.unlock();
+		if (!job())
+			mFailures.fetch_add(1);
+		lock.lock();
+		mBusy = false;
+		if (mJobs.empty())
+			mIdle.notify_all();
+	}
+}
@@ -0,0 +1,56 @@
+#ifndef BACKGROUNDWRITER_H
+#define BACKGROUNDWRITER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+//! One thread that runs file-writing jobs in the order they are posted.
+//!
+//! The caller copies what it wants written into the job and returns, so a
+//! save never holds up a frame or the haptic loop for the disk.  The thread
+//! starts with the first job.
+class BackgroundWriter {
+	public:
+		BackgroundWriter();
+
+		//! Runs the jobs still queued, then joins the thread.
+		//!
+		~BackgroundWriter();
+
+		//! Queues job, which returns false if its write failed.
+		//!
+		void post(std::function<bool()> const &job);
+
+		//! Waits until every job posted so far has run.
+		//!
+		void flush();
+
+		//! Jobs that have returned false.
+		//!
+		int failures() const;
+
+		//! Process-wide writer.
+		//!
+		static BackgroundWriter &shared();
+
+	private:
+		BackgroundWriter(BackgroundWriter const &);
+		BackgroundWriter &operator=(BackgroundWriter const &);
+
+		void run();
+
+		std::thread mThread;
+		std::mutex mLock;
+		std::condition_variable mWake;
+		std::condition_variable mIdle;
+		std::deque<std::function<bool()> > mJobs;
+		bool mBusy;                   // a job is running; guarded by mLock
+		bool mStopping;
+		std::atomic<int> mFailures;
+	};
+
+#endif
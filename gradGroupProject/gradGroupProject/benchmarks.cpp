@@ -0,0 +1,921 @@
+// Benchmarks for the geometry code, run over each of the bundled meshes.  A
+// separate program built on Google Benchmark by the CMake build; not part of
+// the Visual Studio project.
+//
+//   benchmarks [--mesh-dir dir] [Google Benchmark options]
+//
+// --mesh-dir defaults to the source directory.  To keep results for tracking
+// regressions, add --benchmark_out=file.json --benchmark_out_format=json (the
+// run_benchmarks target does) and compare runs with Google Benchmark's
+// tools/compare.py.
+//
+// What the suite covers, per mesh:
+//   - load, loadCached and loadScene: wall time, load/loadScene over 1 to
+//     hardware_concurrency() threads (threads:n).
+//   - parseGetline and parseOBJ: MB/s of the original getline/istringstream
+//     parser against the chunked one that replaced it.
+//   - computeNormals and unitize: 1..n threads crossed with the AoS and SoA
+//     vertex layouts (soa:0/1); Generate and saveOBJ over 1..n threads.
+//   - adjacencyMap/adjacencyCSR and oneRingMap/oneRingCSR: building and
+//     walking the old map-of-sets adjacency against the CSR graph, with the
+//     bytes each takes.
+//   - nearestVertex (soa:0/1), nearestScan (one per kernel: scalar, SSE2,
+//     AVX2) and closestPoint: queries per second.  nearestVertex and
+//     closestPoint also count the allocations they make per query
+//     (operator new is replaced here), which should be none.
+//   - the edit paths (deformSurface, brushRegion, deformRegion, undoRedo,
+//     rigidBegin, rigidIterate), saving, formatting, buildLod and
+//     hapticShape.
+//   - draw and editAndDraw: frame time of the immediate-mode and retained
+//     (buffer object) paths (retained:0/1).  These need an offscreen GL
+//     context (EGL, see offscreengl.h) and report an error without one; the
+//     rest run anywhere.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <new>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "meshcache.h"
+#include "nearestscan.h"
+#include "objloader.h"
+#include "objparser.h"
+#include "objwriter.h"
+#include "offscreengl.h"
+#include "rigidsolver.h"
+#include "scene.h"
+
+namespace {
+
+	// Every allocation through operator new, so the query benchmarks can show
+	// that the callback path allocates nothing, and the bytes asked for, so
+	// the adjacency benchmarks can weigh a node-based graph.
+	std::atomic<long long> gAllocations(0);
+	std::atomic<long long> gAllocatedBytes(0);
+}
+
+void *operator new(size_t size)
+{
+	gAllocations++;
+	gAllocatedBytes += (long long)size;
+	if (void *memory = malloc(size ? size : 1))
+		return memory;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept
+{
+	free(memory);
+}
+
+namespace {
+
+	const char *kMeshes[] = { "pencil", "shrek", "swq", "WavySurface", "bunny" };
+
+	const int kQueries = 1024;            // query points per mesh, cycled through
+
+	std::string gMeshDir = TVO_MESH_DIR;
+	bool gHaveGL = false;
+
+	std::string meshPath(std::string const &mesh)
+	{
+		return gMeshDir + "/" + mesh + ".obj";
+	}
+
+	bool copyFile(std::string const &from, std::string const &to)
+	{
+		FILE *in = fopen(from.c_str(), "rb");
+		if (!in)
+			return false;
+		FILE *out = fopen(to.c_str(), "wb");
+		if (!out) {
+			fclose(in);
+			return false;
+		}
+		char buffer[1 << 16];
+		size_t n;
+		while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0)
+			fwrite(buffer, 1, n, out);
+		fclose(in);
+		fclose(out);
+		return true;
+	}
+
+	size_t fileSize(std::string const &path)
+	{
+		FILE *file = fopen(path.c_str(), "rb");
+		if (!file)
+			return 0;
+		fseek(file, 0, SEEK_END);
+		long size = ftell(file);
+		fclose(file);
+		return size > 0 ? (size_t)size : 0;
+	}
+
+	// A copy of the mesh in the working directory, so the load benchmarks can
+	// make and delete its cache without touching the one next to the source.
+	std::string scratchCopy(std::string const &mesh)
+	{
+		std::string path = "bench-" + mesh + ".obj";
+		copyFile(meshPath(mesh), path);
+		return path;
+	}
+
+	// Each mesh is loaded once and shared by the benchmarks that only read it;
+	// the ones that edit get a copy of their own.  threads is what the
+	// loader's parallel passes then run on, layout what they run over.
+	OBJLoader &loaded(std::string const &mesh, bool edited = false, int threads = 1,
+		VertexLayout layout = VertexLayoutAoS)
+	{
+		static std::map<std::string, OBJLoader> loaders;
+		std::ostringstream key;
+		key << mesh << (edited ? "#edited" : "") << "#" << threads << "#" << layout;
+		std::map<std::string, OBJLoader>::iterator found = loaders.find(key.str());
+		if (found != loaders.end())
+			return found->second;
+		OBJLoader &loader = loaders[key.str()];
+		loader.setVertexLayout(layout);
+		loader.load(meshPath(mesh).c_str(), threads);
+		return loader;
+	}
+
+	// The second argument of the layout benchmarks: 0 for VertexLayoutAoS,
+	// 1 for VertexLayoutSoA.
+	VertexLayout layoutArg(benchmark::State &state, int arg)
+	{
+		return state.range(arg) ? VertexLayoutSoA : VertexLayoutAoS;
+	}
+
+	// Points scattered just off the surface, near the vertices, like the
+	// proxy positions the collision thread passes in.
+	std::vector<glm::vec3> queryPoints(OBJLoader const &loader)
+	{
+		std::vector<glm::vec3> const &vertices = loader.getVertices();
+		std::vector<glm::vec3> points(kQueries);
+		for (int i = 0; i < kQueries; i++) {
+			glm::vec3 offset(sinf(i * 1.7f), cosf(i * 2.3f), sinf(i * 0.9f));
+			points[i] = vertices[(size_t)i * 7919 % vertices.size()] + offset * 0.01f;
+		}
+		return points;
+	}
+
+	// The vertex the headless driver anchors its edit on: the topmost one.
+	int topVertex(OBJLoader const &loader)
+	{
+		std::vector<glm::vec3> const &vertices = loader.getVertices();
+		int top = 0;
+		for (size_t i = 1; i < vertices.size(); i++)
+			if (vertices[i].y > vertices[top].y)
+				top = (int)i;
+		return top;
+	}
+
+	void setCounters(benchmark::State &state, OBJLoader const &loader)
+	{
+		state.counters["vertices"] = (double)loader.getVertices().size();
+		state.counters["triangles"] = (double)(loader.getVertexIndices().size() / 3);
+	}
+
+	// Allocations per iteration since allocations was read before the loop;
+	// 0 is what the collision thread's queries must show.
+	void setAllocations(benchmark::State &state, long long allocations)
+	{
+		allocations = gAllocations - allocations;
+		state.counters["allocs"] = benchmark::Counter((double)allocations, benchmark::Counter::kAvgIterations);
+	}
+
+	// The whole first load: parsing, normals, unitize, adjacency, spatial
+	// index and writing the cache.
+	void loadObj(benchmark::State &state, std::string const &mesh)
+	{
+		std::string path = scratchCopy(mesh);
+		std::string cache = meshCachePath(path.c_str());
+		int threads = (int)state.range(0);
+		for (auto _ : state) {
+			state.PauseTiming();
+			remove(cache.c_str());
+			{
+				OBJLoader loader;
+				state.ResumeTiming();
+				if (!loader.load(path.c_str(), threads))
+					state.SkipWithError("load failed");
+				state.PauseTiming();
+			}
+			state.ResumeTiming();
+		}
+		remove(cache.c_str());
+		remove(path.c_str());
+	}
+
+	void loadCached(benchmark::State &state, std::string const &mesh)
+	{
+		std::string path = scratchCopy(mesh);
+		{
+			OBJLoader loader;
+			loader.load(path.c_str());
+		}
+		for (auto _ : state) {
+			state.PauseTiming();
+			{
+				OBJLoader loader;
+				state.ResumeTiming();
+				if (!loader.load(path.c_str()))
+					state.SkipWithError("load failed");
+				state.PauseTiming();
+			}
+			state.ResumeTiming();
+		}
+		remove(meshCachePath(path.c_str()).c_str());
+		remove(path.c_str());
+	}
+
+	// The getline and istringstream loop load() parsed with before
+	// parseOBJ(), kept only to measure against.  Like the original it reads
+	// "v", "vn" and three-corner "f" lines with plain vertex indices, and
+	// skips any line with a '#' or an 'm' in it.
+	bool parseGetline(std::string const &path, ObjData &out)
+	{
+		std::ifstream file(path.c_str());
+		if (!file.is_open())
+			return false;
+		out.clear();
+		std::string line;
+		while (std::getline(file, line)) {
+			if (line.find('#') != std::string::npos || line.find('m') != std::string::npos)
+				continue;
+			if (line.find('v') != std::string::npos) {
+				glm::vec3 v;
+				if (line.find('t') == std::string::npos && line.find('n') == std::string::npos) {
+					std::istringstream vertexLine(line.substr(2));
+					vertexLine >> v.x >> v.y >> v.z;
+					out.positions.push_back(v);
+				}
+				else if (line.find('n') != std::string::npos) {
+					std::istringstream normalLine(line.substr(3));
+					normalLine >> v.x >> v.y >> v.z;
+					out.normals.push_back(v);
+				}
+			}
+			else if (line.find("f ") != std::string::npos) {
+				std::istringstream faceLine(line);
+				std::string word;
+				faceLine >> word;
+				for (int corner = 0; corner < 3; corner++) {
+					int index = 0;
+					faceLine >> index;
+					out.positionIndices.push_back(index - 1);
+					out.normalIndices.push_back(index - 1);
+				}
+			}
+		}
+		return true;
+	}
+
+	// Reading and parsing the OBJ text alone, the old way and through
+	// parseOBJ().  Both report MB/s of OBJ text.
+	void parseOBJGetline(benchmark::State &state, std::string const &mesh)
+	{
+		std::string path = meshPath(mesh);
+		ObjData obj;
+		for (auto _ : state)
+			if (!parseGetline(path, obj))
+				state.SkipWithError("read failed");
+		state.SetBytesProcessed((int64_t)state.iterations() * (int64_t)fileSize(path));
+		state.counters["vertices"] = (double)obj.positions.size();
+	}
+
+	void parseOBJFile(benchmark::State &state, std::string const &mesh)
+	{
+		std::string path = meshPath(mesh);
+		std::vector<char> buffer;
+		ObjData obj;
+		for (auto _ : state) {
+			if (!readFile(path.c_str(), buffer)) {
+				state.SkipWithError("read failed");
+				break;
+			}
+			const char *text = buffer.empty() ? "" : &buffer[0];
+			parseOBJ(text, text + buffer.size(), obj);
+		}
+		state.SetBytesProcessed((int64_t)state.iterations() * (int64_t)fileSize(path));
+		state.counters["vertices"] = (double)obj.positions.size();
+	}
+
+	// The first argument of these three and of load is the number of
+	// threads; computeNormals and unitize take the layout as their second.
+	void computeNormals(benchmark::State &state, std::string const &mesh)
+	{
+		OBJLoader &loader = loaded(mesh, false, (int)state.range(0), layoutArg(state, 1));
+		std::vector<glm::vec3> normals;
+		for (auto _ : state) {
+			loader.computeNormals(loader.getVertices(), loader.getVertexIndices(), normals);
+			benchmark::DoNotOptimize(normals.data());
+		}
+		setCounters(state, loader);
+	}
+
+	// The mesh's own positions, so the SoA layout runs on its blocks; they
+	// are unitized already, so each pass leaves them where they were.
+	void unitize(benchmark::State &state, std::string const &mesh)
+	{
+		OBJLoader &loader = loaded(mesh, true, (int)state.range(0), layoutArg(state, 1));
+		for (auto _ : state) {
+			loader.unitize();
+			benchmark::ClobberMemory();
+		}
+		setCounters(state, loader);
+	}
+
+	void generate(benchmark::State &state, std::string const &mesh)
+	{
+		OBJLoader &loader = loaded(mesh, false, (int)state.range(0));
+		for (auto _ : state) {
+			loader.Generate();
+			benchmark::ClobberMemory();
+		}
+		setCounters(state, loader);
+	}
+
+	// What the old findNearestVertex() did, through the spatial index, or
+	// with the SoA layout (the argument) and a small mesh, the SIMD scan.
+	void nearestVertex(benchmark::State &state, std::string const &mesh)
+	{
+		OBJLoader &loader = loaded(mesh, false, 1, layoutArg(state, 0));
+		std::vector<glm::vec3> points = queryPoints(loader);
+		int i = 0;
+		long long allocations = gAllocations;
+		for (auto _ : state) {
+			benchmark::DoNotOptimize(loader.nearestVertex(points[i]));
+			i = (i + 1) % kQueries;
+		}
+		setAllocations(state, allocations);
+		setCounters(state, loader);
+	}
+
+	// The linear scan with each kernel forced (the argument is a
+	// NearestKernel), over all of the mesh's vertices.  Every query is
+	// checked against the scalar kernel first.
+	void nearestScanKernel(benchmark::State &state, std::string const &mesh)
+	{
+		NearestKernel kernel = (NearestKernel)state.range(0);
+		state.SetLabel(nearestKernelName(kernel));
+		if (kernel > bestNearestKernel()) {
+			state.SkipWithError("kernel not supported on this CPU");
+			return;
+		}
+		OBJLoader &loader = loaded(mesh);
+		VertexSoA points;
+		points.assign(loader.getVertices());
+		std::vector<glm::vec3> queries = queryPoints(loader);
+		for (int i = 0; i < kQueries; i++) {
+			if (nearestScan(points, queries[i], kernel) != nearestScan(points, queries[i], NearestKernelScalar)) {
+				state.SkipWithError("differs from the scalar kernel");
+				return;
+			}
+		}
+		int i = 0;
+		for (auto _ : state) {
+			benchmark::DoNotOptimize(nearestScan(points, queries[i], kernel));
+			i = (i + 1) % kQueries;
+		}
+		state.counters["queries"] = benchmark::Counter((double)state.iterations(), benchmark::Counter::kIsRate);
+		setCounters(state, loader);
+	}
+
+	// The contact query touch and motion events make now.
+	void closestPoint(benchmark::State &state, std::string const &mesh)
+	{
+		OBJLoader &loader = loaded(mesh);
+		std::vector<glm::vec3> points = queryPoints(loader);
+		SurfacePoint point;
+		int i = 0;
+		long long allocations = gAllocations;
+		for (auto _ : state) {
+			benchmark::DoNotOptimize(loader.closestPoint(points[i], point));
+			i = (i + 1) % kQueries;
+		}
+		setAllocations(state, allocations);
+		setCounters(state, loader);
+	}
+
+	typedef std::map<int, std::set<int> > NodeGraph;
+
+	// The one-ring graph as Generate() built it before the CSR arrays: a
+	// set per vertex in a map.  Edges are linked both ways here, so it holds
+	// exactly the CSR graph's edges.
+	void buildNodeGraph(std::vector<Triangle> const &triangles, NodeGraph &graph)
+	{
+		for (size_t i = 0; i < triangles.size(); i++) {
+			int const *v = triangles[i].vert;
+			for (int k = 0; k < 3; k++) {
+				int a = v[k], b = v[(k + 1) % 3];
+				if (a != b) {
+					graph[a].insert(b);
+					graph[b].insert(a);
+				}
+			}
+		}
+	}
+
+	// Building each graph from the mesh's triangles.  bytes is what the
+	// finished graph holds: the heap asked for by a build of the map (it
+	// frees nothing), CSRGraph::memoryBytes() for the arrays.
+	void adjacencyMap(benchmark::State &state, std::string const &mesh)
+	{
+		OBJLoader &loader = loaded(mesh);
+		long long bytes = 0;
+		size_t edges = 0;
+		for (auto _ : state) {
+			long long before = gAllocatedBytes;
+			NodeGraph graph;
+			buildNodeGraph(loader.getTriangles(), graph);
+			bytes = gAllocatedBytes - before;
+			state.PauseTiming();
+			edges = 0;
+			for (NodeGraph::const_iterator it = graph.begin(); it != graph.end(); ++it)
+				edges += it->second.size();
+			graph.clear();
+			state.ResumeTiming();
+		}
+		state.counters["bytes"] = (double)bytes;
+		state.counters["edges"] = (double)edges;
+	}
+
+	void adjacencyCSR(benchmark::State &state, std::string const &mesh)
+	{
+		OBJLoader &loader = loaded(mesh);
+		CSRGraph graph;
+		for (auto _ : state)
+			graph.buildOneRing(loader.getVertexIndices(), loader.getVertices().size());
+		state.counters["bytes"] = (double)graph.memoryBytes();
+		state.counters["edges"] = (double)graph.edgeCount();
+	}
+
+	// Walking every vertex's one-ring once, as the brush and rigid solver
+	// setups do for their regions.
+	void oneRingMap(benchmark::State &state, std::string const &mesh)
+	{
+		OBJLoader &loader = loaded(mesh);
+		NodeGraph graph;
+		buildNodeGraph(loader.getTriangles(), graph);
+		long long sum = 0;
+		for (auto _ : state) {
+			sum = 0;
+			for (int v = 0; v < (int)loader.getVertices().size(); v++) {
+				NodeGraph::const_iterator ring = graph.find(v);
+				if (ring == graph.end())
+					continue;
+				for (std::set<int>::const_iterator n = ring->second.begin(); n != ring->second.end(); ++n)
+					sum += *n;
+			}
+			benchmark::DoNotOptimize(sum);
+		}
+		state.counters["checksum"] = (double)sum;
+	}
+
+	void oneRingCSR(benchmark::State &state, std::string const &mesh)
+	{
+		OBJLoader &loader = loaded(mesh);
+		CSRGraph const &graph = loader.adjacency();
+		long long sum = 0;
+		for (auto _ : state) {
+			sum = 0;
+			for (int v = 0; v < (int)graph.vertexCount(); v++) {
+				ConstSpan<int> ring = graph.neighbours(v);
+				for (size_t n = 0; n < ring.size(); n++)
+					sum += ring[n];
+			}
+			benchmark::DoNotOptimize(sum);
+		}
+		state.counters["checksum"] = (double)sum;
+	}
+
+	// One edit as the solver applies it, pulling the top vertex and its ring
+	// back and forth so the mesh does not drift between runs.
+	void deformSurface(benchmark::State &state, std::string const &mesh)
+	{
+		OBJLoader &loader = loaded(mesh, true);
+		int anchor = topVertex(loader);
+		ConstSpan<int> ring = loader.neighbours(anchor);
+		std::set<int> neighbours(ring.begin(), ring.end());
+		glm::vec3 rest = loader.getVertices()[anchor];
+		glm::vec3 pulled = rest + glm::vec3(0.0f, 0.01f, 0.0f);
+		bool out = false;
+		for (auto _ : state) {
+			out = !out;
+			loader.deformSurface(anchor, out ? pulled : rest, neighbours);
+		}
+		if (out)
+			loader.deformSurface(anchor, rest, neighbours);
+		setCounters(state, loader);
+	}
+
+	// Finding the vertices a brush moves and their weights, once per edit.
+	// The argument is the radius in hundredths of the unitized mesh's units.
+	void brushRegion(benchmark::State &state, std::string const &mesh)
+	{
+		OBJLoader &loader = loaded(mesh, true);
+		Brush brush = kDefaultBrush;
+		brush.radius = state.range(0) / 100.0f;
+		int anchor = topVertex(loader);
+		BrushRegion region;
+		for (auto _ : state)
+			loader.brushRegion(anchor, brush, region);
+		state.counters["region"] = (double)region.vertices.size();
+	}
+
+	// One brush edit as the solver applies it, back and forth like
+	// deformSurface.
+	void deformRegion(benchmark::State &state, std::string const &mesh)
+	{
+		OBJLoader &loader = loaded(mesh, true);
+		Brush brush = kDefaultBrush;
+		brush.radius = state.range(0) / 100.0f;
+		int anchor = topVertex(loader);
+		BrushRegion region;
+		loader.brushRegion(anchor, brush, region);
+		glm::vec3 rest = loader.getVertices()[anchor];
+		glm::vec3 pulled = rest + glm::vec3(0.0f, 0.01f, 0.0f);
+		bool out = false;
+		for (auto _ : state) {
+			out = !out;
+			loader.deformRegion(out ? pulled : rest, region);
+		}
+		if (out)
+			loader.deformRegion(rest, region);
+		state.counters["region"] = (double)region.vertices.size();
+	}
+
+	// Undoing and redoing one brush edit: only the vertices it moved are
+	// swapped back and forth.
+	void undoRedo(benchmark::State &state, std::string const &mesh)
+	{
+		OBJLoader &loader = loaded(mesh, true);
+		Brush brush = kDefaultBrush;
+		brush.radius = state.range(0) / 100.0f;
+		int anchor = topVertex(loader);
+		BrushRegion region;
+		loader.brushRegion(anchor, brush, region);
+		loader.commitEdit();
+		loader.deformRegion(loader.getVertices()[anchor] + glm::vec3(0.0f, 0.01f, 0.0f), region);
+		loader.commitEdit();
+		for (auto _ : state) {
+			loader.undoEdit();
+			loader.redoEdit();
+		}
+		loader.undoEdit();
+		state.counters["region"] = (double)region.vertices.size();
+	}
+
+	// Setting up a rigid edit: the region's system built and factorized, once
+	// per edit.
+	void rigidBegin(benchmark::State &state, std::string const &mesh)
+	{
+		OBJLoader &loader = loaded(mesh, true);
+		Brush brush = kDefaultBrush;
+		brush.radius = state.range(0) / 100.0f;
+		BrushRegion region;
+		loader.brushRegion(topVertex(loader), brush, region);
+		RigidSolver solver;
+		for (auto _ : state)
+			benchmark::DoNotOptimize(solver.begin(loader.adjacency(), loader.getVertices(), region.vertices));
+		state.counters["region"] = (double)region.vertices.size();
+		state.counters["factor"] = (double)solver.factorSize();
+	}
+
+	// One rigid iteration as the solver runs it per target, back and forth;
+	// the mesh itself is left alone.
+	void rigidIterate(benchmark::State &state, std::string const &mesh)
+	{
+		OBJLoader &loader = loaded(mesh, true);
+		Brush brush = kDefaultBrush;
+		brush.radius = state.range(0) / 100.0f;
+		int anchor = topVertex(loader);
+		BrushRegion region;
+		loader.brushRegion(anchor, brush, region);
+		RigidSolver solver;
+		if (!solver.begin(loader.adjacency(), loader.getVertices(), region.vertices)) {
+			state.SkipWithError("region too small");
+			return;
+		}
+		glm::vec3 rest = loader.getVertices()[anchor];
+		glm::vec3 pulled = rest + glm::vec3(0.0f, 0.01f, 0.0f);
+		std::vector<glm::vec3> positions;
+		bool out = false;
+		for (auto _ : state) {
+			out = !out;
+			solver.iterate(out ? pulled : rest, positions);
+		}
+		state.counters["region"] = (double)region.vertices.size();
+	}
+
+	// Saving a binary snapshot: one copy into a buffer and one write.
+	void saveBinary(benchmark::State &state, std::string const &mesh)
+	{
+		OBJLoader &loader = loaded(mesh);
+		std::string path = "bench-" + mesh + ".mesh";
+		for (auto _ : state)
+			if (!loader.saveBinary(path.c_str()))
+				state.SkipWithError("save failed");
+		state.SetBytesProcessed((int64_t)state.iterations() * (int64_t)fileSize(path));
+		remove(path.c_str());
+	}
+
+	// Saving as OBJ, formatting included.  The argument is the number of
+	// threads the mesh is loaded, and so formatted, with.
+	void saveOBJ(benchmark::State &state, std::string const &mesh)
+	{
+		std::string source = scratchCopy(mesh);
+		OBJLoader loader;
+		loader.load(source.c_str(), (int)state.range(0));
+		std::string path = "bench-" + mesh + "-saved.obj";
+		for (auto _ : state)
+			if (!loader.saveOBJ(path.c_str()))
+				state.SkipWithError("save failed");
+		state.SetBytesProcessed((int64_t)state.iterations() * (int64_t)fileSize(path));
+		remove(path.c_str());
+		remove(meshCachePath(source.c_str()).c_str());
+		remove(source.c_str());
+	}
+
+	// The OBJ formatting alone, against the same text through an ostream.
+	void formatOBJText(benchmark::State &state, std::string const &mesh)
+	{
+		MeshView view = loaded(mesh).view();
+		std::vector<glm::vec3> positions(view.positions.begin(), view.positions.end());
+		std::vector<glm::vec3> normals(view.normals.begin(), view.normals.end());
+		std::vector<int> indices(view.indices.begin(), view.indices.end());
+		std::vector<glm::vec3> colors;
+		std::vector<char> text;
+		for (auto _ : state) {
+			text.clear();
+			formatOBJ(text, positions, normals, colors, indices);
+		}
+		state.SetBytesProcessed((int64_t)state.iterations() * (int64_t)text.size());
+	}
+
+	void formatOBJStream(benchmark::State &state, std::string const &mesh)
+	{
+		MeshView view = loaded(mesh).view();
+		size_t bytes = 0;
+		for (auto _ : state) {
+			std::ostringstream out;
+			out << std::fixed << std::setprecision(kFloatDecimals);
+			for (size_t i = 0; i < view.positions.size(); i++)
+				out << "v " << view.positions[i].x << ' ' << view.positions[i].y << ' ' << view.positions[i].z << '\n';
+			for (size_t i = 0; i < view.normals.size(); i++)
+				out << "vn " << view.normals[i].x << ' ' << view.normals[i].y << ' ' << view.normals[i].z << '\n';
+			for (size_t i = 0; i + 2 < view.indices.size(); i += 3) {
+				out << 'f';
+				for (int corner = 0; corner < 3; corner++)
+					out << ' ' << view.indices[i + corner] + 1 << "//" << view.indices[i + corner] + 1;
+				out << '\n';
+			}
+			bytes = out.str().size();
+		}
+		state.SetBytesProcessed((int64_t)state.iterations() * (int64_t)bytes);
+	}
+
+	// The argument of the draw benchmarks is the RenderPath.
+	RenderPath renderPathArg(benchmark::State &state)
+	{
+		RenderPath path = state.range(0) ? RenderPathRetained : RenderPathImmediate;
+		state.SetLabel(path == RenderPathRetained ? "retained" : "immediate");
+		return path;
+	}
+
+	// Drawing an unchanged mesh: the retained path only binds and draws, the
+	// immediate one sends every vertex again.
+	void draw(benchmark::State &state, std::string const &mesh)
+	{
+		if (!gHaveGL) {
+			state.SkipWithError("no offscreen GL context");
+			return;
+		}
+		OBJLoader &loader = loaded(mesh);
+		loader.setRenderPath(renderPathArg(state));
+		loader.drawColorObj();
+		for (auto _ : state) {
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			loader.drawColorObj();
+			glFinish();
+		}
+		loader.setRenderPath(RenderPathRetained);
+		setCounters(state, loader);
+	}
+
+	// A graphics frame after one edit: the normals around the edit are
+	// brought up to date and, on the retained path, only the vertices they
+	// change are sent; then the mesh is drawn.
+	void editAndDraw(benchmark::State &state, std::string const &mesh)
+	{
+		if (!gHaveGL) {
+			state.SkipWithError("no offscreen GL context");
+			return;
+		}
+		OBJLoader &loader = loaded(mesh, true);
+		loader.setRenderPath(renderPathArg(state));
+		int anchor = topVertex(loader);
+		ConstSpan<int> ring = loader.neighbours(anchor);
+		std::set<int> neighbours(ring.begin(), ring.end());
+		glm::vec3 rest = loader.getVertices()[anchor];
+		glm::vec3 pulled = rest + glm::vec3(0.0f, 0.01f, 0.0f);
+		bool out = false;
+		loader.drawColorObj();
+		for (auto _ : state) {
+			state.PauseTiming();
+			out = !out;
+			loader.deformSurface(anchor, out ? pulled : rest, neighbours);
+			state.ResumeTiming();
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			loader.drawColorObj();
+			glFinish();
+		}
+		if (out)
+			loader.deformSurface(anchor, rest, neighbours);
+		loader.setRenderPath(RenderPathRetained);
+		setCounters(state, loader);
+	}
+
+	void buildLod(benchmark::State &state, std::string const &mesh)
+	{
+		OBJLoader &loader = loaded(mesh);
+		LodHierarchy lod;
+		for (auto _ : state) {
+			lod.build(loader.getVertices(), loader.getVertexIndices());
+			benchmark::ClobberMemory();
+		}
+		setCounters(state, loader);
+		state.counters["levels"] = (double)lod.levelCount();
+	}
+
+	// The haptic shape after one edit: the display list is rebuilt from the
+	// level within the budget (0 for the full mesh) and drawn.
+	void hapticShape(benchmark::State &state, std::string const &mesh)
+	{
+		if (!gHaveGL) {
+			state.SkipWithError("no offscreen GL context");
+			return;
+		}
+		OBJLoader &loader = loaded(mesh, true);
+		loader.setTriangleBudgets((size_t)state.range(0), 0);
+		int anchor = topVertex(loader);
+		ConstSpan<int> ring = loader.neighbours(anchor);
+		std::set<int> neighbours(ring.begin(), ring.end());
+		glm::vec3 rest = loader.getVertices()[anchor];
+		glm::vec3 pulled = rest + glm::vec3(0.0f, 0.01f, 0.0f);
+		bool out = false;
+		loader.drawHapticObj();
+		for (auto _ : state) {
+			state.PauseTiming();
+			out = !out;
+			loader.deformSurface(anchor, out ? pulled : rest, neighbours);
+			state.ResumeTiming();
+			loader.drawHapticObj();
+			glFinish();
+		}
+		if (out)
+			loader.deformSurface(anchor, rest, neighbours);
+		state.counters["hapticTriangles"] = (double)loader.hapticTriangles();
+		loader.setTriangleBudgets(kDefaultHapticTriangles, 0);
+		setCounters(state, loader);
+	}
+
+	// A cold start of a scene with every mesh found, each placed twice: the
+	// distinct meshes load once each, side by side with threads > 1.
+	void loadScene(benchmark::State &state, std::vector<std::string> const &meshes)
+	{
+		std::vector<std::string> paths;
+		for (size_t m = 0; m < meshes.size(); m++)
+			paths.push_back(scratchCopy(meshes[m]));
+		int threads = (int)state.range(0);
+		for (auto _ : state) {
+			state.PauseTiming();
+			for (size_t m = 0; m < paths.size(); m++)
+				remove(meshCachePath(paths[m].c_str()).c_str());
+			{
+				Scene scene;
+				for (int copy = 0; copy < 2; copy++)
+					for (size_t m = 0; m < paths.size(); m++)
+						scene.addObject(paths[m]);
+				state.ResumeTiming();
+				if (!scene.loadMeshes(threads))
+					state.SkipWithError("load failed");
+				state.PauseTiming();
+				state.counters["objects"] = (double)scene.objectCount();
+				state.counters["meshes"] = (double)scene.meshCount();
+			}
+			state.ResumeTiming();
+		}
+		for (size_t m = 0; m < paths.size(); m++) {
+			remove(meshCachePath(paths[m].c_str()).c_str());
+			remove(paths[m].c_str());
+		}
+	}
+
+	typedef void (*MeshBenchmark)(benchmark::State &, std::string const &);
+
+	int gHardwareThreads = 1;
+
+	benchmark::internal::Benchmark *add(const char *name, MeshBenchmark function, std::string const &mesh)
+	{
+		return benchmark::RegisterBenchmark((std::string(name) + "/" + mesh).c_str(), function, mesh)
+			->Unit(benchmark::kMicrosecond);
+	}
+
+	// 1, 2, 4, ... threads up to every hardware thread, timed by the wall
+	// clock: CPU time only counts the thread that waits for the pool.
+	benchmark::internal::Benchmark *threadSweep(benchmark::internal::Benchmark *benchmark)
+	{
+		return benchmark->ArgName("threads")->RangeMultiplier(2)->Range(1, gHardwareThreads)->UseRealTime();
+	}
+
+	// The same for both vertex layouts.
+	benchmark::internal::Benchmark *threadAndLayoutSweep(benchmark::internal::Benchmark *benchmark)
+	{
+		return benchmark->ArgNames({"threads", "soa"})->RangeMultiplier(2)
+			->Ranges({{1, gHardwareThreads}, {0, 1}})->UseRealTime();
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	// Ours first: Google Benchmark rejects options it does not know.
+	int kept = 1;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--mesh-dir") && i + 1 < argc)
+			gMeshDir = argv[++i];
+		else
+			argv[kept++] = argv[i];
+	}
+	argc = kept;
+
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv))
+		return 1;
+
+	gHaveGL = makeOffscreenContext();
+	if (gHaveGL)
+		glEnable(GL_DEPTH_TEST);
+
+	gHardwareThreads = std::max((int)std::thread::hardware_concurrency(), 1);
+	std::vector<std::string> found;
+	for (size_t m = 0; m < sizeof(kMeshes) / sizeof(kMeshes[0]); m++) {
+		std::string mesh = kMeshes[m];
+		FILE *file = fopen(meshPath(mesh).c_str(), "rb");
+		if (!file) {
+			fprintf(stderr, "Skipping %s: not found in %s\n", mesh.c_str(), gMeshDir.c_str());
+			continue;
+		}
+		fclose(file);
+		found.push_back(mesh);
+
+		threadSweep(add("load", loadObj, mesh));
+		add("loadCached", loadCached, mesh);
+		add("parseGetline", parseOBJGetline, mesh);
+		add("parseOBJ", parseOBJFile, mesh);
+		threadAndLayoutSweep(add("computeNormals", computeNormals, mesh));
+		threadAndLayoutSweep(add("unitize", unitize, mesh));
+		threadSweep(add("Generate", generate, mesh));
+		add("adjacencyMap", adjacencyMap, mesh);
+		add("adjacencyCSR", adjacencyCSR, mesh);
+		add("oneRingMap", oneRingMap, mesh);
+		add("oneRingCSR", oneRingCSR, mesh);
+		add("nearestVertex", nearestVertex, mesh)->Unit(benchmark::kNanosecond)->ArgName("soa")->Arg(0)->Arg(1);
+		add("nearestScan", nearestScanKernel, mesh)->Unit(benchmark::kNanosecond)->ArgName("kernel")
+			->DenseRange(NearestKernelScalar, NearestKernelAVX2);
+		add("closestPoint", closestPoint, mesh)->Unit(benchmark::kNanosecond);
+		add("deformSurface", deformSurface, mesh);
+		add("brushRegion", brushRegion, mesh)->ArgName("radius")->Arg(5)->Arg(15)->Arg(40);
+		add("deformRegion", deformRegion, mesh)->ArgName("radius")->Arg(5)->Arg(15)->Arg(40);
+		add("undoRedo", undoRedo, mesh)->ArgName("radius")->Arg(5)->Arg(15)->Arg(40);
+		add("rigidBegin", rigidBegin, mesh)->ArgName("radius")->Arg(5)->Arg(15)->Arg(40);
+		add("rigidIterate", rigidIterate, mesh)->ArgName("radius")->Arg(5)->Arg(15)->Arg(40);
+		add("saveBinary", saveBinary, mesh);
+		threadSweep(add("saveOBJ", saveOBJ, mesh));
+		add("formatOBJ", formatOBJText, mesh);
+		add("formatOBJStream", formatOBJStream, mesh);
+		add("draw", draw, mesh)->ArgName("retained")->Arg(RenderPathImmediate)->Arg(RenderPathRetained);
+		add("editAndDraw", editAndDraw, mesh)->ArgName("retained")->Arg(RenderPathImmediate)->Arg(RenderPathRetained);
+		add("buildLod", buildLod, mesh)->Unit(benchmark::kMillisecond);
+		add("hapticShape", hapticShape, mesh)->ArgName("budget")->Arg(0)->Arg(5000)->Arg(20000);
+	}
+	if (!found.empty()) {
+		threadSweep(benchmark::RegisterBenchmark("loadScene", loadScene, found)->Unit(benchmark::kMillisecond));
+	}
+
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
@@ -0,0 +1,21 @@
+#include "brush.h"
+
+bool adjustBrush(Brush &brush, char key)
+{
+	switch (key) {
+	case '[':
+		brush.radius /= kBrushStep;
+		return true;
+	case ']':
+		// Growing from 0, the one-ring edit, starts from the default size.
+		brush.radius = brush.radius > 0.0f ? brush.radius * kBrushStep : kDefaultBrush.radius;
+		return true;
+	case 'G':
+		brush.metric = brush.metric == BrushGeodesic ? BrushEuclidean : BrushGeodesic;
+		return true;
+	case 'R':
+		brush.mode = brush.mode == BrushFalloff ? BrushRigid : BrushFalloff;
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,49 @@
+#ifndef BRUSH_H
+#define BRUSH_H
+
+#include <vector>
+
+//! How OBJLoader::brushRegion() measures distance from the anchor.
+//!
+enum BrushMetric {
+	BrushGeodesic,     // along the mesh edges
+	BrushEuclidean     // in a straight line, over vertices connected to the anchor inside the radius
+};
+
+//! How an anchored edit moves the vertices brushRegion() finds.
+//!
+enum BrushMode {
+	BrushFalloff,      // each by its SmoothBell() weight times the anchor's move
+	BrushRigid         // as rigidly as possible around the anchor, by RigidSolver
+};
+
+//! Reach of an anchored edit.  Vertices within radius of the anchor follow it
+//! with a smooth bell falloff; a radius of 0 is the original edit, the anchor
+//! and its one-ring at half strength.
+struct Brush {
+	float radius;          // model space; the unitized mesh is 2 across
+	int rings;             // most edges between the anchor and a moved vertex; 0 for no limit
+	BrushMetric metric;
+	BrushMode mode;
+};
+
+const Brush kDefaultBrush = { 0.15f, 0, BrushGeodesic, BrushFalloff };
+
+//! Factor the brush keys grow or shrink the radius by.
+//!
+const float kBrushStep = 1.25f;
+
+//! Applies a brush key to brush: '[' shrinks the radius, ']' grows it, 'G'
+//! switches between geodesic and Euclidean distance and 'R' between the
+//! falloff and rigid modes.  Returns false, leaving brush alone, for any
+//! other key.
+bool adjustBrush(Brush &brush, char key);
+
+//! The vertices one edit moves and how far, as a fraction of the anchor's
+//! move.  The anchor comes first, with weight 1.
+struct BrushRegion {
+	std::vector<int> vertices;
+	std::vector<float> weights;
+};
+
+#endif
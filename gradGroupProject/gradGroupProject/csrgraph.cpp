@@ -0,0 +1,88 @@
+#include <algorithm>
+#include "csrgraph.h"
+#include "threadpool.h"
+
+CSRGraph::CSRGraph()
+{
+}
+
+void CSRGraph::clear()
+{
+	mOffsets.clear();
+	mNeighbours.clear();
+}
+
+void CSRGraph::assign(std::vector<int> &offsets, std::vector<int> &neighbours)
+{
+	mOffsets.swap(offsets);
+	mNeighbours.swap(neighbours);
+}
+
+size_t CSRGraph::memoryBytes() const
+{
+	return mOffsets.capacity() * sizeof(int) + mNeighbours.capacity() * sizeof(int);
+}
+
+void CSRGraph::buildOneRing(std::vector<int> const &indices, size_t vertexCount, int threads)
+{
+	size_t cornerCount = indices.size() / 3 * 3;
+
+	// Every triangle contributes two half-edges per corner: to the next and
+	// to the previous corner.
+	std::vector<int> start(vertexCount + 1, 0);
+	for (size_t i = 0; i < cornerCount; i++)
+		start[indices[i] + 1] += 2;
+	for (size_t v = 0; v < vertexCount; v++)
+		start[v + 1] += start[v];
+
+	std::vector<int> raw(start[vertexCount]);
+	std::vector<int> fill(start.begin(), start.end() - 1);
+	for (size_t t = 0; t < cornerCount; t += 3) {
+		int a = indices[t], b = indices[t + 1], c = indices[t + 2];
+		raw[fill[a]++] = b; raw[fill[a]++] = c;
+		raw[fill[b]++] = c; raw[fill[b]++] = a;
+		raw[fill[c]++] = a; raw[fill[c]++] = b;
+	}
+
+	// Interior edges appear twice in each row; sort and drop the duplicates
+	// (and the self loops of degenerate triangles), remembering each row's
+	// final length.
+	std::vector<int> degree(vertexCount);
+	parallelFor(threads, vertexCount, [&](size_t lo, size_t hi) {
+		for (size_t v = lo; v < hi; v++) {
+			std::vector<int>::iterator first = raw.begin() + start[v];
+			std::sort(first, raw.begin() + start[v + 1]);
+			std::vector<int>::iterator last = std::unique(first, raw.begin() + start[v + 1]);
+			degree[v] = (int)(std::remove(first, last, (int)v) - first);
+		}
+	});
+
+	mOffsets.assign(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		mOffsets[v + 1] = mOffsets[v] + degree[v];
+
+	mNeighbours.resize(mOffsets[vertexCount]);
+	parallelFor(threads, vertexCount, [&](size_t lo, size_t hi) {
+		for (size_t v = lo; v < hi; v++)
+			std::copy(raw.begin() + start[v], raw.begin() + start[v] + degree[v],
+				mNeighbours.begin() + mOffsets[v]);
+	});
+}
+
+void CSRGraph::buildIncidence(std::vector<int> const &indices, size_t vertexCount)
+{
+	size_t cornerCount = indices.size() / 3 * 3;
+
+	mOffsets.assign(vertexCount + 1, 0);
+	for (size_t i = 0; i < cornerCount; i++)
+		mOffsets[indices[i] + 1]++;
+	for (size_t v = 0; v < vertexCount; v++)
+		mOffsets[v + 1] += mOffsets[v];
+
+	// Triangles are visited in order, so every row comes out sorted.  A
+	// degenerate triangle that repeats a corner is listed once per repeat.
+	mNeighbours.resize(cornerCount);
+	std::vector<int> fill(mOffsets.begin(), mOffsets.end() - 1);
+	for (size_t i = 0; i < cornerCount; i++)
+		mNeighbours[fill[indices[i]]++] = (int)(i / 3);
+}
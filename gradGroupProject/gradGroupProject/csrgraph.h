@@ -0,0 +1,55 @@
+#ifndef CSRGRAPH_H
+#define CSRGRAPH_H
+
+#include <cstddef>
+#include <vector>
+#include "span.h"
+
+//! Compressed sparse row graph: the neighbours of vertex v are
+//! neighbours()[offsets()[v] .. offsets()[v + 1]), sorted ascending.
+//!
+//! Two flat int arrays replace a tree node per edge, so walking a one-ring is
+//! a linear read of a few adjacent ints.
+class CSRGraph {
+	public:
+		CSRGraph();
+
+		//! Builds the undirected one-ring adjacency of a triangle mesh in O(E):
+		//! a counting sort of every half-edge by source vertex, then a sort and
+		//! de-duplication of each (short) row.
+		void buildOneRing(std::vector<int> const &indices, size_t vertexCount, int threads = 1);
+
+		//! Builds the vertex-to-triangle incidence of a triangle mesh: row v
+		//! lists every triangle with v as a corner, ascending.
+		void buildIncidence(std::vector<int> const &indices, size_t vertexCount);
+
+		//! Takes ownership of ready-made CSR arrays, e.g. from the mesh cache.
+		//!
+		void assign(std::vector<int> &offsets, std::vector<int> &neighbours);
+
+		void clear();
+
+		ConstSpan<int> neighbours(int v) const
+		{
+			return ConstSpan<int>(mNeighbours.empty() ? 0 : &mNeighbours[0] + mOffsets[v],
+				(size_t)(mOffsets[v + 1] - mOffsets[v]));
+		}
+
+		int degree(int v) const { return mOffsets[v + 1] - mOffsets[v]; }
+
+		size_t vertexCount() const { return mOffsets.empty() ? 0 : mOffsets.size() - 1; }
+		size_t edgeCount() const { return mNeighbours.size(); }
+
+		//! Bytes held by the two arrays.
+		//!
+		size_t memoryBytes() const;
+
+		std::vector<int> const &offsets() const { return mOffsets; }
+		std::vector<int> const &neighbourArray() const { return mNeighbours; }
+
+	private:
+		std::vector<int> mOffsets;
+		std::vector<int> mNeighbours;
+	};
+
+#endif
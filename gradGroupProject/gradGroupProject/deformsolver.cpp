@@ -0,0 +1,149 @@
+#include <chrono>
+#include "deformsolver.h"
+#include "objloader.h"
+#include "profiler.h"
+
+DeformSolver::DeformSolver() :
+mStopping(false),
+mEdit(0),
+mApplied(0),
+mLoader(0),
+mAnchor(-1),
+mBrush(kDefaultBrush),
+mLoaderEdit(0),
+mRegionEdit(0),
+mLastTarget(0.0f, 0.0f, 0.0f),
+mSettling(0)
+{
+}
+
+DeformSolver::~DeformSolver()
+{
+	stop();
+}
+
+void DeformSolver::start()
+{
+	if (mThread.joinable())
+		return;
+	mStopping.store(false);
+	mThread = std::thread(&DeformSolver::run, this);
+}
+
+void DeformSolver::stop()
+{
+	if (!mThread.joinable())
+		return;
+	mStopping.store(true);
+	mThread.join();
+}
+
+void DeformSolver::beginEdit(OBJLoader *loader, int anchor, Brush const &brush)
+{
+	std::lock_guard<std::mutex> lock(mEditLock);
+	mLoader = loader;
+	mAnchor = anchor;
+	mBrush = brush;
+	mLoaderEdit = mEdit.fetch_add(1) + 1;
+}
+
+// Bumping the edit number drops whatever is queued for the old one, and the
+// rigid solve stops settling.
+void DeformSolver::endEdit()
+{
+	mLoader = 0;
+	mLoaderEdit = mEdit.fetch_add(1) + 1;
+}
+
+bool DeformSolver::undo(OBJLoader *loader)
+{
+	std::lock_guard<std::mutex> lock(mEditLock);
+	endEdit();
+	return loader->undoEdit();
+}
+
+bool DeformSolver::redo(OBJLoader *loader)
+{
+	std::lock_guard<std::mutex> lock(mEditLock);
+	endEdit();
+	return loader->redoEdit();
+}
+
+bool DeformSolver::submit(glm::vec3 const &target)
+{
+	Target t;
+	t.position = target;
+	t.edit = mEdit.load();
+	return mTargets.push(t);
+}
+
+int DeformSolver::applied() const
+{
+	return mApplied.load();
+}
+
+void DeformSolver::run()
+{
+	PROFILE_THREAD("solver");
+	for (;;) {
+		// Read the flag first so targets queued before stop() still land.
+		bool stopping = mStopping.load();
+		drain();
+		if (stopping)
+			return;
+		std::this_thread::sleep_for(std::chrono::microseconds(kIdleMicros));
+	}
+}
+
+void DeformSolver::drain()
+{
+	Target target, latest;
+	int coalesced = 0;
+	while (mTargets.pop(target)) {
+		latest = target;
+		coalesced++;
+	}
+	if (!coalesced) {
+		// With nothing queued the lock is only taken while rigid settling
+		// is pending, so an idle solver never contends with the editor.
+		if (mSettling > 0) {
+			std::lock_guard<std::mutex> lock(mEditLock);
+			if (mRegionEdit == mLoaderEdit) {
+				mRigid.iterate(mLastTarget, mRigidPositions);
+				mLoader->moveVertices(mRigid.vertices(), mRigidPositions);
+				mSettling--;
+			}
+			else
+				mSettling = 0;
+		}
+		return;
+	}
+
+	// Edit numbers only grow along the queue, so if the newest target was
+	// stamped for an earlier anchor, all of them were.
+	PROFILE_COUNTER("targets coalesced", coalesced);
+	std::lock_guard<std::mutex> lock(mEditLock);
+	if (!mLoader || latest.edit != mLoaderEdit)
+		return;
+	if (mRegionEdit != mLoaderEdit) {
+		mLoader->commitEdit();
+		mLoader->brushRegion(mAnchor, mBrush, mRegion);
+		if (mBrush.mode == BrushRigid && !mRigid.begin(mLoader->adjacency(), mLoader->getVertices(), mRegion.vertices))
+			mBrush.mode = BrushFalloff;
+		mRegionEdit = mLoaderEdit;
+	}
+	apply(latest.position);
+	mApplied.fetch_add(1);
+}
+
+void DeformSolver::apply(glm::vec3 const &target)
+{
+	if (mBrush.mode == BrushFalloff) {
+		mLoader->deformRegion(target, mRegion);
+		return;
+	}
+	mRigid.iterate(target, mRigidPositions);
+	mLoader->moveVertices(mRigid.vertices(), mRigidPositions);
+	mLastTarget = target;
+	mSettling = kSettleIterations;
+}
@@ -0,0 +1,114 @@
+#ifndef DEFORMSOLVER_H
+#define DEFORMSOLVER_H
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <glm/glm.hpp>
+#include "brush.h"
+#include "rigidsolver.h"
+#include "spscqueue.h"
+
+class OBJLoader;
+
+//! Runs anchored edits on a thread of its own, so the servo loop only has to
+//! hand over where the proxy wants the anchor to be.
+//!
+//! The servo thread submit()s model-space targets into a lock-free queue at
+//! its own rate.  The solver wakes every kIdleMicros, keeps only the newest
+//! target of the current edit and applies it with OBJLoader::deformRegion().
+//! Skipping the older ones gives the same mesh: the anchor lands on the
+//! newest target either way, and since the brush region and its weights are
+//! found once per edit, every other vertex follows its weight times the sum
+//! of the steps, which is its weight times the total.
+//!
+//! A BrushRigid edit factorizes its system once, when the solver first
+//! takes a target for it, and applies each newest target with one
+//! RigidSolver iteration.  That is not linear in the steps, so coalescing
+//! changes how the rigid solve gets there, not where it settles: after the
+//! targets stop, kSettleIterations more run on the last one while the
+//! solver is idle.
+//!
+//! Each edit is one session of the loader's EditJournal.  undo() and redo()
+//! edit the loader from the calling thread, under the same lock the solver
+//! edits it under.
+//!
+//! This makes the solver the loader's editing thread.
+class DeformSolver {
+	public:
+		static const int kQueueSize = 256;     // a quarter second of servo ticks
+		static const int kIdleMicros = 500;
+		static const int kSettleIterations = 8;
+
+		DeformSolver();
+
+		//! Stops the thread if it is still running.
+		//!
+		~DeformSolver();
+
+		void start();
+
+		//! Applies any targets still queued, then joins the thread.
+		//!
+		void stop();
+
+		//! Starts a new edit that moves anchor of loader and the vertices
+		//! brush reaches around it.  The region is found on the solver's
+		//! thread, once per edit.  Targets submitted for an earlier edit are
+		//! discarded from now on.
+		void beginEdit(OBJLoader *loader, int anchor, Brush const &brush);
+
+		//! Ends the current edit, discarding its queued targets, and undoes
+		//! loader's last edit session, or redoes the last one undone.
+		//! Returns false if there is nothing to undo or redo.  Client
+		//! thread, while nothing is anchored.
+		bool undo(OBJLoader *loader);
+		bool redo(OBJLoader *loader);
+
+		//! Servo thread: queues a target for the current edit.  Never blocks;
+		//! returns false, dropping the target, if the queue is full.
+		bool submit(glm::vec3 const &target);
+
+		//! Applies the newest queued target on the calling thread.  For
+		//! running without the solver thread, in place of start().
+		void drain();
+
+		//! Edits applied so far; each may cover several targets.
+		//!
+		int applied() const;
+
+	private:
+		struct Target {
+			glm::vec3 position;
+			unsigned int edit;
+		};
+
+		DeformSolver(DeformSolver const &);
+		DeformSolver &operator=(DeformSolver const &);
+
+		void run();
+		void apply(glm::vec3 const &target);
+		void endEdit();
+
+		std::thread mThread;
+		std::atomic<bool> mStopping;
+		std::atomic<unsigned int> mEdit;       // bumped by beginEdit()
+		std::atomic<int> mApplied;
+		SPSCQueue<Target, kQueueSize> mTargets;
+
+		// The edit the queued targets apply to.  Only beginEdit() and the
+		// solver thread take mEditLock; the servo thread never does.
+		std::mutex mEditLock;
+		OBJLoader *mLoader;
+		int mAnchor;
+		Brush mBrush;
+		unsigned int mLoaderEdit;
+		BrushRegion mRegion;
+		unsigned int mRegionEdit;              // the edit mRegion was found for
+		RigidSolver mRigid;                    // set up with mRegion for BrushRigid
+		std::vector<glm::vec3> mRigidPositions;
+		glm::vec3 mLastTarget;
+		int mSettling;                         // rigid iterations left on mLastTarget
+	};
+
+#endif
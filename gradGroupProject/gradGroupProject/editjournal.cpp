@@ -0,0 +1,122 @@
+#include <algorithm>
+#include "editjournal.h"
+
+EditJournal::EditJournal() :
+mFirst(0),
+mCursor(0),
+mOpen(false),
+mLimit(kDefaultLimit),
+mSerial(0)
+{
+}
+
+void EditJournal::clear(size_t vertexCount)
+{
+	mRecords.clear();
+	mStarts.clear();
+	mFirst = mCursor = 0;
+	mOpen = false;
+	mStamps.assign(vertexCount, 0);
+	mSerial = 0;
+}
+
+void EditJournal::setLimit(size_t records)
+{
+	mLimit = records;
+	trim();
+}
+
+void EditJournal::open()
+{
+	// A new edit after some undos makes them permanent.
+	if (mCursor < mStarts.size()) {
+		mRecords.resize(mStarts[mCursor]);
+		mStarts.resize(mCursor);
+	}
+	mStarts.push_back(mRecords.size());
+	mCursor++;
+	mOpen = true;
+	if (++mSerial == 0) {
+		std::fill(mStamps.begin(), mStamps.end(), 0);
+		mSerial = 1;
+	}
+}
+
+void EditJournal::close()
+{
+	if (!mOpen)
+		return;
+	mOpen = false;
+	trim();
+}
+
+// Dropping a session only moves mFirst; the records before it are erased
+// once they are the larger part of the buffer, so each is moved at most a
+// constant number of times on average.
+void EditJournal::trim()
+{
+	// Never the newest session still applied, nor an undone one.
+	size_t last = mCursor > mFirst ? mCursor - 1 : mFirst;
+	while (mFirst < last && mRecords.size() - mStarts[mFirst] > mLimit)
+		mFirst++;
+
+	size_t dead = mFirst < mStarts.size() ? mStarts[mFirst] : mRecords.size();
+	if (dead == 0 || dead < mRecords.size() - dead)
+		return;
+	mRecords.erase(mRecords.begin(), mRecords.begin() + dead);
+	mStarts.erase(mStarts.begin(), mStarts.begin() + mFirst);
+	for (size_t s = 0; s < mStarts.size(); s++)
+		mStarts[s] -= dead;
+	mCursor -= mFirst;
+	mFirst = 0;
+}
+
+size_t EditJournal::sessionEnd(size_t session) const
+{
+	return session + 1 < mStarts.size() ? mStarts[session + 1] : mRecords.size();
+}
+
+void EditJournal::swap(size_t session, std::vector<glm::vec3> &positions, std::vector<int> &changed)
+{
+	for (size_t r = mStarts[session]; r < sessionEnd(session); r++) {
+		Record &record = mRecords[r];
+		std::swap(positions[record.vertex], record.position);
+		changed.push_back(record.vertex);
+	}
+}
+
+bool EditJournal::undo(std::vector<glm::vec3> &positions, std::vector<int> &changed)
+{
+	close();
+	if (mCursor == mFirst)
+		return false;
+	mCursor--;
+	swap(mCursor, positions, changed);
+	return true;
+}
+
+bool EditJournal::redo(std::vector<glm::vec3> &positions, std::vector<int> &changed)
+{
+	close();
+	if (mCursor == mStarts.size())
+		return false;
+	swap(mCursor, positions, changed);
+	mCursor++;
+	return true;
+}
+
+size_t EditJournal::undoable() const
+{
+	return mCursor - mFirst;
+}
+
+size_t EditJournal::redoable() const
+{
+	return mStarts.size() - mCursor;
+}
+
+size_t EditJournal::memoryBytes() const
+{
+	return mRecords.capacity() * sizeof(Record) + mStarts.capacity() * sizeof(size_t) +
+		mStamps.capacity() * sizeof(unsigned int);
+}
@@ -0,0 +1,92 @@
+#ifndef EDITJOURNAL_H
+#define EDITJOURNAL_H
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+
+//! Undo and redo for a mesh's edits, one session at a time.
+//!
+//! A session is every move between two close()s; for OBJLoader, one anchored
+//! edit.  It is stored as one record per vertex it moved, holding the
+//! position the vertex had before, however many times it moved: the first
+//! move of a vertex appends a record, later ones cost only a check.  Undo
+//! swaps each record of the last session with the mesh's position, so the
+//! record then holds the position to redo to, and redo swaps them back;
+//! both touch only the session's vertices and restore them exactly.
+//!
+//! Records go into one append-only buffer.  Once the sessions hold more than
+//! the limit's worth of records, the oldest are dropped and the mesh as it
+//! was after them becomes the oldest state undo reaches.
+//!
+//! Not thread-safe; OBJLoader keeps it on its editing thread.
+class EditJournal {
+	public:
+		static const size_t kDefaultLimit = 1 << 20;     // records, 16 bytes each
+
+		EditJournal();
+
+		//! Forgets every session, for a mesh of vertexCount vertices.
+		//!
+		void clear(size_t vertexCount);
+
+		//! Most records kept; at least the open session's are, whatever the
+		//! limit.
+		void setLimit(size_t records);
+
+		//! Vertex v is about to move from before.  Opens a session if none is
+		//! open, dropping any sessions undone since the last one.
+		void moving(int v, glm::vec3 const &before)
+		{
+			if (!mOpen)
+				open();
+			if (mStamps[v] == mSerial)
+				return;
+			mStamps[v] = mSerial;
+			Record record = { v, before };
+			mRecords.push_back(record);
+		}
+
+		//! Ends the open session, if any.
+		//!
+		void close();
+
+		//! Puts the vertices of the last session back, or of the last undone
+		//! one forward again, in positions and appends each to changed.
+		//! Closes the open session first.  Return false if there is none.
+		bool undo(std::vector<glm::vec3> &positions, std::vector<int> &changed);
+		bool redo(std::vector<glm::vec3> &positions, std::vector<int> &changed);
+
+		//! Sessions undo and redo can currently step through.
+		//!
+		size_t undoable() const;
+		size_t redoable() const;
+
+		//! Bytes held by the buffer and the per-vertex stamps.
+		//!
+		size_t memoryBytes() const;
+
+	private:
+		struct Record {
+			int vertex;
+			glm::vec3 position;
+		};
+
+		void open();
+		void swap(size_t session, std::vector<glm::vec3> &positions, std::vector<int> &changed);
+		void trim();
+		size_t sessionEnd(size_t session) const;
+
+		std::vector<Record> mRecords;
+		std::vector<size_t> mStarts;           // first record of each session
+		size_t mFirst;                         // oldest session still kept
+		size_t mCursor;                        // sessions applied; the rest are undone
+		bool mOpen;
+		size_t mLimit;
+
+		// mStamps[v] == mSerial once v is in the open session.
+		std::vector<unsigned int> mStamps;
+		unsigned int mSerial;
+	};
+
+#endif
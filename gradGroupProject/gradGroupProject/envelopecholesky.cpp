@@ -0,0 +1,98 @@
+#include <cmath>
+#include "envelopecholesky.h"
+
+EnvelopeCholesky::EnvelopeCholesky() :
+mSize(0)
+{
+}
+
+void EnvelopeCholesky::reset(int n)
+{
+	mSize = n;
+	mFirst.assign(n, 0);
+	mRowStart.clear();
+	mValues.clear();
+	mEntries.clear();
+}
+
+void EnvelopeCholesky::add(int row, int col, double value)
+{
+	Entry entry = { row, col, value };
+	mEntries.push_back(entry);
+}
+
+double &EnvelopeCholesky::at(int row, int col)
+{
+	return mValues[mRowStart[row] + (col - mFirst[row])];
+}
+
+double EnvelopeCholesky::at(int row, int col) const
+{
+	return mValues[mRowStart[row] + (col - mFirst[row])];
+}
+
+// Row by row: entry (i, j) of L needs the dot product of the parts of rows i
+// and j left of column j, and both rows are contiguous there.
+bool EnvelopeCholesky::factorize()
+{
+	for (int i = 0; i < mSize; i++)
+		mFirst[i] = i;
+	for (size_t e = 0; e < mEntries.size(); e++)
+		if (mEntries[e].col < mFirst[mEntries[e].row])
+			mFirst[mEntries[e].row] = mEntries[e].col;
+
+	mRowStart.assign(mSize + 1, 0);
+	for (int i = 0; i < mSize; i++)
+		mRowStart[i + 1] = mRowStart[i] + (size_t)(i - mFirst[i] + 1);
+	mValues.assign(mRowStart[mSize], 0.0);
+	for (size_t e = 0; e < mEntries.size(); e++)
+		at(mEntries[e].row, mEntries[e].col) += mEntries[e].value;
+	mEntries.clear();
+
+	for (int i = 0; i < mSize; i++) {
+		double const *rowI = &mValues[mRowStart[i]] - mFirst[i];
+		for (int j = mFirst[i]; j <= i; j++) {
+			double const *rowJ = &mValues[mRowStart[j]] - mFirst[j];
+			int start = mFirst[i] > mFirst[j] ? mFirst[i] : mFirst[j];
+			double sum = at(i, j);
+			for (int k = start; k < j; k++)
+				sum -= rowI[k] * rowJ[k];
+			if (j < i)
+				at(i, j) = sum / at(j, j);
+			else if (sum <= 0.0)
+				return false;
+			else
+				at(i, i) = std::sqrt(sum);
+		}
+	}
+	return true;
+}
+
+void EnvelopeCholesky::solve(double *b) const
+{
+	// L y = b
+	for (int i = 0; i < mSize; i++) {
+		double const *row = &mValues[mRowStart[i]] - mFirst[i];
+		double sum = b[i];
+		for (int k = mFirst[i]; k < i; k++)
+			sum -= row[k] * b[k];
+		b[i] = sum / row[i];
+	}
+	// L^T x = y, a column of L^T at a time
+	for (int i = mSize - 1; i >= 0; i--) {
+		double const *row = &mValues[mRowStart[i]] - mFirst[i];
+		b[i] /= row[i];
+		for (int k = mFirst[i]; k < i; k++)
+			b[k] -= row[k] * b[i];
+	}
+}
+
+int EnvelopeCholesky::size() const
+{
+	return mSize;
+}
+
+size_t EnvelopeCholesky::envelopeSize() const
+{
+	return mValues.size();
+}
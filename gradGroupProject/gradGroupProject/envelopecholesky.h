@@ -0,0 +1,61 @@
+#ifndef ENVELOPECHOLESKY_H
+#define ENVELOPECHOLESKY_H
+
+#include <vector>
+
+//! Cholesky factorization A = L L^T of a sparse symmetric positive definite
+//! matrix, stored by its envelope.
+//!
+//! Row i of L is kept from its first nonzero column up to the diagonal, as
+//! one contiguous run, so fill-in stays inside the envelope and a solve is
+//! two passes over one flat array.  Orderings that keep neighbours close
+//! together, like a breadth-first walk over a mesh, keep the envelope near
+//! the width of one front of the walk.
+class EnvelopeCholesky {
+	public:
+		EnvelopeCholesky();
+
+		//! Starts an n x n matrix of zeros.  Entries are then add()ed and the
+		//! whole is factorize()d.
+		void reset(int n);
+
+		//! Adds value to A(row, col) (and so to A(col, row)).  Only the lower
+		//! triangle, col <= row, is given.  Every entry must be added before
+		//! factorize().
+		void add(int row, int col, double value);
+
+		//! Factorizes in place.  Returns false if the matrix turns out not to
+		//! be positive definite.
+		bool factorize();
+
+		//! Solves A x = b in place, b holding the right-hand side on entry.
+		//!
+		void solve(double *b) const;
+
+		int size() const;
+
+		//! Stored entries of L, a measure of the solve's cost.
+		//!
+		size_t envelopeSize() const;
+
+	private:
+		// Row i occupies mValues[mRowStart[i] .. mRowStart[i + 1]), columns
+		// mFirst[i] .. i, the diagonal last.
+		double &at(int row, int col);
+		double at(int row, int col) const;
+
+		int mSize;
+		std::vector<int> mFirst;
+		std::vector<size_t> mRowStart;
+		std::vector<double> mValues;
+
+		// Entries added before the envelope is known.
+		struct Entry {
+			int row;
+			int col;
+			double value;
+		};
+		std::vector<Entry> mEntries;
+	};
+
+#endif
@@ -0,0 +1,322 @@
+// Headless driver: runs the touch, anchored-edit and servo code against a
+// SimulatedDevice instead of an OpenHaptics device and a GLUT window, so the
+// interaction can be timed on machines without either.  It is a separate
+// program, built by the CMake build and not part of the Visual Studio project.
+//
+//   headless [options] [mesh.obj...]
+//     --trajectory file   device path, "time x y z button" per line
+//     --rate hz           servo rate (default 1000)
+//     --step              run ticks and edits back to back on the main
+//                         thread with a simulated clock, so every run ends
+//                         with the same mesh; no servo timing is printed
+//     --replay file       replay a session trace recorded with --record
+//                         instead, and print how long each stage took; the
+//                         meshes must be the ones of the recorded scene, in
+//                         the same order
+//     --realtime          replay at the recorded pace instead of flat out
+//     --profile file      write the PROFILE_ timers as a Chrome trace
+//     --save file         write the edited mesh when done: as OBJ if file
+//                         ends in .obj, otherwise as a binary snapshot
+//                         that headless can load again
+//     --brush radius      brush radius for anchored edits (default 0.15;
+//                         0 moves just the anchor and its one-ring)
+//     --rings n           most edges the brush reaches (default no limit)
+//     --euclidean         brush distance in a straight line, not along
+//                         the surface
+//     --rigid             move the brush region as rigidly as possible
+//                         instead of by the falloff
+//     --visual-triangles n  draw the finest LOD level of at most n
+//                         triangles (default 0, the full mesh)
+//     --scene file        the objects of a scene file (see scene.h), before
+//                         any meshes named after the options
+//
+// Without --replay only the first object is used, with its mesh at the
+// origin.  A replay draws every object where the scene puts it.  Where an offscreen GL
+// context can be made (see offscreengl.h), the replay also draws every frame
+// to time the draw stage.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "interaction.h"
+#include "objloader.h"
+#include "offscreengl.h"
+#include "profiler.h"
+#include "scene.h"
+#include "simdevice.h"
+#include "tracereplay.h"
+
+namespace {
+
+	// How close the device has to come to the surface to touch it.
+	const float kContactDistance = 0.02f;
+
+	const int kFrameRate = 60;
+
+	const double kIdentity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+	// Comes down onto the vertex nearest the top of the mesh, presses the
+	// button to anchor an edit there, pulls up and out for a second and lets
+	// go.
+	std::vector<TrajectorySample> defaultTrajectory(OBJLoader const &loader)
+	{
+		std::vector<glm::vec3> const &points = loader.getVertices();
+		glm::vec3 top = points[0];
+		for (size_t i = 1; i < points.size(); i++)
+			if (points[i].y > top.y)
+				top = points[i];
+
+		glm::vec3 above = top + glm::vec3(0.0f, 0.2f, 0.0f);
+		glm::vec3 pulled = top + glm::vec3(0.1f, 0.15f, 0.05f);
+		TrajectorySample path[] = {
+			{ 0.0, above, false },
+			{ 0.5, top, false },
+			{ 0.6, top, true },
+			{ 1.6, pulled, true },
+			{ 1.7, pulled, false },
+			{ 2.0, above, false }
+		};
+		return std::vector<TrajectorySample>(path, path + sizeof(path) / sizeof(path[0]));
+	}
+
+	void usage()
+	{
+		fprintf(stderr, "usage: headless [--trajectory file] [--rate hz] [--step] [--profile file] [--save file] [brush options] --scene file | mesh.obj\n"
+			"       headless --replay file [--realtime] [--profile file] [--visual-triangles n] [brush options] [--scene file] [mesh.obj...]\n");
+		exit(1);
+	}
+
+	void writeProfile(const char *profileFile)
+	{
+		if (!profileFile)
+			return;
+		if (!Profiler::writeChromeTrace(profileFile))
+			fprintf(stderr, "Could not write %s\n", profileFile);
+		else
+			printf("%zu profile events written to %s, %lld dropped\n",
+				Profiler::collected(), profileFile, Profiler::dropped());
+	}
+
+	int replay(const char *traceFile, bool realTime, Brush const &brush, Scene &scene)
+	{
+		std::vector<TraceRecord> records;
+		if (!readTrace(traceFile, records)) {
+			fprintf(stderr, "%s is not a session trace\n", traceFile);
+			return 1;
+		}
+
+		Interaction interaction;
+		interaction.setScene(&scene);
+		interaction.setBrush(brush);
+		TraceReplay replay(interaction, scene);
+		replay.setRealTime(realTime);
+		replay.setFrameRate(kFrameRate);
+		if (makeOffscreenContext()) {
+			glEnable(GL_DEPTH_TEST);
+			replay.setDraw([&]() {
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				for (size_t i = 0; i < scene.objectCount(); i++) {
+					glPushMatrix();
+					glMultMatrixd(scene.object(i).transform);
+					scene.loader(i).drawColorObj();
+					glPopMatrix();
+				}
+				glFinish();
+			});
+		}
+		else
+			fprintf(stderr, "No offscreen GL context; not timing the draw stage\n");
+
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		replay.run(records);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+		printf("%s: %zu records replayed in %.3f s, %d edits applied\n",
+			traceFile, records.size(), seconds, interaction.solver().applied());
+		replay.print(stdout);
+		return 0;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<const char *> meshFiles;
+	const char *trajectoryFile = 0, *traceFile = 0, *profileFile = 0, *saveFile = 0, *sceneFile = 0;
+	int rate = 1000;
+	size_t visualTriangles = 0;
+	bool stepped = false, realTime = false;
+	Brush brush = kDefaultBrush;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--trajectory") && i + 1 < argc)
+			trajectoryFile = argv[++i];
+		else if (!strcmp(argv[i], "--rate") && i + 1 < argc)
+			rate = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--step"))
+			stepped = true;
+		else if (!strcmp(argv[i], "--replay") && i + 1 < argc)
+			traceFile = argv[++i];
+		else if (!strcmp(argv[i], "--realtime"))
+			realTime = true;
+		else if (!strcmp(argv[i], "--profile") && i + 1 < argc)
+			profileFile = argv[++i];
+		else if (!strcmp(argv[i], "--save") && i + 1 < argc)
+			saveFile = argv[++i];
+		else if (!strcmp(argv[i], "--brush") && i + 1 < argc)
+			brush.radius = (float)atof(argv[++i]);
+		else if (!strcmp(argv[i], "--rings") && i + 1 < argc)
+			brush.rings = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--euclidean"))
+			brush.metric = BrushEuclidean;
+		else if (!strcmp(argv[i], "--rigid"))
+			brush.mode = BrushRigid;
+		else if (!strcmp(argv[i], "--scene") && i + 1 < argc)
+			sceneFile = argv[++i];
+		else if (!strcmp(argv[i], "--visual-triangles") && i + 1 < argc)
+			visualTriangles = (size_t)atol(argv[++i]);
+		else if (argv[i][0] == '-')
+			usage();
+		else
+			meshFiles.push_back(argv[i]);
+	}
+	PROFILE_THREAD("main");
+
+	Scene scene;
+	if (sceneFile && !scene.read(sceneFile)) {
+		if (scene.errorLine())
+			fprintf(stderr, "%s:%d: not an object\n", sceneFile, scene.errorLine());
+		else
+			fprintf(stderr, "Could not read %s\n", sceneFile);
+		return 1;
+	}
+	for (size_t i = 0; i < meshFiles.size() && (traceFile || scene.objectCount() == 0); i++)
+		scene.addObject(meshFiles[i]);
+	if (scene.objectCount() == 0)
+		usage();
+	if (!scene.loadMeshes((int)std::thread::hardware_concurrency())) {
+		fprintf(stderr, "Could not load %s\n", scene.failedMesh().c_str());
+		return 1;
+	}
+	for (size_t i = 0; i < scene.meshCount(); i++)
+		scene.mesh(i).setTriangleBudgets(kDefaultHapticTriangles, visualTriangles);
+	if (traceFile) {
+		int status = replay(traceFile, realTime, brush, scene);
+		writeProfile(profileFile);
+		return status;
+	}
+	OBJLoader &loader = scene.loader(0);
+	std::string const &meshFile = scene.meshPath(scene.object(0).mesh);
+
+	Interaction interaction;
+	interaction.setScene(&scene);
+	interaction.setBrush(brush);
+
+	SimulatedDevice device(rate);
+	interaction.servoTiming().setServoRate(device.servoRate());
+	if (trajectoryFile) {
+		if (!device.loadTrajectory(trajectoryFile)) {
+			fprintf(stderr, "Could not read %s\n", trajectoryFile);
+			return 1;
+		}
+	}
+	else
+		device.setTrajectory(defaultTrajectory(loader));
+
+	// The simulated workspace is the world and the mesh sits at its origin,
+	// so device, world and model coordinates are all the same.
+	device.setContact([&](glm::vec3 const &position, glm::vec3 &proxy) {
+		SurfacePoint point;
+		if (!loader.closestPoint(position, point) || point.distance2 > kContactDistance * kContactDistance)
+			return -1;
+		proxy = point.position;
+		return 0;
+	});
+	device.setServo([&](glm::vec3 const &position) {
+		PROFILE_THREAD("servo");
+		PROFILE_SCOPE("servo tick");
+		interaction.servoTiming().beginTick();
+		glm::vec3 force(0.0f, 0.0f, 0.0f);
+		interaction.servoTick(position, position, force);
+		interaction.servoTiming().endTick();
+		return force;
+	});
+
+	// What the HL callbacks do in the app, with the button standing in for
+	// the 'A' key.
+	int touches = 0, motions = 0, anchors = 0;
+	std::function<void(DeviceEvent const &)> handle = [&](DeviceEvent const &event) {
+		switch (event.type) {
+		case DeviceTouch:
+			interaction.touch(event.object, event.proxy);
+			touches++;
+			break;
+		case DeviceMotion:
+			interaction.motion(event.object, event.proxy);
+			motions++;
+			break;
+		case DeviceUntouch:
+			interaction.untouch();
+			break;
+		case DeviceButtonDown:
+			if (interaction.beginAnchor(device.devicePosition(), device.devicePosition(), event.proxy, kIdentity))
+				anchors++;
+			break;
+		case DeviceButtonUp:
+			interaction.endAnchor();
+			break;
+		}
+	};
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	int frames = 0;
+	if (stepped) {
+		int ticksPerFrame = rate / kFrameRate > 0 ? rate / kFrameRate : 1;
+		for (long long tick = 0; device.step(); tick++) {
+			interaction.applyEdits();
+			if (tick % ticksPerFrame == 0) {
+				device.checkEvents(handle);
+				loader.updateNormals();
+				Profiler::collect();
+				frames++;
+			}
+		}
+	}
+	else {
+		interaction.start();
+		device.start();
+		while (!device.finished()) {
+			device.checkEvents(handle);
+			loader.updateNormals();
+			Profiler::collect();
+			frames++;
+			std::this_thread::sleep_for(std::chrono::microseconds(1000000 / kFrameRate));
+		}
+		device.stop();
+	}
+	device.checkEvents(handle);
+	interaction.stop();
+	loader.updateNormals();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	printf("%s: %.3f s, %d frames, %d touches, %d motions, %d anchors, %d edits applied\n",
+		meshFile.c_str(), seconds, frames, touches, motions, anchors, interaction.solver().applied());
+	// Stepped ticks run back to back, so their wall-clock timing says
+	// nothing about the servo loop.
+	ServoSummary servo;
+	while (!stepped && interaction.servoTiming().takeSummary(servo))
+		printf("Servo: %d ticks, mean period %.1f us, max jitter %lld us, max busy %lld us, %d over budget, %d dropped\n",
+			servo.ticks, servo.meanPeriod, servo.maxJitter, servo.maxBusy, servo.overruns, servo.dropped);
+	writeProfile(profileFile);
+
+	if (saveFile) {
+		size_t length = strlen(saveFile);
+		bool obj = length >= 4 && !strcmp(saveFile + length - 4, ".obj");
+		if (!(obj ? loader.saveOBJ(saveFile) : loader.saveBinary(saveFile))) {
+			fprintf(stderr, "Could not write %s\n", saveFile);
+			return 1;
+		}
+	}
+	return 0;
+}
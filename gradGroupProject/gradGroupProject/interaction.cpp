@@ -0,0 +1,226 @@
+#include <cstring>
+#include "interaction.h"
+#include "objloader.h"
+#include "profiler.h"
+#include "scene.h"
+
+namespace {
+
+	// Affine part of an OpenGL-order matrix applied to a point.
+	glm::vec3 transformPoint(double const m[16], glm::vec3 const &p)
+	{
+		glm::vec3 out;
+		for (int j = 0; j < 3; j++)
+			out[j] = (float)(p[0] * m[j] + p[1] * m[4 + j] + p[2] * m[8 + j] + m[12 + j]);
+		return out;
+	}
+
+	// An object and one of its vertices in one 64-bit word, object high.
+	long long packVertex(int object, int vertex)
+	{
+		return (long long)object << 32 | (unsigned int)vertex;
+	}
+
+	int unpackVertex(long long packed, int &object)
+	{
+		object = (int)(packed >> 32);
+		return (int)(unsigned int)(packed & 0xffffffff);
+	}
+}
+
+Interaction::Interaction() :
+mScene(0),
+mStiffness(0.1),
+mBrush(kDefaultBrush),
+mContactVertex(packVertex(0, -1)),
+mTouching(false),
+mFriction(0.0),
+mAnchored(false),
+mLastAnchored(false),
+mLastForce(0.0f, 0.0f, 0.0f)
+{
+	mContact.triangle = -1;
+	for (int i = 0; i < 16; i++)
+		mWorldToModel[i] = i % 5 == 0 ? 1.0 : 0.0;
+}
+
+void Interaction::setScene(Scene *scene)
+{
+	mScene = scene;
+}
+
+void Interaction::setStiffness(double stiffness)
+{
+	mStiffness = stiffness;
+}
+
+void Interaction::setBrush(Brush const &brush)
+{
+	mBrush = brush;
+}
+
+Brush Interaction::brush() const
+{
+	return mBrush;
+}
+
+void Interaction::start()
+{
+	mSolver.start();
+}
+
+void Interaction::stop()
+{
+	endAnchor();
+	mSolver.stop();
+}
+
+void Interaction::applyEdits()
+{
+	mSolver.drain();
+}
+
+void Interaction::touch(int object, glm::vec3 const &proxy)
+{
+	updateContact(object, proxy);
+	mTouching.store(true);
+}
+
+void Interaction::motion(int object, glm::vec3 const &proxy)
+{
+	updateContact(object, proxy);
+	mTouching.store(true);
+}
+
+void Interaction::untouch()
+{
+	mTouching.store(false);
+}
+
+void Interaction::select(int object)
+{
+	// Nothing is known about the new object until it is touched.
+	mContactVertex.store(packVertex(object, -1));
+}
+
+// Friction is interpolated across the touched triangle instead of taken from
+// the nearest vertex, and the anchor for editing is the triangle corner
+// closest to the contact point.
+void Interaction::updateContact(int object, glm::vec3 const &proxy)
+{
+	PROFILE_SCOPE("updateContact");
+	OBJLoader const &loader = mScene->loader(object);
+	int nearest;
+	double friction;
+	if (loader.closestPoint(proxy, mContact)) {
+		nearest = loader.nearestCorner(mContact);
+		friction = loader.frictionAt(mContact);
+	}
+	else {
+		// The spatial index answers this without scanning the whole mesh.
+		nearest = loader.nearestVertex(proxy);
+		friction = nearest >= 0 ? loader.view().friction[nearest] : 0.0;
+	}
+	mContactVertex.store(packVertex(object, nearest));
+	mFriction.store(friction);
+}
+
+bool Interaction::beginAnchor(glm::vec3 const &device, glm::vec3 const &deviceWorld,
+	glm::vec3 const &proxy, double const worldToModel[16])
+{
+	int object;
+	int anchor = nearestVertex(object);
+	if (!mTouching.load() || anchor < 0)
+		return false;
+
+	OBJLoader &loader = mScene->loader(object);
+
+	std::lock_guard<std::mutex> lock(mAnchorLock);
+	mAnchorDevice = device;
+	mAnchorDeviceWorld = deviceWorld;
+	mAnchorProxy = proxy;
+	mProxyTarget = proxy;
+	memcpy(mWorldToModel, worldToModel, sizeof(mWorldToModel));
+
+	mSolver.beginEdit(&loader, anchor, mBrush);
+	mAnchored = true;
+	return true;
+}
+
+void Interaction::endAnchor()
+{
+	std::lock_guard<std::mutex> lock(mAnchorLock);
+	mAnchored = false;
+}
+
+bool Interaction::undo()
+{
+	std::lock_guard<std::mutex> lock(mAnchorLock);
+	return !mAnchored && mSolver.undo(&mScene->loader(object()));
+}
+
+bool Interaction::redo()
+{
+	std::lock_guard<std::mutex> lock(mAnchorLock);
+	return !mAnchored && mSolver.redo(&mScene->loader(object()));
+}
+
+bool Interaction::servoTick(glm::vec3 const &device, glm::vec3 const &deviceWorld, glm::vec3 &force)
+{
+	std::unique_lock<std::mutex> lock(mAnchorLock, std::try_to_lock);
+	if (lock.owns_lock()) {
+		mLastAnchored = mAnchored;
+		if (mAnchored) {
+			mProxyTarget = mAnchorProxy + (deviceWorld - mAnchorDeviceWorld);
+			if (!mSolver.submit(transformPoint(mWorldToModel, mProxyTarget)))
+				mTiming.noteDropped();
+			mLastForce = (mAnchorDevice - device) * (float)mStiffness;
+		}
+	}
+	force = mLastForce;
+	return mLastAnchored;
+}
+
+int Interaction::object() const
+{
+	int object;
+	unpackVertex(mContactVertex.load(), object);
+	return object;
+}
+
+int Interaction::nearestVertex(int &object) const
+{
+	return unpackVertex(mContactVertex.load(), object);
+}
+
+double Interaction::friction() const
+{
+	return mFriction.load();
+}
+
+bool Interaction::touching() const
+{
+	return mTouching.load();
+}
+
+bool Interaction::anchored() const
+{
+	std::lock_guard<std::mutex> lock(mAnchorLock);
+	return mAnchored;
+}
+
+glm::vec3 Interaction::proxyTarget() const
+{
+	std::lock_guard<std::mutex> lock(mAnchorLock);
+	return mProxyTarget;
+}
+
+ServoTiming &Interaction::servoTiming()
+{
+	return mTiming;
+}
+
+DeformSolver const &Interaction::solver() const
+{
+	return mSolver;
+}
@@ -0,0 +1,131 @@
+#ifndef INTERACTION_H
+#define INTERACTION_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <glm/glm.hpp>
+#include "brush.h"
+#include "deformsolver.h"
+#include "servotiming.h"
+#include "trianglebvh.h"
+
+class Scene;
+
+//! Touch, anchored editing and the servo force, independent of the device.
+//!
+//! The OpenHaptics callbacks and SimulatedDevice both drive one of these, so
+//! the same contact, edit and force code runs with or without hardware.
+//! Objects are the scene's object indices; positions are world space
+//! unless a method says model space.
+//!
+//! Threads: touch(), motion() and untouch() come from the collision thread;
+//! select(), beginAnchor(), endAnchor(), undo() and redo() from the client
+//! thread; servoTick() from the servo thread.  The accessors may be called
+//! anywhere.
+class Interaction {
+	public:
+		Interaction();
+
+		//! The objects that can be touched, with their meshes loaded.  Must
+		//! not change while the interaction is running.
+		void setScene(Scene *scene);
+
+		//! Spring constant of the anchored edit's force.
+		//!
+		void setStiffness(double stiffness);
+
+		//! The brush the next anchored edit uses; kDefaultBrush to start
+		//! with.  Client thread.
+		void setBrush(Brush const &brush);
+		Brush brush() const;
+
+		//! Starts and stops the solver thread that applies the edits.
+		//!
+		void start();
+		void stop();
+
+		//! Applies queued edits on the calling thread, for running without
+		//! start() when every run must produce the same mesh.
+		void applyEdits();
+
+		//! The proxy, in the model space of object, touched or slid over it.
+		//! Finds the contact point, the vertex to anchor and the friction.
+		void touch(int object, glm::vec3 const &proxy);
+		void motion(int object, glm::vec3 const &proxy);
+		void untouch();
+
+		//! Makes object the current one without touching it, e.g. when the
+		//! button grabs it.
+		void select(int object);
+
+		//! Anchors an edit on the vertex under the proxy.  device is the
+		//! device in workspace coordinates and deviceWorld in world ones;
+		//! worldToModel is the current object's inverse transform, as 16
+		//! doubles in OpenGL order.  Returns false if nothing is touched.
+		bool beginAnchor(glm::vec3 const &device, glm::vec3 const &deviceWorld,
+			glm::vec3 const &proxy, double const worldToModel[16]);
+		void endAnchor();
+
+		//! Undoes the current object's last anchored edit, or redoes the last
+		//! one undone.  Returns false while anchored or if there is nothing
+		//! to undo or redo.  Client thread.
+		bool undo();
+		bool redo();
+
+		//! Servo thread: while an edit is anchored, moves its target with the
+		//! device, sets force to the spring pulling the device back to the
+		//! anchor and returns true.  Only constant work; the mesh is edited by
+		//! the solver.
+		bool servoTick(glm::vec3 const &device, glm::vec3 const &deviceWorld, glm::vec3 &force);
+
+		int object() const;
+
+		//! The touched object and the vertex nearest the contact on it, read
+		//! as one pair so that the vertex always belongs to the object; the
+		//! vertex is -1 if none is known for it.
+		int nearestVertex(int &object) const;
+		double friction() const;
+		bool touching() const;
+		bool anchored() const;
+
+		//! Where the anchored proxy is being pulled to, in world space; only
+		//! meaningful while anchored().
+		glm::vec3 proxyTarget() const;
+
+		ServoTiming &servoTiming();
+		DeformSolver const &solver() const;
+
+	private:
+		Interaction(Interaction const &);
+		Interaction &operator=(Interaction const &);
+
+		void updateContact(int object, glm::vec3 const &proxy);
+
+		Scene *mScene;
+		double mStiffness;
+		Brush mBrush;                 // client thread
+		DeformSolver mSolver;
+		ServoTiming mTiming;
+
+		// Collision thread.  The object and its nearest vertex share one
+		// atomic so that readers never pair a vertex with another mesh.
+		std::atomic<long long> mContactVertex;
+		std::atomic<bool> mTouching;
+		std::atomic<double> mFriction;
+		SurfacePoint mContact;
+
+		// The anchored edit.  The servo thread only ever try_locks mAnchorLock
+		// and repeats its last answer for a tick when someone else holds it.
+		mutable std::mutex mAnchorLock;
+		bool mAnchored;
+		glm::vec3 mAnchorDevice;
+		glm::vec3 mAnchorDeviceWorld;
+		glm::vec3 mAnchorProxy;
+		double mWorldToModel[16];
+		glm::vec3 mProxyTarget;
+		bool mLastAnchored;           // servo thread only
+		glm::vec3 mLastForce;
+	};
+
+#endif
@@ -0,0 +1,93 @@
+#include "latencyhistogram.h"
+
+namespace {
+
+	const int kOctaves = 48;         // up to 2^48 ns, about three days
+}
+
+LatencyHistogram::LatencyHistogram() :
+mCounts(kOctaves * kSubBuckets, 0),
+mCount(0),
+mSum(0.0),
+mMax(0)
+{
+}
+
+// Values below kSubBuckets get a bucket each; above that, the top bit picks
+// the octave and the next three bits the bucket within it.
+int LatencyHistogram::bucket(long long nanoseconds)
+{
+	if (nanoseconds < kSubBuckets)
+		return nanoseconds < 0 ? 0 : (int)nanoseconds;
+
+	int top = 63;
+	while (!(nanoseconds >> top))
+		top--;
+	int sub = (int)((nanoseconds >> (top - 3)) & (kSubBuckets - 1));
+	int index = (top - 2) * kSubBuckets + sub;
+	return index < kOctaves * kSubBuckets ? index : kOctaves * kSubBuckets - 1;
+}
+
+long long LatencyHistogram::upperEdge(int bucket)
+{
+	if (bucket < kSubBuckets)
+		return bucket;
+	int top = bucket / kSubBuckets + 2;
+	long long sub = bucket % kSubBuckets;
+	return ((kSubBuckets + sub + 1) << (top - 3)) - 1;
+}
+
+void LatencyHistogram::record(long long nanoseconds)
+{
+	mCounts[bucket(nanoseconds)]++;
+	mCount++;
+	mSum += (double)nanoseconds;
+	if (nanoseconds > mMax)
+		mMax = nanoseconds;
+}
+
+void LatencyHistogram::clear()
+{
+	mCounts.assign(mCounts.size(), 0);
+	mCount = 0;
+	mSum = 0.0;
+	mMax = 0;
+}
+
+long long LatencyHistogram::count() const
+{
+	return mCount;
+}
+
+double LatencyHistogram::mean() const
+{
+	return mCount ? mSum / mCount : 0.0;
+}
+
+long long LatencyHistogram::max() const
+{
+	return mMax;
+}
+
+long long LatencyHistogram::percentile(double q) const
+{
+	if (mCount == 0)
+		return 0;
+	long long rank = (long long)(q * (mCount - 1)) + 1;
+	long long seen = 0;
+	for (size_t i = 0; i < mCounts.size(); i++) {
+		seen += mCounts[i];
+		if (seen >= rank) {
+			long long edge = upperEdge((int)i);
+			return edge < mMax ? edge : mMax;
+		}
+	}
+	return mMax;
+}
+
+void LatencyHistogram::print(FILE *out, const char *name) const
+{
+	fprintf(out, "%-12s %8lld  mean %9.1f  p50 %9.1f  p90 %9.1f  p99 %9.1f  max %9.1f us\n",
+		name, mCount, mean() / 1000.0, percentile(0.5) / 1000.0, percentile(0.9) / 1000.0,
+		percentile(0.99) / 1000.0, mMax / 1000.0);
+}
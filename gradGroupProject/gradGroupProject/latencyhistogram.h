@@ -0,0 +1,43 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <cstdio>
+#include <vector>
+
+//! Histogram of durations with logarithmic buckets.
+//!
+//! Each power of two of nanoseconds is split into kSubBuckets equal buckets,
+//! so any percentile is off by at most 1/kSubBuckets of its value while the
+//! whole range from 1 ns to minutes fits in a few hundred counters.
+class LatencyHistogram {
+	public:
+		static const int kSubBuckets = 8;
+
+		LatencyHistogram();
+
+		void record(long long nanoseconds);
+		void clear();
+
+		long long count() const;
+		double mean() const;          // nanoseconds
+		long long max() const;
+
+		//! Upper edge of the bucket holding the q-quantile, 0 <= q <= 1.
+		//!
+		long long percentile(double q) const;
+
+		//! One line: count, mean, p50, p90, p99 and max in microseconds.
+		//!
+		void print(FILE *out, const char *name) const;
+
+	private:
+		static int bucket(long long nanoseconds);
+		static long long upperEdge(int bucket);
+
+		std::vector<long long> mCounts;
+		long long mCount;
+		double mSum;
+		long long mMax;
+	};
+
+#endif
@@ -0,0 +1,352 @@
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include "lodhierarchy.h"
+#include "profiler.h"
+
+namespace {
+
+	// Open edges are held in place by a plane through them, perpendicular to
+	// their triangle, weighted this much more than the surface itself.
+	const double kBoundaryWeight = 1000.0;
+
+	// A collapse may not turn any triangle's normal by more than about 78
+	// degrees.
+	const double kMinNormalCosine = 0.2;
+
+	// Symmetric 4x4 error quadric, upper triangle row by row.
+	struct Quadric {
+		double q[10];
+
+		Quadric()
+		{
+			std::fill(q, q + 10, 0.0);
+		}
+
+		// Squared distance to the plane n.x + d = 0, |n| = 1, times weight.
+		void addPlane(glm::dvec3 const &n, double d, double weight)
+		{
+			q[0] += weight * n.x * n.x; q[1] += weight * n.x * n.y; q[2] += weight * n.x * n.z; q[3] += weight * n.x * d;
+			q[4] += weight * n.y * n.y; q[5] += weight * n.y * n.z; q[6] += weight * n.y * d;
+			q[7] += weight * n.z * n.z; q[8] += weight * n.z * d;
+			q[9] += weight * d * d;
+		}
+
+		Quadric &operator+=(Quadric const &other)
+		{
+			for (int i = 0; i < 10; i++)
+				q[i] += other.q[i];
+			return *this;
+		}
+
+		double error(glm::dvec3 const &p) const
+		{
+			return q[0] * p.x * p.x + 2.0 * q[1] * p.x * p.y + 2.0 * q[2] * p.x * p.z + 2.0 * q[3] * p.x +
+				q[4] * p.y * p.y + 2.0 * q[5] * p.y * p.z + 2.0 * q[6] * p.y +
+				q[7] * p.z * p.z + 2.0 * q[8] * p.z + q[9];
+		}
+	};
+
+	// Moving from onto to, queued by cost.  The versions say which state of
+	// the two vertices the cost was worked out for.
+	struct Collapse {
+		double cost;
+		int from, to;
+		unsigned int fromVersion, toVersion;
+
+		bool operator<(Collapse const &other) const
+		{
+			return cost > other.cost;
+		}
+	};
+
+	class Decimator {
+		public:
+			Decimator(std::vector<glm::vec3> const &positions, std::vector<int> const &indices);
+
+			// Collapses until no more than target triangles are left or
+			// nothing can go.  Returns the triangles left.
+			size_t run(size_t target);
+
+			void liveIndices(std::vector<int> &out) const;
+
+		private:
+			glm::dvec3 position(int v) const { return glm::dvec3(mPositions[v]); }
+			glm::dvec3 faceNormal(int f) const;
+			void queue(int a, int b);
+			bool canCollapse(int from, int to);
+			void collapse(int from, int to);
+			void gatherNeighbours(int v, std::vector<int> &out);
+
+			std::vector<glm::vec3> const &mPositions;
+			std::vector<int> mCorners;
+			std::vector<char> mFaceAlive;
+			std::vector<std::vector<int> > mVertexFaces;
+			std::vector<Quadric> mQuadrics;
+			std::vector<unsigned int> mVersions;
+			std::vector<char> mVertexAlive;
+			std::priority_queue<Collapse> mQueue;
+			size_t mLive;
+
+			std::vector<unsigned int> mStamps;   // scratch for gatherNeighbours()
+			unsigned int mStamp;
+			std::vector<int> mNeighbours, mOtherNeighbours;
+		};
+
+	Decimator::Decimator(std::vector<glm::vec3> const &positions, std::vector<int> const &indices) :
+	mPositions(positions),
+	mCorners(indices),
+	mFaceAlive(indices.size() / 3, 1),
+	mVertexFaces(positions.size()),
+	mQuadrics(positions.size()),
+	mVersions(positions.size(), 0),
+	mVertexAlive(positions.size(), 1),
+	mLive(indices.size() / 3),
+	mStamps(positions.size(), 0),
+	mStamp(0)
+	{
+		size_t faceCount = mCorners.size() / 3;
+		std::vector<std::pair<std::pair<int, int>, int> > edges;
+		edges.reserve(mCorners.size());
+		for (size_t f = 0; f < faceCount; f++) {
+			int const *c = &mCorners[3 * f];
+			for (int k = 0; k < 3; k++) {
+				mVertexFaces[c[k]].push_back((int)f);
+				int a = c[k], b = c[(k + 1) % 3];
+				edges.push_back(std::make_pair(std::make_pair(std::min(a, b), std::max(a, b)), (int)f));
+			}
+
+			// Area-weighted plane of the triangle, on each of its corners.
+			glm::dvec3 n = glm::cross(position(c[1]) - position(c[0]), position(c[2]) - position(c[0]));
+			double length = glm::length(n);
+			if (length <= 0.0)
+				continue;
+			n /= length;
+			Quadric plane;
+			plane.addPlane(n, -glm::dot(n, position(c[0])), 0.5 * length);
+			for (int k = 0; k < 3; k++)
+				mQuadrics[c[k]] += plane;
+		}
+
+		// Each edge once; one used by a single triangle is on a boundary.
+		std::sort(edges.begin(), edges.end());
+		for (size_t e = 0; e < edges.size(); ) {
+			size_t next = e + 1;
+			while (next < edges.size() && edges[next].first == edges[e].first)
+				next++;
+			int a = edges[e].first.first, b = edges[e].first.second;
+			if (next - e == 1) {
+				glm::dvec3 along = position(b) - position(a);
+				glm::dvec3 n = glm::cross(along, faceNormal(edges[e].second));
+				double length = glm::length(n);
+				if (length > 0.0) {
+					n /= length;
+					Quadric plane;
+					plane.addPlane(n, -glm::dot(n, position(a)), kBoundaryWeight * glm::dot(along, along));
+					mQuadrics[a] += plane;
+					mQuadrics[b] += plane;
+				}
+			}
+			if (a != b)
+				queue(a, b);
+			e = next;
+		}
+	}
+
+	glm::dvec3 Decimator::faceNormal(int f) const
+	{
+		int const *c = &mCorners[3 * f];
+		glm::dvec3 n = glm::cross(position(c[1]) - position(c[0]), position(c[2]) - position(c[0]));
+		double length = glm::length(n);
+		return length > 0.0 ? n / length : n;
+	}
+
+	// Queues whichever direction of the edge costs less.
+	void Decimator::queue(int a, int b)
+	{
+		Quadric sum = mQuadrics[a];
+		sum += mQuadrics[b];
+		double costA = sum.error(position(a)), costB = sum.error(position(b));
+		Collapse c;
+		c.cost = std::min(costA, costB);
+		c.from = costA <= costB ? b : a;
+		c.to = costA <= costB ? a : b;
+		c.fromVersion = mVersions[c.from];
+		c.toVersion = mVersions[c.to];
+		mQueue.push(c);
+	}
+
+	void Decimator::gatherNeighbours(int v, std::vector<int> &out)
+	{
+		out.clear();
+		if (++mStamp == 0) {
+			std::fill(mStamps.begin(), mStamps.end(), 0);
+			mStamp = 1;
+		}
+		mStamps[v] = mStamp;
+		for (size_t i = 0; i < mVertexFaces[v].size(); i++) {
+			int f = mVertexFaces[v][i];
+			if (!mFaceAlive[f])
+				continue;
+			for (int k = 0; k < 3; k++) {
+				int w = mCorners[3 * f + k];
+				if (mStamps[w] != mStamp) {
+					mStamps[w] = mStamp;
+					out.push_back(w);
+				}
+			}
+		}
+	}
+
+	// The link condition: the edge's two ends may share only the vertices
+	// opposite it, or the collapse would pinch the surface.  Then no
+	// triangle that survives may flip or turn too far.
+	bool Decimator::canCollapse(int from, int to)
+	{
+		int shared = 0;
+		for (size_t i = 0; i < mVertexFaces[from].size(); i++) {
+			int f = mVertexFaces[from][i];
+			if (mFaceAlive[f] && (mCorners[3 * f] == to || mCorners[3 * f + 1] == to || mCorners[3 * f + 2] == to))
+				shared++;
+		}
+		if (shared == 0)
+			return false;
+
+		gatherNeighbours(to, mOtherNeighbours);
+		gatherNeighbours(from, mNeighbours);
+		int common = 0;
+		for (size_t i = 0; i < mOtherNeighbours.size(); i++)
+			if (mStamps[mOtherNeighbours[i]] == mStamp && mOtherNeighbours[i] != from && mOtherNeighbours[i] != to)
+				common++;
+		if (common != shared)
+			return false;
+
+		glm::dvec3 target = position(to);
+		for (size_t i = 0; i < mVertexFaces[from].size(); i++) {
+			int f = mVertexFaces[from][i];
+			int const *c = &mCorners[3 * f];
+			if (!mFaceAlive[f] || c[0] == to || c[1] == to || c[2] == to)
+				continue;
+			glm::dvec3 p[3];
+			for (int k = 0; k < 3; k++)
+				p[k] = c[k] == from ? target : position(c[k]);
+			glm::dvec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+			double length = glm::length(after);
+			if (length <= 0.0 || glm::dot(after / length, faceNormal(f)) < kMinNormalCosine)
+				return false;
+		}
+		return true;
+	}
+
+	void Decimator::collapse(int from, int to)
+	{
+		std::vector<int> &toFaces = mVertexFaces[to];
+		for (size_t i = 0; i < mVertexFaces[from].size(); i++) {
+			int f = mVertexFaces[from][i];
+			if (!mFaceAlive[f])
+				continue;
+			int *c = &mCorners[3 * f];
+			if (c[0] == to || c[1] == to || c[2] == to) {
+				mFaceAlive[f] = 0;
+				mLive--;
+				continue;
+			}
+			for (int k = 0; k < 3; k++)
+				if (c[k] == from)
+					c[k] = to;
+			toFaces.push_back(f);
+		}
+		mVertexFaces[from].clear();
+		mVertexAlive[from] = 0;
+		mQuadrics[to] += mQuadrics[from];
+		mVersions[to]++;
+
+		size_t kept = 0;
+		for (size_t i = 0; i < toFaces.size(); i++)
+			if (mFaceAlive[toFaces[i]])
+				toFaces[kept++] = toFaces[i];
+		toFaces.resize(kept);
+
+		gatherNeighbours(to, mNeighbours);
+		for (size_t i = 0; i < mNeighbours.size(); i++)
+			if (mNeighbours[i] != to)
+				queue(to, mNeighbours[i]);
+	}
+
+	size_t Decimator::run(size_t target)
+	{
+		while (mLive > target && !mQueue.empty()) {
+			Collapse c = mQueue.top();
+			mQueue.pop();
+			if (!mVertexAlive[c.from] || !mVertexAlive[c.to] ||
+				mVersions[c.from] != c.fromVersion || mVersions[c.to] != c.toVersion)
+				continue;
+			if (canCollapse(c.from, c.to))
+				collapse(c.from, c.to);
+		}
+		return mLive;
+	}
+
+	void Decimator::liveIndices(std::vector<int> &out) const
+	{
+		out.clear();
+		out.reserve(3 * mLive);
+		for (size_t f = 0; f < mFaceAlive.size(); f++)
+			if (mFaceAlive[f])
+				out.insert(out.end(), &mCorners[3 * f], &mCorners[3 * f] + 3);
+	}
+}
+
+LodHierarchy::LodHierarchy()
+{
+}
+
+// One decimation all the way down, stopping at each halving to copy the
+// level out.
+void LodHierarchy::build(std::vector<glm::vec3> const &positions, std::vector<int> const &indices)
+{
+	PROFILE_SCOPE("buildLod");
+	mLevels.clear();
+	size_t triangles = indices.size() / 3;
+	if (triangles <= 2 * kMinTriangles)
+		return;
+
+	Decimator decimator(positions, indices);
+	while (triangles / 2 >= kMinTriangles) {
+		size_t left = decimator.run(triangles / 2);
+		// Stuck well short of the target: nothing more will collapse.
+		if (left > triangles * 3 / 4)
+			break;
+		mLevels.push_back(std::vector<int>());
+		decimator.liveIndices(mLevels.back());
+		triangles = left;
+	}
+}
+
+void LodHierarchy::assign(std::vector<std::vector<int> > &levels)
+{
+	mLevels.swap(levels);
+}
+
+void LodHierarchy::clear()
+{
+	mLevels.clear();
+}
+
+size_t LodHierarchy::levelCount() const
+{
+	return mLevels.size();
+}
+
+std::vector<int> const &LodHierarchy::level(size_t level) const
+{
+	return mLevels[level];
+}
+
+int LodHierarchy::levelWithin(size_t budget) const
+{
+	for (size_t l = 0; l < mLevels.size(); l++)
+		if (mLevels[l].size() / 3 <= budget)
+			return (int)l;
+	return mLevels.empty() ? -1 : (int)mLevels.size() - 1;
+}
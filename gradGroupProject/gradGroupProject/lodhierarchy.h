@@ -0,0 +1,58 @@
+#ifndef LODHIERARCHY_H
+#define LODHIERARCHY_H
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+
+//! Coarser versions of a triangle mesh, for drawing it within a triangle
+//! budget.
+//!
+//! Built by quadric edge collapse (Garland and Heckbert, "Surface
+//! Simplification Using Quadric Error Metrics"): the edge whose collapse
+//! moves the surface least goes first, and each level is kept when the
+//! triangle count has halved since the last.  A collapse keeps one of the
+//! edge's two vertices rather than placing a new one, so every level is just
+//! another index list over the full mesh's vertices.  Moving a vertex of the
+//! full mesh therefore moves every level that still uses it, with nothing to
+//! update.
+//!
+//! Collapses that would fold a triangle over, pinch the surface or pull in
+//! an open boundary are refused or made costly, so levels stay manifold
+//! where the mesh is and keep their outline.
+class LodHierarchy {
+	public:
+		//! No level is made with fewer triangles than this.
+		//!
+		static const size_t kMinTriangles = 256;
+
+		LodHierarchy();
+
+		//! Replaces the levels with those of the mesh given by positions and
+		//! indices, three per triangle.  A mesh of at most 2 * kMinTriangles
+		//! triangles gets none.
+		void build(std::vector<glm::vec3> const &positions, std::vector<int> const &indices);
+
+		//! Takes ready-made levels, e.g. from the mesh cache.
+		//!
+		void assign(std::vector<std::vector<int> > &levels);
+
+		void clear();
+
+		//! Levels, finest first; the full mesh is not one of them.
+		//!
+		size_t levelCount() const;
+
+		//! Indices of level, three per triangle, into the full mesh's vertices.
+		//!
+		std::vector<int> const &level(size_t level) const;
+
+		//! The finest level of at most budget triangles, or the coarsest if
+		//! none is that small.  -1 if there are no levels.
+		int levelWithin(size_t budget) const;
+
+	private:
+		std::vector<std::vector<int> > mLevels;
+	};
+
+#endif
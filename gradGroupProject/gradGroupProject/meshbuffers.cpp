@@ -0,0 +1,299 @@
+#if defined(WIN32)
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <dlfcn.h>
+#else
+#include <GL/glx.h>
+#endif
+#include <algorithm>
+#include <cstdio>
+#include "meshbuffers.h"
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#define GL_STATIC_DRAW 0x88E4
+#define GL_DYNAMIC_DRAW 0x88E8
+#endif
+
+namespace {
+
+	typedef void (APIENTRY *GenBuffersProc)(GLsizei n, GLuint *buffers);
+	typedef void (APIENTRY *DeleteBuffersProc)(GLsizei n, GLuint const *buffers);
+	typedef void (APIENTRY *BindBufferProc)(GLenum target, GLuint buffer);
+	typedef void (APIENTRY *BufferDataProc)(GLenum target, ptrdiff_t size, void const *data, GLenum usage);
+	typedef void (APIENTRY *BufferSubDataProc)(GLenum target, ptrdiff_t offset, ptrdiff_t size, void const *data);
+
+	GenBuffersProc genBuffers = 0;
+	DeleteBuffersProc deleteBuffers = 0;
+	BindBufferProc bindBuffer = 0;
+	BufferDataProc bufferData = 0;
+	BufferSubDataProc bufferSubData = 0;
+
+	// Changed vertices closer together than this are sent as one range; a
+	// few clean vertices cost less than another call.
+	const int kMergeGap = 16;
+
+	void *glProc(const char *name)
+	{
+#if defined(WIN32)
+		return (void *)wglGetProcAddress(name);
+#elif defined(__APPLE__)
+		return dlsym(RTLD_DEFAULT, name);
+#else
+		return (void *)glXGetProcAddressARB((const GLubyte *)name);
+#endif
+	}
+
+	// Looked up once, on the first upload; the program only ever has one
+	// context.  Buffer objects are core from GL 1.5; a driver may still hand
+	// out the entry points on an older context, so check the version too.
+	bool haveBufferObjects()
+	{
+		static int state = -1;
+		if (state != -1)
+			return state == 1;
+
+		int major = 0, minor = 0;
+		const char *version = (const char *)glGetString(GL_VERSION);
+		if (version)
+			sscanf(version, "%d.%d", &major, &minor);
+
+		state = 0;
+		if (major > 1 || (major == 1 && minor >= 5)) {
+			genBuffers = (GenBuffersProc)glProc("glGenBuffers");
+			deleteBuffers = (DeleteBuffersProc)glProc("glDeleteBuffers");
+			bindBuffer = (BindBufferProc)glProc("glBindBuffer");
+			bufferData = (BufferDataProc)glProc("glBufferData");
+			bufferSubData = (BufferSubDataProc)glProc("glBufferSubData");
+			state = genBuffers && deleteBuffers && bindBuffer && bufferData && bufferSubData ? 1 : 0;
+		}
+		return state == 1;
+	}
+}
+
+MeshBuffers::MeshBuffers() :
+mVertexBuffer(0),
+mIndexBuffer(0),
+mUploaded(false),
+mUploadBytes(0)
+{
+}
+
+MeshBuffers::MeshBuffers(MeshBuffers const &) :
+mVertexBuffer(0),
+mIndexBuffer(0),
+mUploaded(false),
+mUploadBytes(0)
+{
+}
+
+MeshBuffers &MeshBuffers::operator=(MeshBuffers const &other)
+{
+	if (this != &other) {
+		mVertices.clear();
+		mIndices.clear();
+		mUploaded = false;
+	}
+	return *this;
+}
+
+MeshBuffers::~MeshBuffers()
+{
+}
+
+void MeshBuffers::release()
+{
+	if (mVertexBuffer) {
+		GLuint buffers[2] = { mVertexBuffer, mIndexBuffer };
+		deleteBuffers(2, buffers);
+	}
+	mVertexBuffer = mIndexBuffer = 0;
+	mVertices.clear();
+	mIndices.clear();
+	mUploaded = false;
+}
+
+bool MeshBuffers::uploaded() const
+{
+	return mUploaded;
+}
+
+bool MeshBuffers::bufferObjects() const
+{
+	return mVertexBuffer != 0;
+}
+
+size_t MeshBuffers::takeUploadBytes()
+{
+	size_t bytes = mUploadBytes;
+	mUploadBytes = 0;
+	return bytes;
+}
+
+void MeshBuffers::upload(std::vector<glm::vec3> const &positions,
+	std::vector<glm::vec3> const &normals,
+	std::vector<glm::vec3> const &colors,
+	std::vector<int> const &indices)
+{
+	mVertices.resize(positions.size());
+	for (size_t i = 0; i < positions.size(); i++) {
+		MeshVertex &v = mVertices[i];
+		for (int a = 0; a < 3; a++) {
+			v.position[a] = positions[i][a];
+			v.normal[a] = normals[i][a];
+			v.color[a] = colors[i][a];
+		}
+	}
+	mIndices.assign(indices.begin(), indices.begin() + indices.size() / 3 * 3);
+	mUploadBytes += mVertices.size() * sizeof(MeshVertex) + mIndices.size() * sizeof(GLuint);
+
+	if (haveBufferObjects()) {
+		if (!mVertexBuffer) {
+			GLuint buffers[2];
+			genBuffers(2, buffers);
+			mVertexBuffer = buffers[0];
+			mIndexBuffer = buffers[1];
+		}
+		// Vertices change with every edit, the triangles never do.
+		bindBuffer(GL_ARRAY_BUFFER, mVertexBuffer);
+		bufferData(GL_ARRAY_BUFFER, mVertices.size() * sizeof(MeshVertex),
+			mVertices.empty() ? 0 : &mVertices[0], GL_DYNAMIC_DRAW);
+		bindBuffer(GL_ARRAY_BUFFER, 0);
+		bindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer);
+		bufferData(GL_ELEMENT_ARRAY_BUFFER, mIndices.size() * sizeof(GLuint),
+			mIndices.empty() ? 0 : &mIndices[0], GL_STATIC_DRAW);
+		bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+	mUploaded = true;
+}
+
+void MeshBuffers::update(std::vector<glm::vec3> const &positions,
+	std::vector<glm::vec3> const &normals,
+	std::vector<glm::vec3> const &colors,
+	std::vector<int> &changed)
+{
+	if (!mUploaded || changed.empty())
+		return;
+
+	std::sort(changed.begin(), changed.end());
+	for (size_t i = 0; i < changed.size(); i++) {
+		MeshVertex &v = mVertices[changed[i]];
+		for (int a = 0; a < 3; a++) {
+			v.position[a] = positions[changed[i]][a];
+			v.normal[a] = normals[changed[i]][a];
+			v.color[a] = colors[changed[i]][a];
+		}
+	}
+
+	if (mVertexBuffer)
+		bindBuffer(GL_ARRAY_BUFFER, mVertexBuffer);
+	size_t i = 0;
+	while (i < changed.size()) {
+		int begin = changed[i], end = begin + 1;
+		for (i++; i < changed.size() && changed[i] - end < kMergeGap; i++)
+			end = changed[i] + 1;
+
+		size_t bytes = (end - begin) * sizeof(MeshVertex);
+		if (mVertexBuffer)
+			bufferSubData(GL_ARRAY_BUFFER, begin * sizeof(MeshVertex), bytes, &mVertices[begin]);
+		mUploadBytes += bytes;
+	}
+	if (mVertexBuffer)
+		bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MeshBuffers::draw() const
+{
+	if (!mUploaded || mIndices.empty())
+		return;
+
+	// With a buffer bound the pointers are byte offsets into it.
+	const char *base = (const char *)&mVertices[0];
+	if (mVertexBuffer) {
+		base = 0;
+		bindBuffer(GL_ARRAY_BUFFER, mVertexBuffer);
+		bindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer);
+	}
+
+	glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex), base + offsetof(MeshVertex, position));
+	glNormalPointer(GL_FLOAT, sizeof(MeshVertex), base + offsetof(MeshVertex, normal));
+	glColorPointer(3, GL_FLOAT, sizeof(MeshVertex), base + offsetof(MeshVertex, color));
+	glDrawElements(GL_TRIANGLES, (GLsizei)mIndices.size(), GL_UNSIGNED_INT,
+		mIndexBuffer ? 0 : &mIndices[0]);
+	glPopClientAttrib();
+
+	if (mVertexBuffer) {
+		bindBuffer(GL_ARRAY_BUFFER, 0);
+		bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+}
+
+ShapeList::ShapeList() :
+mList(0),
+mCompiled(false)
+{
+}
+
+ShapeList::ShapeList(ShapeList const &) :
+mList(0),
+mCompiled(false)
+{
+}
+
+ShapeList &ShapeList::operator=(ShapeList const &other)
+{
+	if (this != &other)
+		mCompiled = false;
+	return *this;
+}
+
+ShapeList::~ShapeList()
+{
+}
+
+void ShapeList::release()
+{
+	if (mList)
+		glDeleteLists(mList, 1);
+	mList = 0;
+	mCompiled = false;
+}
+
+bool ShapeList::compiled() const
+{
+	return mCompiled;
+}
+
+// glDrawElements reads the client arrays while the list is compiled, so the
+// list keeps its own copy of the triangles.
+void ShapeList::compile(std::vector<glm::vec3> const &positions, std::vector<int> const &indices)
+{
+	if (!mList)
+		mList = glGenLists(1);
+
+	glNewList(mList, GL_COMPILE);
+	if (!positions.empty() && indices.size() >= 3) {
+		glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+		glEnableClientState(GL_VERTEX_ARRAY);
+		glVertexPointer(3, GL_FLOAT, sizeof(glm::vec3), &positions[0]);
+		glDrawElements(GL_TRIANGLES, (GLsizei)(indices.size() / 3 * 3), GL_UNSIGNED_INT, &indices[0]);
+		glPopClientAttrib();
+	}
+	glEndList();
+	mCompiled = true;
+}
+
+void ShapeList::call() const
+{
+	if (mCompiled)
+		glCallList(mList);
+}
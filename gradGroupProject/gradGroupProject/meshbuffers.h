@@ -0,0 +1,105 @@
+#ifndef MESHBUFFERS_H
+#define MESHBUFFERS_H
+#if defined(WIN32) || defined(linux)
+#include <GL/glut.h>
+#elif defined(__APPLE__)
+#include <GLUT/glut.h>
+#endif
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+
+//! One vertex of the interleaved vertex buffer.
+//!
+struct MeshVertex {
+	float position[3];
+	float normal[3];
+	float color[3];
+};
+
+//! Retained copy of an indexed mesh, drawn with a single glDrawElements.
+//!
+//! Vertices are interleaved in one buffer object and the triangle indices
+//! kept in a second.  The GL 1.5 buffer entry points are looked up at run
+//! time, since opengl32 on Windows only exports GL 1.1; on a context without
+//! them the same arrays are drawn from client memory instead.
+//!
+//! Buffer objects belong to the context that was current at upload().  A copy
+//! starts out empty and has to be uploaded again.  The destructor leaves the
+//! buffers alone because the context may already be gone at exit; call
+//! release() while it is still current to free them earlier.
+class MeshBuffers {
+	public:
+		MeshBuffers();
+		MeshBuffers(MeshBuffers const &other);
+		MeshBuffers &operator=(MeshBuffers const &other);
+		~MeshBuffers();
+
+		//! Rebuilds the interleaved vertices and uploads both buffers.  normals
+		//! and colors share the indices of positions.  Needs a current context.
+		void upload(std::vector<glm::vec3> const &positions,
+			std::vector<glm::vec3> const &normals,
+			std::vector<glm::vec3> const &colors,
+			std::vector<int> const &indices);
+
+		//! Re-sends only the listed vertices, which must have been uploaded
+		//! before.  changed is sorted in place and coalesced into ranges, each
+		//! sent with one glBufferSubData.
+		void update(std::vector<glm::vec3> const &positions,
+			std::vector<glm::vec3> const &normals,
+			std::vector<glm::vec3> const &colors,
+			std::vector<int> &changed);
+
+		//! Draws every triangle.  Client array state is saved and restored.
+		//!
+		void draw() const;
+
+		//! Deletes the buffer objects; the context they were made in must be
+		//! current.
+		void release();
+
+		bool uploaded() const;
+
+		//! True if the buffers live in GL buffer objects rather than client
+		//! memory.
+		bool bufferObjects() const;
+
+		//! Bytes sent by upload() and update() since the last call.  Without
+		//! buffer objects this counts what would have been sent.
+		size_t takeUploadBytes();
+
+	private:
+		std::vector<MeshVertex> mVertices;
+		std::vector<GLuint> mIndices;
+		GLuint mVertexBuffer;
+		GLuint mIndexBuffer;
+		bool mUploaded;
+		size_t mUploadBytes;
+	};
+
+//! Display list holding just the triangle positions of a mesh, for haptic
+//! shapes: the feedback buffer only needs geometry, so normals and colours
+//! are left out.  The triangles are captured at compile() and replayed by
+//! call() until the next compile().
+//!
+//! Like MeshBuffers, a copy starts out empty and the destructor leaves the
+//! list alone; release() frees it while its context is current.
+class ShapeList {
+	public:
+		ShapeList();
+		ShapeList(ShapeList const &other);
+		ShapeList &operator=(ShapeList const &other);
+		~ShapeList();
+
+		void compile(std::vector<glm::vec3> const &positions, std::vector<int> const &indices);
+		void call() const;
+		void release();
+		bool compiled() const;
+
+	private:
+		GLuint mList;
+		bool mCompiled;
+	};
+
+#endif
@@ -0,0 +1,206 @@
+#include <cstdio>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if defined(WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "meshcache.h"
+
+namespace {
+
+	const char kMagic[4] = { 'T', 'V', 'O', 'M' };
+	const int32_t kMaxGridDim = 1 << 16;
+
+	uint64_t align(uint64_t offset)
+	{
+		return (offset + kMeshCacheAlignment - 1) & ~(uint64_t)(kMeshCacheAlignment - 1);
+	}
+
+	bool inside(uint64_t offset, uint64_t bytes, uint64_t fileSize)
+	{
+		return offset <= fileSize && bytes <= fileSize - offset;
+	}
+}
+
+void layoutMeshCache(MeshCacheHeader &header)
+{
+	memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.version = kMeshCacheVersion;
+	header.reserved = 0;
+
+	uint64_t vec3Bytes = (uint64_t)header.vertexCount * 3 * sizeof(float);
+	uint64_t offset = align(sizeof(MeshCacheHeader));
+	header.positionsOffset = offset;        offset = align(offset + vec3Bytes);
+	header.normalsOffset = offset;          offset = align(offset + vec3Bytes);
+	header.colorsOffset = offset;           offset = align(offset + vec3Bytes);
+	header.frictionOffset = offset;         offset = align(offset + (uint64_t)header.vertexCount * sizeof(double));
+	header.indicesOffset = offset;          offset = align(offset + (uint64_t)header.indexCount * sizeof(int));
+	header.adjacencyOffsetsOffset = offset; offset = align(offset + ((uint64_t)header.vertexCount + 1) * sizeof(int));
+	header.adjacencyOffset = offset;        offset = align(offset + (uint64_t)header.adjacencyCount * sizeof(int));
+	header.lodLevelsOffset = offset;        offset = align(offset + (uint64_t)header.lodLevelCount * sizeof(uint32_t));
+	header.lodIndicesOffset = offset;       offset = align(offset + (uint64_t)header.lodIndexCount * sizeof(int));
+	header.incidenceOffsetsOffset = offset; offset = align(offset + ((uint64_t)header.vertexCount + 1) * sizeof(int));
+	header.incidenceOffset = offset;        offset = align(offset + (uint64_t)header.indexCount * sizeof(int));
+	header.gridCellStartOffset = offset;    offset = align(offset + (meshCacheGridCells(header) + 1) * sizeof(int));
+	header.gridCellItemsOffset = offset;    offset = align(offset + (uint64_t)header.vertexCount * sizeof(int));
+	header.bvhNodesOffset = offset;         offset = align(offset + (uint64_t)header.bvhNodeCount * 2 * sizeof(int));
+	header.bvhItemsOffset = offset;         offset = offset + (uint64_t)(header.indexCount / 3) * sizeof(int);
+	header.fileSize = offset;
+}
+
+uint64_t meshCacheGridCells(MeshCacheHeader const &header)
+{
+	uint64_t cells = 1;
+	for (int a = 0; a < 3; a++)
+		cells *= header.gridDims[a] > 0 ? (uint64_t)header.gridDims[a] : 0;
+	return cells;
+}
+
+bool validMeshCache(MeshCacheHeader const &header, size_t fileSize)
+{
+	if (fileSize < sizeof(MeshCacheHeader) || memcmp(header.magic, kMagic, sizeof(kMagic)) != 0)
+		return false;
+	if (header.version != kMeshCacheVersion || header.fileSize != fileSize)
+		return false;
+
+	// Recompute the layout rather than trusting the stored offsets, once it
+	// is sure not to overflow.
+	for (int a = 0; a < 3; a++)
+		if (header.gridDims[a] < 0 || header.gridDims[a] > kMaxGridDim)
+			return false;
+	MeshCacheHeader expected = header;
+	layoutMeshCache(expected);
+	return memcmp(&expected, &header, sizeof(header)) == 0 &&
+		inside(header.bvhItemsOffset, (uint64_t)(header.indexCount / 3) * sizeof(int), fileSize);
+}
+
+bool fileStamp(const char *path, uint64_t &size, int64_t &time)
+{
+#if defined(WIN32)
+	struct __stat64 st;
+	if (_stat64(path, &st) != 0)
+		return false;
+#else
+	struct stat st;
+	if (stat(path, &st) != 0)
+		return false;
+#endif
+	size = (uint64_t)st.st_size;
+	time = (int64_t)st.st_mtime;
+	return true;
+}
+
+bool writeFileAtomically(const char *path, const char *data, size_t size)
+{
+	std::string tmpPath = std::string(path) + ".tmp";
+	FILE *out = fopen(tmpPath.c_str(), "wb");
+	if (!out)
+		return false;
+	bool ok = fwrite(data, 1, size, out) == size;
+	ok = (fclose(out) == 0) && ok;
+	if (ok) {
+		remove(path);
+		ok = rename(tmpPath.c_str(), path) == 0;
+	}
+	if (!ok)
+		remove(tmpPath.c_str());
+	return ok;
+}
+
+std::string meshCachePath(const char *filename)
+{
+	return std::string(filename) + ".cache";
+}
+
+#if defined(WIN32)
+
+MappedFile::MappedFile() : mData(0), mSize(0), mFile(INVALID_HANDLE_VALUE), mMapping(0) {}
+
+bool MappedFile::open(const char *path)
+{
+	close();
+	mFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (mFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(mFile, &size) || size.QuadPart == 0) {
+		close();
+		return false;
+	}
+	mMapping = CreateFileMappingA(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mMapping)
+		mData = (const char *)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+	if (!mData) {
+		close();
+		return false;
+	}
+	mSize = (size_t)size.QuadPart;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (mData)
+		UnmapViewOfFile(mData);
+	if (mMapping)
+		CloseHandle(mMapping);
+	if (mFile != INVALID_HANDLE_VALUE)
+		CloseHandle(mFile);
+	mData = 0;
+	mSize = 0;
+	mMapping = 0;
+	mFile = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile() : mData(0), mSize(0), mFile(-1) {}
+
+bool MappedFile::open(const char *path)
+{
+	close();
+	mFile = ::open(path, O_RDONLY);
+	if (mFile < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(mFile, &st) != 0 || st.st_size == 0) {
+		close();
+		return false;
+	}
+	void *data = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, mFile, 0);
+	if (data == MAP_FAILED) {
+		close();
+		return false;
+	}
+	mData = (const char *)data;
+	mSize = (size_t)st.st_size;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (mData)
+		munmap((void *)mData, mSize);
+	if (mFile >= 0)
+		::close(mFile);
+	mData = 0;
+	mSize = 0;
+	mFile = -1;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
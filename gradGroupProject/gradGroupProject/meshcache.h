@@ -0,0 +1,122 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <cstddef>
+#include <string>
+#include <stdint.h>
+
+//! Binary mesh cache written next to a source .obj after the first load.
+//!
+//! The file is a MeshCacheHeader followed by contiguous arrays at the byte
+//! offsets recorded in the header, each aligned to kMeshCacheAlignment:
+//!
+//!   positions   vertexCount * 3 floats
+//!   normals     vertexCount * 3 floats
+//!   colors      vertexCount * 3 floats
+//!   friction    vertexCount doubles
+//!   indices     indexCount ints (three per triangle)
+//!   adjacency   vertexCount + 1 offsets, then adjacencyCount neighbour ints
+//!   lod levels  lodLevelCount uint32 triangle counts, finest first
+//!   lod indices lodIndexCount ints, every LodHierarchy level back to back
+//!   incidence   vertexCount + 1 offsets, then indexCount triangle ids
+//!   grid cells  gridDims[0] * gridDims[1] * gridDims[2] + 1 offsets, then
+//!               vertexCount vertex ids
+//!   bvh         bvhNodeCount (first, count) int pairs, then indexCount / 3
+//!               triangle ids; the boxes are fitted again on load
+//!
+//! Everything is stored already unitized with normals computed, and with the
+//! spatial indices built, so loading is a map of the file and one copy per
+//! array.  The cache is tied to the source
+//! file by its size and modification time and is ignored when either changes.
+//! OBJLoader::saveBinary() writes the same format with both set to 0, for a
+//! snapshot that stands on its own.
+struct MeshCacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t adjacencyCount;
+	uint32_t lodLevelCount;
+	uint32_t lodIndexCount;
+	uint32_t bvhNodeCount;
+	int32_t gridDims[3];
+	float gridCellSize;
+	float gridOrigin[3];
+	uint32_t reserved;
+
+	uint64_t positionsOffset;
+	uint64_t normalsOffset;
+	uint64_t colorsOffset;
+	uint64_t frictionOffset;
+	uint64_t indicesOffset;
+	uint64_t adjacencyOffsetsOffset;
+	uint64_t adjacencyOffset;
+	uint64_t lodLevelsOffset;
+	uint64_t lodIndicesOffset;
+	uint64_t incidenceOffsetsOffset;
+	uint64_t incidenceOffset;
+	uint64_t gridCellStartOffset;
+	uint64_t gridCellItemsOffset;
+	uint64_t bvhNodesOffset;
+	uint64_t bvhItemsOffset;
+	uint64_t fileSize;
+};
+
+const uint32_t kMeshCacheVersion = 5;
+const size_t kMeshCacheAlignment = 16;
+
+//! Fills in the magic, version and array offsets from the counts already set
+//! in header.
+void layoutMeshCache(MeshCacheHeader &header);
+
+//! Number of cells of the grid stored in header.
+//!
+uint64_t meshCacheGridCells(MeshCacheHeader const &header);
+
+//! Checks the magic, version and that every array lies inside fileSize bytes.
+//!
+bool validMeshCache(MeshCacheHeader const &header, size_t fileSize);
+
+//! Size and modification time of path.  Returns false if it cannot be stat'ed.
+//!
+bool fileStamp(const char *path, uint64_t &size, int64_t &time);
+
+//! Writes size bytes to path in one call, through a temporary file that is
+//! renamed over path, so a crash never leaves a torn file.
+bool writeFileAtomically(const char *path, const char *data, size_t size);
+
+//! Where the cache for an .obj file lives.
+//!
+std::string meshCachePath(const char *filename);
+
+//! Read-only memory mapping of a whole file.
+//!
+class MappedFile {
+	public:
+		MappedFile();
+		~MappedFile();
+
+		bool open(const char *path);
+		void close();
+
+		const char *data() const { return mData; }
+		size_t size() const { return mSize; }
+
+	private:
+		MappedFile(MappedFile const &);
+		MappedFile &operator=(MappedFile const &);
+
+		const char *mData;
+		size_t mSize;
+#if defined(WIN32)
+		void *mFile;
+		void *mMapping;
+#else
+		int mFile;
+#endif
+	};
+
+#endif
@@ -0,0 +1,202 @@
+#include "meshsnapshot.h"
+
+MeshSnapshots::MeshSnapshots() :
+mLatest(-1),
+mEpoch(0),
+mSoA(false),
+mMovedSince(0),
+mCaughtUp(0)
+{
+	for (int i = 0; i < kSlots; i++)
+		mSlots[i].readers.store(0);
+}
+
+MeshSnapshots::MeshSnapshots(MeshSnapshots const &other) :
+mLatest(-1),
+mEpoch(0),
+mSoA(false),
+mMovedSince(0),
+mCaughtUp(0)
+{
+	copyFrom(other);
+}
+
+MeshSnapshots &MeshSnapshots::operator=(MeshSnapshots const &other)
+{
+	if (this != &other)
+		copyFrom(other);
+	return *this;
+}
+
+void MeshSnapshots::copyFrom(MeshSnapshots const &other)
+{
+	for (int i = 0; i < kSlots; i++) {
+		mSlots[i].snapshot = other.mSlots[i].snapshot;
+		mSlots[i].isPending = other.mSlots[i].isPending;
+		mSlots[i].pending = other.mSlots[i].pending;
+		mSlots[i].readers.store(0);
+	}
+	mLatest.store(other.mLatest.load());
+	mEpoch = other.mEpoch;
+	mSoA = other.mSoA;
+	mMoved = other.mMoved;
+	mLastMoved = other.mLastMoved;
+	mMovedSince = other.mMovedSince;
+	mCaughtUp.store(other.mCaughtUp.load());
+}
+
+void MeshSnapshots::clear()
+{
+	for (int i = 0; i < kSlots; i++) {
+		mSlots[i].snapshot = MeshSnapshot();
+		mSlots[i].isPending.clear();
+		mSlots[i].pending.clear();
+		mSlots[i].readers.store(0);
+	}
+	mLatest.store(-1);
+	mEpoch = 0;
+	mSoA = false;
+	mMoved.clear();
+	mLastMoved.clear();
+	mMovedSince = 0;
+	mCaughtUp.store(0);
+}
+
+void MeshSnapshots::reset(std::vector<glm::vec3> const &positions, std::vector<int> const &indices, bool soa)
+{
+	// Build the indices once and copy them; they come out the same anyway.
+	SpatialGrid grid;
+	TriangleBVH bvh;
+	grid.build(positions);
+	bvh.build(positions, indices);
+	reset(positions, grid, bvh, soa);
+}
+
+void MeshSnapshots::reset(std::vector<glm::vec3> const &positions, SpatialGrid const &grid, TriangleBVH const &bvh,
+	bool soa)
+{
+	MeshSnapshot &first = mSlots[0].snapshot;
+	first.positions = positions;
+	if (soa)
+		first.positionsSoA.assign(positions);
+	else
+		first.positionsSoA.clear();
+	first.grid = grid;
+	first.bvh = bvh;
+	first.epoch = ++mEpoch;
+	first.moved.clear();
+	first.movedSince = first.epoch;
+
+	for (int i = 0; i < kSlots; i++) {
+		if (i > 0)
+			mSlots[i].snapshot = first;
+		mSlots[i].isPending.assign(positions.size(), 0);
+		mSlots[i].pending.clear();
+		mSlots[i].readers.store(0);
+	}
+	mSoA = soa;
+	mMoved.clear();
+	mLastMoved.assign(positions.size(), 0);
+	mMovedSince = mEpoch;
+	mLatest.store(0);
+}
+
+void MeshSnapshots::moved(int v)
+{
+	for (int i = 0; i < kSlots; i++) {
+		Slot &slot = mSlots[i];
+		if (!slot.isPending[v]) {
+			slot.isPending[v] = 1;
+			slot.pending.push_back(v);
+		}
+	}
+	// The next publish() that succeeds makes epoch mEpoch + 1.
+	if (mLastMoved[v] <= mMovedSince)
+		mMoved.push_back(v);
+	mLastMoved[v] = mEpoch + 1;
+}
+
+void MeshSnapshots::caughtUp(unsigned int epoch) const
+{
+	mCaughtUp.store(epoch, std::memory_order_relaxed);
+}
+
+bool MeshSnapshots::publish(std::vector<glm::vec3> const &positions, std::vector<int> const &indices,
+	CSRGraph const &vertexTriangles)
+{
+	// Only the editor stores mLatest, so its own load needs no ordering.
+	int latest = mLatest.load(std::memory_order_relaxed);
+	if (latest < 0)
+		return false;
+
+	// A reader that bumps the count after this check sees that the slot is
+	// not the latest and backs off before reading it.
+	int target = -1;
+	for (int i = 0; i < kSlots && target < 0; i++)
+		if (i != latest && mSlots[i].readers.load() == 0)
+			target = i;
+	if (target < 0)
+		return false;
+
+	Slot &slot = mSlots[target];
+	MeshSnapshot &snapshot = slot.snapshot;
+	mTriangles.clear();
+	for (size_t i = 0; i < slot.pending.size(); i++) {
+		int v = slot.pending[i];
+		snapshot.positions[v] = positions[v];
+		snapshot.grid.update(snapshot.positions, v);
+		if (mSoA)
+			snapshot.positionsSoA.set(v, positions[v]);
+		ConstSpan<int> incident = vertexTriangles.neighbours(v);
+		mTriangles.insert(mTriangles.end(), incident.begin(), incident.end());
+		slot.isPending[v] = 0;
+	}
+	slot.pending.clear();
+	// Neighbouring moved vertices share triangles, and triangles share
+	// leaves; refit() fits each leaf and box above it once.
+	snapshot.bvh.refit(snapshot.positions, indices, mTriangles);
+
+	// Vertices the copy-keeping reader has seen drop off the list.
+	unsigned int caughtUp = mCaughtUp.load(std::memory_order_relaxed);
+	if (caughtUp > mMovedSince && caughtUp <= mEpoch) {
+		size_t kept = 0;
+		for (size_t i = 0; i < mMoved.size(); i++)
+			if (mLastMoved[mMoved[i]] > caughtUp)
+				mMoved[kept++] = mMoved[i];
+		mMoved.resize(kept);
+		mMovedSince = caughtUp;
+	}
+	snapshot.moved = mMoved;
+	snapshot.movedSince = mMovedSince;
+	snapshot.epoch = ++mEpoch;
+
+	mLatest.store(target);
+	return true;
+}
+
+// Pin first, then check the slot is still the latest: once both hold, the
+// editor will not pick it until it is released.
+MeshSnapshot const *MeshSnapshots::acquire() const
+{
+	for (;;) {
+		int latest = mLatest.load();
+		if (latest < 0)
+			return 0;
+		Slot const &slot = mSlots[latest];
+		slot.readers.fetch_add(1);
+		if (mLatest.load() == latest)
+			return &slot.snapshot;
+		slot.readers.fetch_sub(1);
+	}
+}
+
+void MeshSnapshots::release(MeshSnapshot const *snapshot) const
+{
+	if (!snapshot)
+		return;
+	for (int i = 0; i < kSlots; i++)
+		if (&mSlots[i].snapshot == snapshot) {
+			mSlots[i].readers.fetch_sub(1);
+			return;
+		}
+}
@@ -0,0 +1,134 @@
+#ifndef MESHSNAPSHOT_H
+#define MESHSNAPSHOT_H
+
+#include <atomic>
+#include <vector>
+#include <glm/glm.hpp>
+#include "csrgraph.h"
+#include "spatialgrid.h"
+#include "trianglebvh.h"
+#include "vertexsoa.h"
+
+//! Vertex positions and the spatial indices over them, as of one published
+//! edit.  Readers only ever see a snapshot that is complete.
+struct MeshSnapshot {
+	std::vector<glm::vec3> positions;
+	VertexSoA positionsSoA;       // empty unless built with soa
+	SpatialGrid grid;
+	TriangleBVH bvh;
+	unsigned int epoch;           // increases with every reset() and publish()
+
+	// Every vertex whose position changed between epoch movedSince and this
+	// one, for a reader that keeps its own copy (see caughtUp()).
+	std::vector<int> moved;
+	unsigned int movedSince;
+};
+
+//! Hands consistent MeshSnapshots from one editing thread to any number of
+//! reading threads without locks.
+//!
+//! The editor changes its own copy of the positions, reports every vertex it
+//! moves with moved(), and calls publish() once an edit is complete.
+//! publish() picks a slot that is neither the latest nor held by a reader,
+//! replays into it only the vertices moved since that slot was last written,
+//! and makes it the latest with one atomic store.  Readers pin the latest
+//! slot with acquire() and unpin it with release(); a pinned slot is never
+//! written.  Each reader pins at most one slot at a time, so with kSlots
+//! slots up to kSlots - 2 readers never leave the editor without a free one,
+//! and the editor never waits.
+//!
+//! A reader that keeps a copy of the positions of its own, like the graphics
+//! thread, reports the epoch its copy is at with caughtUp().  Each snapshot
+//! then lists the vertices moved since an epoch that reader had reached, so
+//! it can bring its copy up to date by copying only those.
+class MeshSnapshots {
+	public:
+		static const int kSlots = 5;
+
+		MeshSnapshots();
+
+		//! Copies the current contents.  Neither side may be in use by
+		//! another thread.
+		MeshSnapshots(MeshSnapshots const &other);
+		MeshSnapshots &operator=(MeshSnapshots const &other);
+
+		//! Fills every slot from positions, with the grid, the BVH and (with
+		//! soa) the SoA copy built over them.  Not thread-safe.
+		void reset(std::vector<glm::vec3> const &positions, std::vector<int> const &indices, bool soa);
+
+		//! Same, with a grid and BVH already built over positions, e.g. from
+		//! the mesh cache.
+		void reset(std::vector<glm::vec3> const &positions, SpatialGrid const &grid, TriangleBVH const &bvh,
+			bool soa);
+
+		void clear();
+
+		//! Editor: positions[v] has changed since the last publish().
+		//!
+		void moved(int v);
+
+		//! Editor: publishes positions as the new latest snapshot.  Returns
+		//! false, leaving the moves queued for the next call, if every other
+		//! slot is pinned by a reader.
+		bool publish(std::vector<glm::vec3> const &positions, std::vector<int> const &indices,
+			CSRGraph const &vertexTriangles);
+
+		//! The one reader with a copy of its own: its copy now matches
+		//! snapshot epoch.
+		void caughtUp(unsigned int epoch) const;
+
+		//! Reader: pins the latest snapshot, or returns 0 if there is none.
+		//! Must be paired with release() on the same thread.
+		MeshSnapshot const *acquire() const;
+		void release(MeshSnapshot const *snapshot) const;
+
+	private:
+		// pending and isPending belong to the editor; readers only touch
+		// snapshot and readers.
+		struct Slot {
+			MeshSnapshot snapshot;
+			std::vector<char> isPending;
+			std::vector<int> pending;
+			mutable std::atomic<int> readers;
+		};
+
+		void copyFrom(MeshSnapshots const &other);
+
+		Slot mSlots[kSlots];
+		std::atomic<int> mLatest;     // -1 when empty
+		unsigned int mEpoch;
+		bool mSoA;
+
+		// Editor: the vertices moved since epoch mMovedSince, and the epoch
+		// each vertex last moved in.  mCaughtUp is where the reader with its
+		// own copy has got to; the editor moves mMovedSince up to it.
+		std::vector<int> mMoved;
+		std::vector<unsigned int> mLastMoved;
+		unsigned int mMovedSince;
+		mutable std::atomic<unsigned int> mCaughtUp;
+
+		// Editor: scratch for publish().
+		std::vector<int> mTriangles;
+	};
+
+//! Pins the latest snapshot for the lifetime of the reference.
+//!
+class SnapshotRef {
+	public:
+		explicit SnapshotRef(MeshSnapshots const &snapshots) :
+		mSnapshots(snapshots), mSnapshot(snapshots.acquire()) {}
+		~SnapshotRef() { mSnapshots.release(mSnapshot); }
+
+		MeshSnapshot const *operator->() const { return mSnapshot; }
+		MeshSnapshot const &operator*() const { return *mSnapshot; }
+		bool empty() const { return mSnapshot == 0; }
+
+	private:
+		SnapshotRef(SnapshotRef const &);
+		SnapshotRef &operator=(SnapshotRef const &);
+
+		MeshSnapshots const &mSnapshots;
+		MeshSnapshot const *mSnapshot;
+	};
+
+#endif
@@ -0,0 +1,195 @@
+#include <cmath>
+#include "nearestscan.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define NEARESTSCAN_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TARGET_SSE2
+#define TARGET_AVX2
+#else
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// Distances for a block of kVertexSoALanes points are computed into a small
+// array; only a block whose minimum beats the best so far is scanned again to
+// find which lane it was.
+static int nearestScalar(VertexSoA const &points, glm::vec3 const &p)
+{
+	float const *x = points.x(), *y = points.y(), *z = points.z();
+	float best = HUGE_VALF;
+	int bestIndex = 0;
+	float d[kVertexSoALanes];
+	for (size_t base = 0; base < points.paddedSize(); base += kVertexSoALanes) {
+		float blockMin = HUGE_VALF;
+		for (size_t k = 0; k < kVertexSoALanes; k++) {
+			float dx = x[base + k] - p.x, dy = y[base + k] - p.y, dz = z[base + k] - p.z;
+			d[k] = dx * dx + dy * dy + dz * dz;
+			blockMin = d[k] < blockMin ? d[k] : blockMin;
+		}
+		if (blockMin < best) {
+			best = blockMin;
+			for (size_t k = 0; k < kVertexSoALanes; k++)
+				if (d[k] == blockMin) {
+					bestIndex = (int)(base + k);
+					break;
+				}
+		}
+	}
+	return bestIndex;
+}
+
+#ifdef NEARESTSCAN_X86
+
+// Each vector lane keeps the first minimum of the points it saw, so the
+// overall answer is the smallest distance across lanes, lowest index first.
+static int reduceLanes(float const *dist, int const *index, int lanes)
+{
+	int best = 0;
+	for (int k = 1; k < lanes; k++)
+		if (dist[k] < dist[best] || (dist[k] == dist[best] && index[k] < index[best]))
+			best = k;
+	return index[best];
+}
+
+TARGET_SSE2 static int nearestSSE2(VertexSoA const &points, glm::vec3 const &p)
+{
+	float const *x = points.x(), *y = points.y(), *z = points.z();
+	__m128 px = _mm_set1_ps(p.x), py = _mm_set1_ps(p.y), pz = _mm_set1_ps(p.z);
+	__m128 best = _mm_set1_ps(HUGE_VALF);
+	__m128i bestIndex = _mm_setzero_si128();
+	__m128i index = _mm_setr_epi32(0, 1, 2, 3);
+	__m128i step = _mm_set1_epi32(4);
+	for (size_t i = 0; i < points.paddedSize(); i += 4) {
+		__m128 dx = _mm_sub_ps(_mm_load_ps(x + i), px);
+		__m128 dy = _mm_sub_ps(_mm_load_ps(y + i), py);
+		__m128 dz = _mm_sub_ps(_mm_load_ps(z + i), pz);
+		__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		__m128 less = _mm_cmplt_ps(d, best);
+		__m128i lessMask = _mm_castps_si128(less);
+		best = _mm_or_ps(_mm_and_ps(less, d), _mm_andnot_ps(less, best));
+		bestIndex = _mm_or_si128(_mm_and_si128(lessMask, index), _mm_andnot_si128(lessMask, bestIndex));
+		index = _mm_add_epi32(index, step);
+	}
+
+	float dist[4];
+	int lanes[4];
+	_mm_storeu_ps(dist, best);
+	_mm_storeu_si128((__m128i *)lanes, bestIndex);
+	return reduceLanes(dist, lanes, 4);
+}
+
+TARGET_AVX2 static int nearestAVX2(VertexSoA const &points, glm::vec3 const &p)
+{
+	float const *x = points.x(), *y = points.y(), *z = points.z();
+	__m256 px = _mm256_set1_ps(p.x), py = _mm256_set1_ps(p.y), pz = _mm256_set1_ps(p.z);
+	__m256 best = _mm256_set1_ps(HUGE_VALF);
+	__m256i bestIndex = _mm256_setzero_si256();
+	__m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	__m256i step = _mm256_set1_epi32(8);
+	for (size_t i = 0; i < points.paddedSize(); i += 8) {
+		__m256 dx = _mm256_sub_ps(_mm256_load_ps(x + i), px);
+		__m256 dy = _mm256_sub_ps(_mm256_load_ps(y + i), py);
+		__m256 dz = _mm256_sub_ps(_mm256_load_ps(z + i), pz);
+		// Separate multiply and add, never FMA, to round like the scalar loop.
+		__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+		__m256 less = _mm256_cmp_ps(d, best, _CMP_LT_OQ);
+		best = _mm256_blendv_ps(best, d, less);
+		bestIndex = _mm256_blendv_epi8(bestIndex, index, _mm256_castps_si256(less));
+		index = _mm256_add_epi32(index, step);
+	}
+
+	float dist[8];
+	int lanes[8];
+	_mm256_storeu_ps(dist, best);
+	_mm256_storeu_si256((__m256i *)lanes, bestIndex);
+	return reduceLanes(dist, lanes, 8);
+}
+
+static bool cpuHasSSE2()
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[3] & (1 << 26)) != 0;
+#else
+	return __builtin_cpu_supports("sse2") != 0;
+#endif
+}
+
+// AVX2 needs both the instructions and an OS that saves the ymm registers.
+static bool cpuHasAVX2()
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+#endif
+
+static NearestKernel detectNearestKernel()
+{
+#ifdef NEARESTSCAN_X86
+	if (cpuHasAVX2())
+		return NearestKernelAVX2;
+	if (cpuHasSSE2())
+		return NearestKernelSSE2;
+#endif
+	return NearestKernelScalar;
+}
+
+NearestKernel bestNearestKernel()
+{
+	static const NearestKernel kernel = detectNearestKernel();
+	return kernel;
+}
+
+const char *nearestKernelName(NearestKernel kernel)
+{
+	switch (kernel) {
+	case NearestKernelSSE2:
+		return "sse2";
+	case NearestKernelAVX2:
+		return "avx2";
+	default:
+		return "scalar";
+	}
+}
+
+int nearestScan(VertexSoA const &points, glm::vec3 const &p)
+{
+	return nearestScan(points, p, bestNearestKernel());
+}
+
+int nearestScan(VertexSoA const &points, glm::vec3 const &p, NearestKernel kernel)
+{
+	if (points.empty())
+		return -1;
+
+	// Never run a kernel the CPU lacks, whatever the caller asked for.
+	if (kernel > bestNearestKernel())
+		kernel = NearestKernelScalar;
+
+#ifdef NEARESTSCAN_X86
+	if (kernel == NearestKernelAVX2)
+		return nearestAVX2(points, p);
+	if (kernel == NearestKernelSSE2)
+		return nearestSSE2(points, p);
+#endif
+	return nearestScalar(points, p);
+}
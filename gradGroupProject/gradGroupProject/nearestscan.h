@@ -0,0 +1,31 @@
+#ifndef NEARESTSCAN_H
+#define NEARESTSCAN_H
+
+#include <glm/glm.hpp>
+#include "vertexsoa.h"
+
+//! Implementations of the linear nearest-point scan.  Every kernel compares
+//! squared float distances computed as dx*dx + dy*dy + dz*dz and breaks ties
+//! towards the lower index, so all of them return the same index as a plain
+//! scalar loop over the points.
+enum NearestKernel {
+	NearestKernelScalar,
+	NearestKernelSSE2,   // 4 points per step
+	NearestKernelAVX2    // 8 points per step
+};
+
+//! Fastest kernel this CPU and OS support, detected on first use.
+//!
+NearestKernel bestNearestKernel();
+
+const char *nearestKernelName(NearestKernel kernel);
+
+//! Index of the point closest to p, or -1 if there are no points.  Uses
+//! bestNearestKernel().
+int nearestScan(VertexSoA const &points, glm::vec3 const &p);
+
+//! Same with an explicit kernel; one the CPU does not support falls back to
+//! the scalar loop.
+int nearestScan(VertexSoA const &points, glm::vec3 const &p, NearestKernel kernel);
+
+#endif
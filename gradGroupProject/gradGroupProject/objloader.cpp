@@ -1,21 +1,44 @@
 #include <iostream>    // std::cout  
-#include <fstream>
-#include <sstream>
-#include <string>
+#include <algorithm>
 #include <cmath>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>         // std::string
 #include <cstddef>         // std::size_t
+#include <cstdio>
+#include <cstring>
+#include <queue>
 #include "objloader.h"
+#include "backgroundwriter.h"
+#include "meshcache.h"
+#include "nearestscan.h"
+#include "objparser.h"
+#include "objwriter.h"
+#include "profiler.h"
+#include "threadpool.h"
 
 
 void OBJLoader:: computeNormals(std::vector<glm::vec3> const &vertices, std::vector<int> const &indices, std::vector<glm::vec3> &normals){
+		PROFILE_SCOPE("computeNormals");
+
+		if (mLayout == VertexLayoutSoA && &vertices == &mVertices) {
+			computeNormalsSoA(indices, normals);
+			return;
+		}
 		
-	    normals.resize(vertices.size(), glm::vec3(0.0f, 0.0f, 0.0f));
+	    normals.assign(vertices.size(), glm::vec3(0.0f, 0.0f, 0.0f));
+		size_t triangleCount = indices.size() / 3;
+
+		if (mThreads > 1) {
+			computeNormalsParallel(vertices, indices, normals);
+			return;
+		}
 		
 		// Compute per-vertex normals here!
 
-		int i;
-		for (i = 0; i < indices.size(); i += 3)
+		size_t i;
+		for (i = 0; i < triangleCount * 3; i += 3)
 		{
 			glm::vec3 p1 = vertices[indices[i]];
 			glm::vec3 p2 = vertices[indices[i + 1]];
@@ -34,140 +57,450 @@ void OBJLoader:: computeNormals(std::vector<glm::vec3> const &vertices, std::vec
 			normals[i] = glm::normalize(normals[i]);
 }
 
+// Same result as the serial loop, bit for bit: face normals are computed in
+// parallel, then each vertex sums its faces in increasing triangle order.
+void OBJLoader::computeNormalsParallel(std::vector<glm::vec3> const &vertices, std::vector<int> const &indices, std::vector<glm::vec3> &normals){
+	size_t triangleCount = indices.size() / 3;
+	std::vector<glm::vec3> faceNormals(triangleCount);
+	parallelFor(mThreads, triangleCount, [&](size_t lo, size_t hi) {
+		for (size_t t = lo; t < hi; t++) {
+			glm::vec3 p1 = vertices[indices[3 * t]];
+			glm::vec3 p2 = vertices[indices[3 * t + 1]];
+			glm::vec3 p3 = vertices[indices[3 * t + 2]];
+			faceNormals[t] = glm::normalize(glm::cross((p2 - p1), (p3 - p1)));
+		}
+	});
+
+	// Vertex-to-triangle incidence by counting sort; rows come out sorted.
+	std::vector<int> start(vertices.size() + 1, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		start[indices[i] + 1]++;
+	for (size_t v = 0; v < vertices.size(); v++)
+		start[v + 1] += start[v];
+	std::vector<int> incident(triangleCount * 3);
+	std::vector<int> fill(start.begin(), start.end() - 1);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		incident[fill[indices[i]]++] = (int)(i / 3);
+
+	parallelFor(mThreads, vertices.size(), [&](size_t lo, size_t hi) {
+		for (size_t v = lo; v < hi; v++) {
+			glm::vec3 sum(0.0f, 0.0f, 0.0f);
+			for (int k = start[v]; k < start[v + 1]; k++)
+				sum += faceNormals[incident[k]];
+			normals[v] = glm::normalize(sum);
+		}
+	});
+}
+
+// Same result as the AoS loops: face normals use glm's operand order and each
+// vertex sums its faces in increasing triangle order.
+void OBJLoader::computeNormalsSoA(std::vector<int> const &indices, std::vector<glm::vec3> &normals){
+	size_t triangleCount = indices.size() / 3;
+	size_t vertexCount = mPositionsSoA.size();
+
+	mFaceNormalsSoA.assignZero(triangleCount);
+	if (triangleCount) {
+		parallelFor(mThreads, triangleCount, [&](size_t lo, size_t hi) {
+			soaFaceNormals(mPositionsSoA, &indices[0], lo, hi, mFaceNormalsSoA);
+		});
+	}
+
+	mNormalsSoA.assignZero(vertexCount);
+	float const *fx = mFaceNormalsSoA.x(), *fy = mFaceNormalsSoA.y(), *fz = mFaceNormalsSoA.z();
+	float *nx = mNormalsSoA.x(), *ny = mNormalsSoA.y(), *nz = mNormalsSoA.z();
+	for (size_t i = 0; i < triangleCount * 3; i++) {
+		int v = indices[i];
+		size_t t = i / 3;
+		nx[v] += fx[t];
+		ny[v] += fy[t];
+		nz[v] += fz[t];
+	}
+
+	parallelFor(mThreads, vertexCount, [&](size_t lo, size_t hi) {
+		soaNormalize(mNormalsSoA, lo, hi);
+	});
+	mNormalsSoA.store(normals);
+}
+
 
 OBJLoader::OBJLoader() :
+mThreads(1),
+mLayout(VertexLayoutAoS),
+mRenderPath(RenderPathRetained),
+mHapticBudget(kDefaultHapticTriangles),
+mVisualBudget(0),
 mVertices(0),
 mNormals(0),
 mColors(0),
-vIndices(0)
+vIndices(0),
+mDrawnEpoch(0),
+mNormalsStale(true),
+mBuffersStale(true),
+mHapticStale(true)
 {
-	std::cout << "Called OBJFileReader constructor" << std::endl;
 }
 
 OBJLoader::~OBJLoader()
 {
-	std::cout << "Called OBJFileReader destructor" << std::endl;
 }
 
-bool OBJLoader::load(const char *filename)
+bool OBJLoader::load(const char *filename, int threads)
 {
-	// Open OBJ file
-	std::ifstream OBJFile(filename);
-	if (!OBJFile.is_open()) {
+	mThreads = threads > 1 ? threads : 1;
+	mNormalsStale = true;
+	mBuffersStale = true;
+	mHapticStale = true;
+
+	// A cache from a previous run, or a snapshot from saveBinary(), already
+	// holds the unitized mesh, its normals, its adjacency graph and its
+	// spatial indices.
+	if (readCache(filename) || readMeshFile(filename, 0, 0)) {
+		mJournal.clear(mVertices.size());
+		return true;
+	}
+
+	// Read the whole OBJ file in one go and parse it from memory
+	std::vector<char> buffer;
+	if (!readFile(filename, buffer)) {
 		std::cerr << "Could not open " << filename << std::endl;
 		return false;
 	}
-	
-	// Extract vertices and indices
-	std::string line;
-	glm::vec3 vertex;
-	glm::vec3 normal;
-	glm::vec2 uv;
-	double fric;
-	while (!OBJFile.eof()) {
-		std::getline(OBJFile, line);
-		if ((line.find('#') == -1) && (line.find('m') == -1)){
-			if (line.find('v') != -1) {
-
-				if ((line.find('t') == -1) && (line.find('n') == -1)){
-					std::istringstream vertexLine(line.substr(2));
-					vertexLine >> vertex.x;
-					vertexLine >> vertex.y;
-					vertexLine >> vertex.z;
-				    mVertices.push_back(vertex);
-					
-					//printf("Vertex is: %f %f %f\n", vertex.x, vertex.y, vertex.z);
-					vertex = glm::normalize(vertex);//Normalizing the vertices to get the values between 0-1
-					vertex.x = abs(vertex.x);
-					vertex.y = abs(vertex.y);
-					vertex.z = abs(vertex.z);
-					//color is assigned here
-					mColors.push_back(vertex);
-					//assign friction based on the color of the object
-					if(vertex.x > vertex.y && vertex.x > vertex.z) fric = 0.9;
-					if(vertex.y > vertex.x && vertex.y > vertex.z) fric = 0.4;
-					if(vertex.z > vertex.x && vertex.z > vertex.y) fric=0.1;
-					mFriction.push_back(fric);
-
-					
-				}
-				else if(line.find('n') != -1) {
-					std::istringstream textureLine(line.substr(3));
-					textureLine >> normal.x;
-					textureLine >> normal.y;
-					textureLine >> normal.z;
-				    mNormals.push_back(normal);
-				}
-			}
-
-			else if (line.find("f ") != -1) {
-				std::istringstream faceLine(line);
-				std::string val1;
-				faceLine >> val1;
-				int val, val2;
-				int tIndices[3];
-				char slash;
-				for (int n = 0; n < 3; n++){
-					 faceLine >> val;
-					 vIndices.push_back(val- 1);
-					 nIndices.push_back(val- 1);
-					 tIndices[n] = (val- 1);
-				}
 
-				  tris.push_back(Triangle(tIndices[0], tIndices[1], tIndices[2]));  
+	ObjData obj;
+	const char *text = buffer.empty() ? "" : &buffer[0];
+	if (!parseOBJ(text, text + buffer.size(), obj, mThreads)) {
+		std::cerr << "Invalid face index in " << filename << std::endl;
+		return false;
+	}
+	buffer.clear();
 
+	mVertices.swap(obj.positions);
+	vIndices.swap(obj.positionIndices);
+	if (mLayout == VertexLayoutSoA)
+		mPositionsSoA.assign(mVertices);
 
-			}
-	    }
+	// Colors and friction come from the direction of each vertex.  The file's
+	// own vn entries are not used; per-vertex normals are recomputed from the
+	// faces below, so normals share the vertex indices.
+	nIndices = vIndices;
+	mColors.clear();
+	mFriction.clear();
+	mColors.reserve(mVertices.size());
+	mFriction.reserve(mVertices.size());
+	double fric = 0.1;
+	for (size_t i = 0; i < mVertices.size(); i++) {
+		glm::vec3 color = glm::normalize(mVertices[i]);//Normalizing the vertices to get the values between 0-1
+		color.x = abs(color.x);
+		color.y = abs(color.y);
+		color.z = abs(color.z);
+		//color is assigned here
+		mColors.push_back(color);
+		//assign friction based on the color of the object
+		if(color.x > color.y && color.x > color.z) fric = 0.9;
+		if(color.y > color.x && color.y > color.z) fric = 0.4;
+		if(color.z > color.x && color.z > color.y) fric=0.1;
+		mFriction.push_back(fric);
 	}
 
-	// Close OBJ file
-	OBJFile.close();
+	tris.clear();
+	tris.reserve(vIndices.size() / 3);
+	for (size_t i = 0; i + 2 < vIndices.size(); i += 3)
+		tris.push_back(Triangle(vIndices[i], vIndices[i + 1], vIndices[i + 2]));
 
-	
 	// Compute normals
 	computeNormals(mVertices, vIndices, mNormals);
 
-	unitize(mVertices);
+	unitize();
+	buildSpatialIndex();
+	mJournal.clear(mVertices.size());
 	Generate(); //generate the map of vertices and connections.
+	mLod.build(mVertices, vIndices);
+
+	writeCache(filename);
 	
 	return true;
 }
 
-void OBJLoader:: unitize(std::vector<glm::vec3> &vertices) {
-	float min_x = vertices[0].x, max_x = vertices[0].x,
-	min_y = vertices[0].y, max_y = vertices[0].y,
-	min_z = vertices[0].z, max_z = vertices[0].z;
+bool OBJLoader::readCache(const char *filename)
+{
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	if (!fileStamp(filename, sourceSize, sourceTime))
+		return false;
+	return readMeshFile(meshCachePath(filename).c_str(), sourceSize, sourceTime);
+}
 
-	
+bool OBJLoader::readMeshFile(const char *path, uint64_t sourceSize, int64_t sourceTime)
+{
+	MappedFile file;
+	if (!file.open(path) || file.size() < sizeof(MeshCacheHeader))
+		return false;
+
+	MeshCacheHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+	if (!validMeshCache(header, file.size()) ||
+		header.sourceSize != sourceSize || header.sourceTime != sourceTime)
+		return false;
+
+	const char *base = file.data();
+	size_t vertexCount = header.vertexCount;
+	const glm::vec3 *positions = (const glm::vec3 *)(base + header.positionsOffset);
+	const glm::vec3 *normals = (const glm::vec3 *)(base + header.normalsOffset);
+	const glm::vec3 *colors = (const glm::vec3 *)(base + header.colorsOffset);
+	const double *friction = (const double *)(base + header.frictionOffset);
+	const int *indices = (const int *)(base + header.indicesOffset);
+	const int *adjacencyOffsets = (const int *)(base + header.adjacencyOffsetsOffset);
+	const int *adjacency = (const int *)(base + header.adjacencyOffset);
+	const uint32_t *lodLevels = (const uint32_t *)(base + header.lodLevelsOffset);
+	const int *lodIndices = (const int *)(base + header.lodIndicesOffset);
+	const int *incidenceOffsets = (const int *)(base + header.incidenceOffsetsOffset);
+	const int *incidence = (const int *)(base + header.incidenceOffset);
+	const int *gridCellStart = (const int *)(base + header.gridCellStartOffset);
+	const int *gridCellItems = (const int *)(base + header.gridCellItemsOffset);
+	const int *bvhNodes = (const int *)(base + header.bvhNodesOffset);
+	const int *bvhItemsBegin = (const int *)(base + header.bvhItemsOffset);
+
+	for (size_t i = 0; i < header.indexCount; i++)
+		if (indices[i] < 0 || (size_t)indices[i] >= vertexCount)
+			return false;
+	uint64_t lodTriangles = 0;
+	for (size_t l = 0; l < header.lodLevelCount; l++)
+		lodTriangles += lodLevels[l];
+	if (3 * lodTriangles != header.lodIndexCount)
+		return false;
+	for (size_t i = 0; i < header.lodIndexCount; i++)
+		if (lodIndices[i] < 0 || (size_t)lodIndices[i] >= vertexCount)
+			return false;
+	if (adjacencyOffsets[0] != 0 || adjacencyOffsets[vertexCount] != (int)header.adjacencyCount)
+		return false;
+	for (size_t v = 0; v < vertexCount; v++)
+		if (adjacencyOffsets[v] > adjacencyOffsets[v + 1])
+			return false;
+	int triangleCount = (int)(header.indexCount / 3);
+	if (incidenceOffsets[0] != 0 || incidenceOffsets[vertexCount] != (int)header.indexCount)
+		return false;
+	for (size_t v = 0; v < vertexCount; v++)
+		if (incidenceOffsets[v] > incidenceOffsets[v + 1])
+			return false;
+	for (size_t i = 0; i < header.indexCount; i++)
+		if (incidence[i] < 0 || incidence[i] >= triangleCount)
+			return false;
+
+	// The grid and the BVH check themselves against the positions, so
+	// nothing is taken over until they have.
+	std::vector<glm::vec3> vertices(positions, positions + vertexCount);
+	std::vector<int> triangleIndices(indices, indices + header.indexCount);
+	std::vector<int> cellStart(gridCellStart, gridCellStart + meshCacheGridCells(header) + 1);
+	std::vector<int> cellItems(gridCellItems, gridCellItems + vertexCount);
+	std::vector<int> bvhItems(bvhItemsBegin, bvhItemsBegin + triangleCount);
+	SpatialGrid grid;
+	TriangleBVH bvh;
+	if (!grid.assign(vertices, glm::vec3(header.gridOrigin[0], header.gridOrigin[1], header.gridOrigin[2]),
+			header.gridCellSize, header.gridDims, cellStart, cellItems) ||
+		!bvh.assign(vertices, triangleIndices, bvhNodes, header.bvhNodeCount, bvhItems))
+		return false;
+
+	mVertices.swap(vertices);
+	mNormals.assign(normals, normals + vertexCount);
+	mColors.assign(colors, colors + vertexCount);
+	mFriction.assign(friction, friction + vertexCount);
+	vIndices.swap(triangleIndices);
+	nIndices = vIndices;
+
+	tris.clear();
+	tris.reserve(header.indexCount / 3);
+	for (size_t i = 0; i + 2 < header.indexCount; i += 3)
+		tris.push_back(Triangle(indices[i], indices[i + 1], indices[i + 2]));
+
+	std::vector<int> offsets(adjacencyOffsets, adjacencyOffsets + vertexCount + 1);
+	std::vector<int> neighbours(adjacency, adjacency + header.adjacencyCount);
+	mAdjacency.assign(offsets, neighbours);
+
+	std::vector<std::vector<int> > levels(header.lodLevelCount);
+	for (size_t l = 0; l < header.lodLevelCount; l++) {
+		levels[l].assign(lodIndices, lodIndices + 3 * (size_t)lodLevels[l]);
+		lodIndices += 3 * (size_t)lodLevels[l];
+	}
+	mLod.assign(levels);
+
+	std::vector<int> triangleOffsets(incidenceOffsets, incidenceOffsets + vertexCount + 1);
+	std::vector<int> triangles(incidence, incidence + header.indexCount);
+	mVertexTriangles.assign(triangleOffsets, triangles);
+	if (mLayout == VertexLayoutSoA)
+		mPositionsSoA.assign(mVertices);
+	resetSnapshots(grid, bvh);
+	return true;
+}
+
+void OBJLoader::writeCache(const char *filename) const
+{
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	std::vector<char> buffer;
+	if (!fileStamp(filename, sourceSize, sourceTime) ||
+		!packMeshFile(mVertices, sourceSize, sourceTime, buffer))
+		return;
+	writeFileAtomically(meshCachePath(filename).c_str(), &buffer[0], buffer.size());
+}
 
-	for(int i = 1; i < vertices.size(); i++)
-	{
-		if(vertices[i].x < min_x)
-			min_x = vertices[i].x;
-		if(vertices[i].x > max_x)
-			max_x = vertices[i].x;
-		if(vertices[i].y < min_y)
-			min_y = vertices[i].y;
-		if(vertices[i].y > max_y)
-			max_y = vertices[i].y;
-		if(vertices[i].z < min_z)
-			min_z = vertices[i].z;
-		if(vertices[i].z > max_z)
-			max_z = vertices[i].z;
+// Assemble the whole file in memory so it goes out in a single write.
+bool OBJLoader::packMeshFile(std::vector<glm::vec3> const &positions, uint64_t sourceSize, int64_t sourceTime,
+	std::vector<char> &buffer) const
+{
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.sourceSize = sourceSize;
+	header.sourceTime = sourceTime;
+
+	size_t vertexCount = positions.size();
+	if (vertexCount == 0 || mNormals.size() != vertexCount ||
+		mColors.size() != vertexCount || mFriction.size() != vertexCount)
+		return false;
+
+	std::vector<int> const &adjacencyOffsets = mAdjacency.offsets();
+	std::vector<int> const &adjacency = mAdjacency.neighbourArray();
+	std::vector<int> const &incidenceOffsets = mVertexTriangles.offsets();
+	std::vector<int> const &incidence = mVertexTriangles.neighbourArray();
+	if (adjacencyOffsets.size() != vertexCount + 1 || incidenceOffsets.size() != vertexCount + 1)
+		return false;
+
+	// The latest snapshot's indices may have been built over other positions
+	// than these; readMeshFile() fits them to the positions it reads.
+	SnapshotRef snapshot(mSnapshots);
+	if (snapshot.empty() || snapshot->grid.cellItems().size() != vertexCount)
+		return false;
+	SpatialGrid const &grid = snapshot->grid;
+	TriangleBVH const &bvh = snapshot->bvh;
+
+	header.vertexCount = (uint32_t)vertexCount;
+	header.indexCount = (uint32_t)vIndices.size();
+	header.adjacencyCount = (uint32_t)adjacency.size();
+	header.lodLevelCount = (uint32_t)mLod.levelCount();
+	for (size_t l = 0; l < mLod.levelCount(); l++)
+		header.lodIndexCount += (uint32_t)mLod.level(l).size();
+	header.bvhNodeCount = (uint32_t)bvh.nodeCount();
+	for (int a = 0; a < 3; a++) {
+		header.gridDims[a] = grid.dims()[a];
+		header.gridOrigin[a] = grid.origin()[a];
+	}
+	header.gridCellSize = grid.cellSize();
+	layoutMeshCache(header);
+
+	buffer.assign((size_t)header.fileSize, 0);
+	char *base = &buffer[0];
+	memcpy(base, &header, sizeof(header));
+	memcpy(base + header.positionsOffset, &positions[0], vertexCount * sizeof(glm::vec3));
+	memcpy(base + header.normalsOffset, &mNormals[0], vertexCount * sizeof(glm::vec3));
+	memcpy(base + header.colorsOffset, &mColors[0], vertexCount * sizeof(glm::vec3));
+	memcpy(base + header.frictionOffset, &mFriction[0], vertexCount * sizeof(double));
+	if (!vIndices.empty())
+		memcpy(base + header.indicesOffset, &vIndices[0], vIndices.size() * sizeof(int));
+	memcpy(base + header.adjacencyOffsetsOffset, &adjacencyOffsets[0], (vertexCount + 1) * sizeof(int));
+	if (!adjacency.empty())
+		memcpy(base + header.adjacencyOffset, &adjacency[0], adjacency.size() * sizeof(int));
+	char *lodIndices = base + header.lodIndicesOffset;
+	for (size_t l = 0; l < mLod.levelCount(); l++) {
+		std::vector<int> const &level = mLod.level(l);
+		uint32_t triangles = (uint32_t)(level.size() / 3);
+		memcpy(base + header.lodLevelsOffset + l * sizeof(uint32_t), &triangles, sizeof(triangles));
+		memcpy(lodIndices, &level[0], level.size() * sizeof(int));
+		lodIndices += level.size() * sizeof(int);
+	}
+	memcpy(base + header.incidenceOffsetsOffset, &incidenceOffsets[0], (vertexCount + 1) * sizeof(int));
+	if (!incidence.empty())
+		memcpy(base + header.incidenceOffset, &incidence[0], incidence.size() * sizeof(int));
+	memcpy(base + header.gridCellStartOffset, &grid.cellStarts()[0], grid.cellStarts().size() * sizeof(int));
+	memcpy(base + header.gridCellItemsOffset, &grid.cellItems()[0], vertexCount * sizeof(int));
+	bvh.shape((int *)(base + header.bvhNodesOffset));
+	if (!bvh.items().empty())
+		memcpy(base + header.bvhItemsOffset, &bvh.items()[0], bvh.items().size() * sizeof(int));
+	return true;
+}
+
+bool OBJLoader::saveBinary(const char *path, bool async)
+{
+	PROFILE_SCOPE("saveBinary");
+	updateNormals();
+	std::shared_ptr<std::vector<char> > buffer(new std::vector<char>);
+	if (!packMeshFile(mDrawVertices, 0, 0, *buffer))
+		return false;
+	if (!async)
+		return writeFileAtomically(path, &(*buffer)[0], buffer->size());
+
+	std::string target(path);
+	BackgroundWriter::shared().post([buffer, target] {
+		return writeFileAtomically(target.c_str(), &(*buffer)[0], buffer->size());
+	});
+	return true;
+}
+
+// The async job formats on the writer's thread, and on that thread alone:
+// the shared pool runs one batch at a time, so a parallel format there could
+// hold up the caller's next parallel pass.
+bool OBJLoader::saveOBJ(const char *path, bool async)
+{
+	PROFILE_SCOPE("saveOBJ");
+	updateNormals();
+	if (mDrawVertices.empty() || mNormals.size() != mDrawVertices.size())
+		return false;
+	if (!async) {
+		std::vector<char> text;
+		formatOBJ(text, mDrawVertices, mNormals, mColors, vIndices, mThreads);
+		return writeFileAtomically(path, text.empty() ? "" : &text[0], text.size());
 	}
 
+	struct Mesh {
+		std::vector<glm::vec3> positions, normals, colors;
+		std::vector<int> indices;
+	};
+	std::shared_ptr<Mesh> mesh(new Mesh);
+	mesh->positions = mDrawVertices;
+	mesh->normals = mNormals;
+	mesh->colors = mColors;
+	mesh->indices = vIndices;
+	std::string target(path);
+	BackgroundWriter::shared().post([mesh, target] {
+		PROFILE_SCOPE("formatOBJ");
+		std::vector<char> text;
+		formatOBJ(text, mesh->positions, mesh->normals, mesh->colors, mesh->indices);
+		return writeFileAtomically(target.c_str(), text.empty() ? "" : &text[0], text.size());
+	});
+	return true;
+}
+
+void OBJLoader:: unitize(std::vector<glm::vec3> &vertices) {
+	if (vertices.empty())
+		return;
+
+	bool soa = mLayout == VertexLayoutSoA && &vertices == &mVertices;
+	if (&vertices == &mVertices)
+		mNormalsStale = mBuffersStale = mHapticStale = true;
+
+	// Bounding box, reduced over per-thread partial boxes.
+	glm::vec3 lo = vertices[0], hi = vertices[0];
+	std::mutex boundsLock;
+	parallelFor(mThreads, vertices.size(), [&](size_t begin, size_t end) {
+		glm::vec3 partLo = vertices[begin], partHi = vertices[begin];
+		if (soa) {
+			soaBounds(mPositionsSoA, begin, end, partLo, partHi);
+		} else {
+			for (size_t i = begin + 1; i < end; i++) {
+				partLo = glm::min(partLo, vertices[i]);
+				partHi = glm::max(partHi, vertices[i]);
+			}
+		}
+		std::lock_guard<std::mutex> lock(boundsLock);
+		lo = glm::min(lo, partLo);
+		hi = glm::max(hi, partHi);
+	});
+	float min_x = lo.x, max_x = hi.x,
+	min_y = lo.y, max_y = hi.y,
+	min_z = lo.z, max_z = hi.z;
+
 	float center_x = (max_x + min_x) / 2,
 	center_y = (max_y + min_y) / 2,
 	center_z = (max_z + min_z) / 2;
 
-	for(int i = 0; i < vertices.size(); i++)
-	{
-		vertices[i].x -= center_x;
-		vertices[i].y -= center_y;
-		vertices[i].z -= center_z;
-	}
-
 	float width = glm::abs(max_x - min_x),
 	height = glm::abs(max_y - min_y),
 	depth = glm::abs(max_z - min_z);
@@ -176,13 +509,77 @@ void OBJLoader:: unitize(std::vector<glm::vec3> &vertices) {
 
 	float scale = 2 / glm::max(glm::max(width, height), depth);
 
-	for(int i = 0; i < vertices.size(); i++)
-	{
-		vertices[i] *= scale;
-		//printf("%f, %f, %f\n", vertices[i].x, vertices[i].y, vertices[i].z);
+	if (soa) {
+		glm::vec3 center(center_x, center_y, center_z);
+		parallelFor(mThreads, vertices.size(), [&](size_t begin, size_t end) {
+			soaTranslateScale(mPositionsSoA, begin, end, center, scale);
+		});
+		mPositionsSoA.store(vertices);
+		return;
 	}
+
+	parallelFor(mThreads, vertices.size(), [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			vertices[i].x -= center_x;
+			vertices[i].y -= center_y;
+			vertices[i].z -= center_z;
+			vertices[i] *= scale;
+		}
+	});
 }
 
+void OBJLoader::unitize()
+{
+	unitize(mVertices);
+}
+
+void OBJLoader::setVertexLayout(VertexLayout layout)
+{
+	mLayout = layout;
+	if (mLayout == VertexLayoutSoA) {
+		mPositionsSoA.assign(mVertices);
+	} else {
+		mPositionsSoA.clear();
+		mFaceNormalsSoA.clear();
+		mNormalsSoA.clear();
+	}
+
+	// The snapshots carry their own SoA copy for the linear scan.
+	if (!vIndices.empty())
+		mSnapshots.reset(mVertices, vIndices, mLayout == VertexLayoutSoA);
+}
+
+VertexLayout OBJLoader::vertexLayout() const
+{
+	return mLayout;
+}
+
+VertexSoA const &OBJLoader::positionsSoA() const
+{
+	return mPositionsSoA;
+}
+
+void OBJLoader::setRenderPath(RenderPath path)
+{
+	mRenderPath = path;
+}
+
+RenderPath OBJLoader::renderPath() const
+{
+	return mRenderPath;
+}
+
+MeshView OBJLoader::view() const
+{
+	MeshView v;
+	v.positions = mDrawVertices;
+	v.normals = mNormals;
+	v.colors = mColors;
+	v.friction = mFriction;
+	v.indices = vIndices;
+	v.triangles = tris;
+	return v;
+}
 
 std::vector<glm::vec3> const &OBJLoader::getVertices() const
 {
@@ -219,23 +616,87 @@ std::vector<double> const &OBJLoader::getFriction() const
 
 /******************************************************************************************************************/
 void OBJLoader::drawColorObj(){
+	PROFILE_SCOPE("drawColorObj");
+	updateNormals();
+	if (mRenderPath == RenderPathImmediate) {
+		drawColorObjImmediate();
+		return;
+	}
+
+	if (mBuffersStale || !mBuffers.uploaded()) {
+		mBuffers.upload(mDrawVertices, mNormals, mColors, lodIndices(mVisualBudget));
+		mBuffersStale = false;
+	}
+	else if (!mChanged.empty()) {
+		mBuffers.update(mDrawVertices, mNormals, mColors, mChanged);
+	}
+	for (size_t i = 0; i < mChanged.size(); i++)
+		mIsChanged[mChanged[i]] = 0;
+	mChanged.clear();
+	glPushAttrib(GL_CURRENT_BIT | GL_ENABLE_BIT | GL_LIGHTING_BIT);
+	mBuffers.draw();
+	glPopAttrib();
+}
+
+void OBJLoader::drawHapticObj(){
+	syncDrawState();
+	if (mHapticStale || !mHapticList.compiled()) {
+		mHapticList.compile(mDrawVertices, lodIndices(mHapticBudget));
+		mHapticStale = false;
+	}
+	mHapticList.call();
+}
+
+void OBJLoader::setTriangleBudgets(size_t haptic, size_t visual){
+	if (haptic != mHapticBudget)
+		mHapticStale = true;
+	if (visual != mVisualBudget)
+		mBuffersStale = true;
+	mHapticBudget = haptic;
+	mVisualBudget = visual;
+}
+
+size_t OBJLoader::hapticTriangles() const{
+	return lodIndices(mHapticBudget).size() / 3;
+}
+
+size_t OBJLoader::visualTriangles() const{
+	return lodIndices(mVisualBudget).size() / 3;
+}
+
+LodHierarchy const &OBJLoader::lod() const{
+	return mLod;
+}
+
+std::vector<int> const &OBJLoader::lodIndices(size_t budget) const{
+	if (budget == 0 || vIndices.size() / 3 <= budget)
+		return vIndices;
+	int level = mLod.levelWithin(budget);
+	return level < 0 ? vIndices : mLod.level(level);
+}
+
+size_t OBJLoader::takeUploadBytes(){
+	return mBuffers.takeUploadBytes();
+}
+
+void OBJLoader::drawColorObjImmediate(){
 
 	vec3 vertex_one, vertex_two, vertex_three;
 	vec3 norm_one, norm_two, norm_three;
 	vec3 color_one, color_two, color_three;
-	computeNormals(mVertices, vIndices, mNormals);
 	glPushAttrib(GL_CURRENT_BIT | GL_ENABLE_BIT | GL_LIGHTING_BIT);
     glPushMatrix();
 	//glEnable(GL_COLOR_MATERIAL);
 	glBegin(GL_TRIANGLES);
 
-	for (int i = 0; i < tris.size(); i++){
+	std::vector<int> const &indices = lodIndices(mVisualBudget);
+	for (size_t i = 0; i + 2 < indices.size(); i += 3){
 		
-	     Triangle &tri = tris[i];
+	     Triangle tri(indices[i], indices[i + 1], indices[i + 2]);
 		 
-		 vertex_one = mVertices[tri.vert[0]];
-		 vertex_two = mVertices[tri.vert[1]];
-		 vertex_three = mVertices[tri.vert[2]];
+		 vertex_one = mDrawVertices[tri.vert[0]];
+		 vertex_two = mDrawVertices[tri.vert[1]];
+		 vertex_three = mDrawVertices[tri.vert[2]];
 
 		 norm_one = mNormals[tri.vert[0]];
 		 norm_two = mNormals[tri.vert[1]];
@@ -271,35 +732,377 @@ void OBJLoader::drawColorObj(){
 }
 
 void OBJLoader::Generate(){
-	for(int i = 0; i<tris.size(); i++){
-		Triangle &tri = tris[i];
-		Link(tri.vert[0], tri.vert[1]);
-		Link(tri.vert[1], tri.vert[2]);
-		Link(tri.vert[2], tri.vert[0]);
-	}
+	mAdjacency.buildOneRing(vIndices, mVertices.size(), mThreads);
 }
 
-void OBJLoader::Link(int a, int b){
-	
-	(net)[a].insert(b);
+CSRGraph const &OBJLoader::adjacency() const
+{
+	return mAdjacency;
 }
 
-void OBJLoader::deformSurface(int nearestVertex, vec3 newProxyPosition, set<int>nearestNeighbour){
+ConstSpan<int> OBJLoader::neighbours(int v) const
+{
+	return mAdjacency.neighbours(v);
+}
+
+void OBJLoader::deformSurface(int nearestVertex, vec3 newProxyPosition, set<int> const &nearestNeighbour){
+	PROFILE_SCOPE("deformSurface");
 	vec3 myNormal; 
 
 	myNormal.x=newProxyPosition.x-mVertices[nearestVertex].x;
 	myNormal.y=newProxyPosition.y-mVertices[nearestVertex].y;
 	myNormal.z=newProxyPosition.z-mVertices[nearestVertex].z;
 
+	mJournal.moving(nearestVertex, mVertices[nearestVertex]);
 	mVertices[nearestVertex].x+=myNormal.x;
 	mVertices[nearestVertex].y+=myNormal.y;
 	mVertices[nearestVertex].z+=myNormal.z;
+	vertexMoved(nearestVertex);
 
-	for(set<int>::iterator cur_b= nearestNeighbour.begin(); cur_b!= nearestNeighbour.end(); cur_b++){
+	for(set<int>::const_iterator cur_b= nearestNeighbour.begin(); cur_b!= nearestNeighbour.end(); cur_b++){
+		mJournal.moving(*cur_b, mVertices[*cur_b]);
 		mVertices[*cur_b].x += myNormal.x/2;
 		mVertices[*cur_b].y += myNormal.y/2;
 		mVertices[*cur_b].z += myNormal.z/2;
+		vertexMoved(*cur_b);
+	}
+
+	mSnapshots.publish(mVertices, vIndices, mVertexTriangles);
+}
+
+float OBJLoader::SmoothBell(float x){
+	if (x >= 1.0f)
+		return 0.0f;
+	float t = 1.0f - x * x;
+	return t * t;
+}
+
+// Dijkstra from the anchor, settling vertices in order of distance and never
+// following an edge past the radius or the ring limit.  Geodesic distance is
+// the shortest path along edges; Euclidean distance is straight to the anchor,
+// so the walk only decides which vertices are connected to it inside the
+// radius and a nearby but separate part of the mesh is left alone.
+void OBJLoader::brushRegion(int anchor, Brush const &brush, BrushRegion &region){
+	PROFILE_SCOPE("brushRegion");
+	region.vertices.clear();
+	region.weights.clear();
+	region.vertices.push_back(anchor);
+	region.weights.push_back(1.0f);
+
+	if (brush.radius <= 0.0f) {
+		ConstSpan<int> ring = mAdjacency.neighbours(anchor);
+		for (size_t i = 0; i < ring.size(); i++) {
+			region.vertices.push_back(ring[i]);
+			region.weights.push_back(0.5f);
+		}
+		return;
+	}
+
+	if (mBrushDistance.size() != mVertices.size()) {
+		mBrushDistance.assign(mVertices.size(), -1.0f);
+		mBrushHops.assign(mVertices.size(), 0);
+		mBrushSettled.assign(mVertices.size(), 0);
+	}
+
+	typedef std::pair<float, int> Entry;
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > open;
+	std::vector<int> reached(1, anchor);
+	mBrushDistance[anchor] = 0.0f;
+	mBrushHops[anchor] = 0;
+	open.push(Entry(0.0f, anchor));
+	while (!open.empty()) {
+		int v = open.top().second;
+		open.pop();
+		if (mBrushSettled[v])
+			continue;
+		mBrushSettled[v] = 1;
+		if (v != anchor) {
+			region.vertices.push_back(v);
+			region.weights.push_back(SmoothBell(mBrushDistance[v] / brush.radius));
+		}
+		if (brush.rings > 0 && mBrushHops[v] >= brush.rings)
+			continue;
+
+		ConstSpan<int> ring = mAdjacency.neighbours(v);
+		for (size_t i = 0; i < ring.size(); i++) {
+			int u = ring[i];
+			if (mBrushSettled[u])
+				continue;
+			float distance = brush.metric == BrushGeodesic ?
+				mBrushDistance[v] + glm::length(mVertices[u] - mVertices[v]) :
+				glm::length(mVertices[u] - mVertices[anchor]);
+			if (distance >= brush.radius)
+				continue;
+			if (mBrushDistance[u] < 0.0f)
+				reached.push_back(u);
+			else if (distance >= mBrushDistance[u])
+				continue;
+			mBrushDistance[u] = distance;
+			mBrushHops[u] = mBrushHops[v] + 1;
+			open.push(Entry(distance, u));
+		}
+	}
+
+	for (size_t i = 0; i < reached.size(); i++) {
+		mBrushDistance[reached[i]] = -1.0f;
+		mBrushSettled[reached[i]] = 0;
+	}
+}
+
+void OBJLoader::deformRegion(vec3 target, BrushRegion const &region){
+	PROFILE_SCOPE("deformRegion");
+	vec3 delta = target - mVertices[region.vertices[0]];
+	for (size_t i = 0; i < region.vertices.size(); i++) {
+		int v = region.vertices[i];
+		mJournal.moving(v, mVertices[v]);
+		mVertices[v] += delta * region.weights[i];
+		vertexMoved(v);
+	}
+	mSnapshots.publish(mVertices, vIndices, mVertexTriangles);
+}
+
+void OBJLoader::moveVertices(std::vector<int> const &vertices, std::vector<glm::vec3> const &positions){
+	PROFILE_SCOPE("moveVertices");
+	for (size_t i = 0; i < vertices.size(); i++) {
+		mJournal.moving(vertices[i], mVertices[vertices[i]]);
+		mVertices[vertices[i]] = positions[i];
+		vertexMoved(vertices[i]);
+	}
+	mSnapshots.publish(mVertices, vIndices, mVertexTriangles);
+}
+
+void OBJLoader::commitEdit(){
+	mJournal.close();
+}
+
+bool OBJLoader::undoEdit(){
+	return applyJournal(false);
+}
+
+bool OBJLoader::redoEdit(){
+	return applyJournal(true);
+}
+
+bool OBJLoader::applyJournal(bool redo){
+	PROFILE_SCOPE("applyJournal");
+	mJournalChanged.clear();
+	if (!(redo ? mJournal.redo(mVertices, mJournalChanged) : mJournal.undo(mVertices, mJournalChanged)))
+		return false;
+	for (size_t i = 0; i < mJournalChanged.size(); i++)
+		vertexMoved(mJournalChanged[i]);
+	mSnapshots.publish(mVertices, vIndices, mVertexTriangles);
+	return true;
+}
+
+EditJournal const &OBJLoader::journal() const
+{
+	return mJournal;
+}
+
+void OBJLoader::Step(int n, int vertice, vec3 direction, float radius){
+	Brush brush = { radius, n, BrushGeodesic, BrushFalloff };
+	BrushRegion region;
+	brushRegion(vertice, brush, region);
+	deformRegion(mVertices[vertice] + direction, region);
+}
+
+void OBJLoader::vertexMoved(int v){
+	if (mLayout == VertexLayoutSoA)
+		mPositionsSoA.set(v, mVertices[v]);
+	mSnapshots.moved(v);
+}
+
+// Comparing every position costs a pass over the vertices, but only in a
+// frame after an edit, and it needs nothing from the editor but the snapshot.
+void OBJLoader::syncDrawState(){
+	SnapshotRef snapshot(mSnapshots);
+	if (snapshot.empty() || snapshot->epoch == mDrawnEpoch)
+		return;
+
+	std::vector<glm::vec3> const &positions = snapshot->positions;
+	if (mDrawVertices.size() != positions.size()) {
+		mDrawVertices = positions;
+		mNormalsStale = mBuffersStale = true;
+	}
+	else if (snapshot->movedSince <= mDrawnEpoch) {
+		// Only the vertices the snapshot lists can differ from our copy.
+		std::vector<int> const &moved = snapshot->moved;
+		for (size_t i = 0; i < moved.size(); i++)
+			syncDrawVertex(moved[i], positions[moved[i]]);
 	}
+	else {
+		// After a reset() the list does not reach back to our copy.
+		for (size_t v = 0; v < positions.size(); v++)
+			syncDrawVertex((int)v, positions[v]);
+	}
+	mDrawnEpoch = snapshot->epoch;
+	mSnapshots.caughtUp(mDrawnEpoch);
+	mHapticStale = true;
+}
+
+void OBJLoader::syncDrawVertex(int v, glm::vec3 const &position){
+	if (mDrawVertices[v] == position)
+		return;
+	mDrawVertices[v] = position;
+	// mDirty was reserved for every vertex, so this never reallocates.
+	if (!mNormalsStale && !mIsDirty[v]) {
+		mIsDirty[v] = 1;
+		mDirty.push_back(v);
+	}
+}
 
+glm::vec3 OBJLoader::vertexNormal(int v) const{
+	glm::vec3 sum(0.0f, 0.0f, 0.0f);
+	ConstSpan<int> incident = mVertexTriangles.neighbours(v);
+	for (size_t i = 0; i < incident.size(); i++) {
+		int const *corner = &vIndices[3 * incident[i]];
+		glm::vec3 p1 = mDrawVertices[corner[0]];
+		glm::vec3 p2 = mDrawVertices[corner[1]];
+		glm::vec3 p3 = mDrawVertices[corner[2]];
+		sum += glm::normalize(glm::cross((p2 - p1), (p3 - p1)));
+	}
+	return glm::normalize(sum);
 }
-/******************************************************************************************************************/
\ No newline at end of file
+
+void OBJLoader::updateNormals(){
+	PROFILE_SCOPE("updateNormals");
+	syncDrawState();
+	if (mNormalsStale) {
+		computeNormals(mDrawVertices, vIndices, mNormals);
+		mIsDirty.assign(mDrawVertices.size(), 0);
+		mIsTouched.assign(mDrawVertices.size(), 0);
+		mIsChanged.assign(mDrawVertices.size(), 0);
+		mDirty.clear();
+		mDirty.reserve(mDrawVertices.size());
+		mChanged.clear();
+		mNormalsStale = false;
+		return;
+	}
+
+	// A moved vertex changes the face normal of every triangle around it, and
+	// so the normal of every corner of those triangles.  The moved vertex is
+	// marked touched even without triangles so its position gets uploaded.
+	mTouched.clear();
+	for (size_t i = 0; i < mDirty.size(); i++) {
+		if (!mIsTouched[mDirty[i]]) {
+			mIsTouched[mDirty[i]] = 1;
+			mTouched.push_back(mDirty[i]);
+		}
+		ConstSpan<int> incident = mVertexTriangles.neighbours(mDirty[i]);
+		for (size_t t = 0; t < incident.size(); t++)
+			for (int k = 0; k < 3; k++) {
+				int u = vIndices[3 * incident[t] + k];
+				if (!mIsTouched[u]) {
+					mIsTouched[u] = 1;
+					mTouched.push_back(u);
+				}
+			}
+		mIsDirty[mDirty[i]] = 0;
+	}
+	mDirty.clear();
+
+	for (size_t i = 0; i < mTouched.size(); i++) {
+		int u = mTouched[i];
+		mNormals[u] = vertexNormal(u);
+		mIsTouched[u] = 0;
+		if (!mIsChanged[u]) {
+			mIsChanged[u] = 1;
+			mChanged.push_back(u);
+		}
+	}
+}
+
+void OBJLoader::buildSpatialIndex(){
+	mVertexTriangles.buildIncidence(vIndices, mVertices.size());
+	SpatialGrid grid;
+	TriangleBVH bvh;
+	grid.build(mVertices);
+	bvh.build(mVertices, vIndices);
+	resetSnapshots(grid, bvh);
+}
+
+void OBJLoader::resetSnapshots(SpatialGrid const &grid, TriangleBVH const &bvh){
+	mSnapshots.reset(mVertices, grid, bvh, mLayout == VertexLayoutSoA);
+
+	// The graphics copy starts from the same positions and needs a full pass.
+	SnapshotRef snapshot(mSnapshots);
+	mDrawVertices = mVertices;
+	mDrawnEpoch = snapshot->epoch;
+	mNormalsStale = mBuffersStale = mHapticStale = true;
+}
+
+int OBJLoader::nearestVertex(glm::vec3 const &p) const{
+	PROFILE_SCOPE("nearestVertex");
+	SnapshotRef snapshot(mSnapshots);
+	if (snapshot.empty())
+		return -1;
+	if (mLayout == VertexLayoutSoA && snapshot->positions.size() <= kLinearNearestLimit)
+		return nearestScan(snapshot->positionsSoA, p);
+	return snapshot->grid.nearest(snapshot->positions, p);
+}
+
+void OBJLoader::nearestVertices(glm::vec3 const &p, int k, std::vector<int> &out) const{
+	SnapshotRef snapshot(mSnapshots);
+	out.clear();
+	if (!snapshot.empty())
+		snapshot->grid.kNearest(snapshot->positions, p, k, out);
+}
+
+void OBJLoader::verticesInRadius(glm::vec3 const &p, float radius, std::vector<int> &out) const{
+	SnapshotRef snapshot(mSnapshots);
+	out.clear();
+	if (!snapshot.empty())
+		snapshot->grid.withinRadius(snapshot->positions, p, radius, out);
+}
+
+int OBJLoader::nearestVertexLinear(glm::vec3 const &p) const{
+	SnapshotRef snapshot(mSnapshots);
+	if (snapshot.empty())
+		return -1;
+	if (mLayout == VertexLayoutSoA)
+		return nearestScan(snapshot->positionsSoA, p);
+
+	std::vector<glm::vec3> const &positions = snapshot->positions;
+	int best = positions.empty() ? -1 : 0;
+	float bestDist = HUGE_VALF;
+	for (size_t i = 0; i < positions.size(); i++) {
+		glm::vec3 d = positions[i] - p;
+		float dist = glm::dot(d, d);
+		if (dist < bestDist) {
+			bestDist = dist;
+			best = (int)i;
+		}
+	}
+	return best;
+}
+
+bool OBJLoader::closestPoint(glm::vec3 const &p, SurfacePoint &out) const{
+	PROFILE_SCOPE("closestPoint");
+	SnapshotRef snapshot(mSnapshots);
+	if (snapshot.empty()) {
+		out.triangle = -1;
+		return false;
+	}
+	return snapshot->bvh.closestPoint(snapshot->positions, vIndices, p, out);
+}
+
+double OBJLoader::frictionAt(SurfacePoint const &point) const{
+	int const *corner = &vIndices[3 * point.triangle];
+	return point.barycentric.x * mFriction[corner[0]] +
+		point.barycentric.y * mFriction[corner[1]] +
+		point.barycentric.z * mFriction[corner[2]];
+}
+
+glm::vec3 OBJLoader::colorAt(SurfacePoint const &point) const{
+	int const *corner = &vIndices[3 * point.triangle];
+	return point.barycentric.x * mColors[corner[0]] +
+		point.barycentric.y * mColors[corner[1]] +
+		point.barycentric.z * mColors[corner[2]];
+}
+
+int OBJLoader::nearestCorner(SurfacePoint const &point) const{
+	glm::vec3 const &w = point.barycentric;
+	int k = w.x >= w.y && w.x >= w.z ? 0 : (w.y >= w.z ? 1 : 2);
+	return vIndices[3 * point.triangle + k];
+}
+/******************************************************************************************************************/
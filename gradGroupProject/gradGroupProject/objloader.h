@@ -6,10 +6,18 @@
 #include <GLUT/glut.h>
 #endif
 
-#include <map>
 #include <set>
 #include <vector>
+#include <stdint.h>
 #include <glm/glm.hpp>
+#include "brush.h"
+#include "csrgraph.h"
+#include "editjournal.h"
+#include "lodhierarchy.h"
+#include "meshbuffers.h"
+#include "meshsnapshot.h"
+#include "span.h"
+#include "vertexsoa.h"
 using namespace glm;
 using namespace std;
 
@@ -20,12 +28,57 @@ struct Triangle{
     }
 
     int vert[3];          // indices of vertices compose triangle
-    vec3 normal;  // triangle normal
-	vec3 center;
-	int id;
 };
 
+//! Zero-copy, read-only view of the mesh arrays held by an OBJLoader.
+//!
+//! Per-vertex arrays share indices with each other; indices holds three vertex
+//! indices per triangle, in the same order as triangles.
+struct MeshView {
+	ConstSpan<glm::vec3> positions;
+	ConstSpan<glm::vec3> normals;
+	ConstSpan<glm::vec3> colors;
+	ConstSpan<double> friction;
+	ConstSpan<int> indices;
+	ConstSpan<Triangle> triangles;
+};
+
+//! Memory layout the geometry kernels run on.  The vec3 arrays are always
+//! kept; VertexLayoutSoA additionally keeps the positions as aligned x[], y[]
+//! and z[] blocks that the normal, unitize, deformation and linear
+//! nearest-vertex loops work on.
+enum VertexLayout {
+	VertexLayoutAoS,
+	VertexLayoutSoA
+};
+
+//! How drawColorObj() sends the mesh to GL.  Retained keeps the mesh in
+//! vertex and index buffers and draws it with one glDrawElements; immediate
+//! is the original glBegin/glVertex path.
+enum RenderPath {
+	RenderPathImmediate,
+	RenderPathRetained
+};
 
+//! Below this many vertices a SIMD linear scan beats the spatial index.
+//!
+const size_t kLinearNearestLimit = 2048;
+
+//! Default triangle budget for the haptic shape; see setTriangleBudgets().
+//!
+const size_t kDefaultHapticTriangles = 20000;
+
+//! A mesh loaded from an .obj file, with the spatial queries, editing and
+//! drawing built on it.
+//!
+//! Threads: after load() one thread edits the mesh (deformSurface()), one
+//! graphics thread draws it (updateNormals(), drawColorObj(),
+//! drawHapticObj(), view()), and any thread may query it (nearestVertex() and
+//! the other spatial queries, closestPoint() and the attribute lookups).
+//! The editor publishes each finished edit as a MeshSnapshot; queries and
+//! draws read the latest one, so nobody waits and nobody sees a half-applied
+//! edit.  load(), setVertexLayout(), unitize() and buildSpatialIndex() must
+//! not overlap with any other call.
 class OBJLoader {
 	public:
 		//! Constructor
@@ -36,8 +89,47 @@ class OBJLoader {
 		//!
 		~OBJLoader();
 
-		bool load(const char *filename);
+		//! Loads an .obj file (or its binary cache).  With threads > 1 the
+		//! file is parsed in parallel chunks and computeNormals(), unitize()
+		//! and Generate() run as parallel passes; the result is the same.
+		bool load(const char *filename, int threads = 1);
+
+		//! Graphics thread: writes the mesh as of the last published edit,
+		//! with its normals, colours, friction, triangles and adjacency, as a
+		//! binary snapshot that load() reads back as it is.  The file is
+		//! assembled in memory and written in one call; with async the write
+		//! is left to BackgroundWriter::shared() and only the copy is done
+		//! here.  Returns false if the mesh is empty or the write fails; a
+		//! failed async write only shows in BackgroundWriter::failures().
+		bool saveBinary(const char *path, bool async = false);
+
+		//! Graphics thread: writes the same as an OBJ file, formatted by
+		//! formatOBJ().  Friction has no place in OBJ; load() derives it from
+		//! the colours anyway.  With async the formatting moves to the
+		//! background as well, on one thread.
+		bool saveOBJ(const char *path, bool async = false);
 
+		//! Read-only access to the mesh without copying it.  The view stays
+		//! valid until the loader is reloaded or destroyed.  Positions and
+		//! normals are the graphics thread's copy, as of its last draw.
+		MeshView view() const;
+
+		//! Switches the kernel layout.  Can be called before or after load().
+		//!
+		void setVertexLayout(VertexLayout layout);
+		VertexLayout vertexLayout() const;
+
+		//! Positions in structure-of-arrays form; empty unless the layout is
+		//! VertexLayoutSoA.
+		VertexSoA const &positionsSoA() const;
+
+		//! Selects how drawColorObj() draws; retained by default.
+		//!
+		void setRenderPath(RenderPath path);
+		RenderPath renderPath() const;
+
+		//! The editor's copy of the positions, ahead of what readers see
+		//! until the next publish.  Only for the editing thread.
 		std::vector<glm::vec3> const &getVertices() const;
 		std::vector<glm::vec3> const &getNormals() const;
 		std::vector<glm::vec3> const &getColors() const;
@@ -45,21 +137,192 @@ class OBJLoader {
 		std::vector<int> const &getVertexIndices() const;
 		std::vector<int> const &getNormalIndices() const;
 		std::vector<Triangle> const &getTriangles() const;
-		std::map<int, set<int>> net;
-		void OBJLoader::Step(int n, int vertice, vec3 direction, float radius);
-		float SmoothBell(float x);
+
+		//! One-ring adjacency built by Generate().
+		//!
+		CSRGraph const &adjacency() const;
+
+		//! Vertices sharing an edge with v, sorted ascending.
+		//!
+		ConstSpan<int> neighbours(int v) const;
+
+		//! Moves the vertices within radius of vertice, and at most n edges
+		//! away (any number if n is 0), by direction scaled by the falloff:
+		//! vertice by all of it, the edge of the brush by none.  Geodesic
+		//! distance; publishes the result.
+		void Step(int n, int vertice, vec3 direction, float radius);
+
+		//! The brush falloff, (1 - x^2)^2: 1 at x = 0 down to 0 at x = 1 and
+		//! beyond, flat at both ends so the edit leaves no crease.
+		static float SmoothBell(float x);
+
+		//! Editing thread: finds the vertices brush reaches from anchor and
+		//! their weights.  The search spreads outward from the anchor over
+		//! the adjacency and stops at the radius, so it costs in proportion to
+		//! the region, not the mesh.
+		void brushRegion(int anchor, Brush const &brush, BrushRegion &region);
+
+		//! Moves region's anchor onto target and every other vertex of it by
+		//! its weight times as far, then publishes the result.
+		void deformRegion(vec3 target, BrushRegion const &region);
+
+		//! Editing thread: puts each of vertices at the matching entry of
+		//! positions, then publishes the result.
+		void moveVertices(std::vector<int> const &vertices, std::vector<glm::vec3> const &positions);
+
+		//! Editing thread: ends the journal's current edit session, so the
+		//! next move starts another.  Every edit above is journalled.
+		void commitEdit();
+
+		//! Editing thread: puts back the vertices of the last edit session,
+		//! or moves those of the last one undone forward again, and publishes
+		//! the result.  Returns false if there is nothing to undo or redo.
+		bool undoEdit();
+		bool redoEdit();
+
+		EditJournal const &journal() const;
 		void computeNormals(std::vector<glm::vec3> const &vertices,
 			std::vector<int> const &indices,
 			std::vector<glm::vec3> &normals);
 		
+		//! Brings the normals up to date with the vertex positions.  Only the
+		//! triangles around vertices moved since the last call are revisited,
+		//! and nothing is done if none moved; the result is the same as a
+		//! full computeNormals().  drawColorObj() calls this.
+		void updateNormals();
+
+		//! Draws the mesh with per-vertex normals and colours through the
+		//! selected render path, within the visual triangle budget.  After an
+		//! edit the retained path re-sends only the vertices whose position or
+		//! normal changed.
 		void drawColorObj();
+
+		//! Draws just the triangle geometry, for a feedback-buffer haptic
+		//! shape, within the haptic triangle budget.  The triangles are kept in
+		//! a display list that is only rebuilt after the mesh has moved, and
+		//! normals are not touched.
+		void drawHapticObj();
+
+		//! Most triangles drawHapticObj() and drawColorObj() draw; 0 for the
+		//! whole mesh.  Each draws the finest level of lod() within its
+		//! budget, over the same vertices as the full mesh, so edits show at
+		//! every level.  The haptic budget keeps the cost of the feedback
+		//! buffer shape, which the haptic frame renders, bounded however
+		//! dense the mesh.  Graphics thread; can be set before or after load().
+		void setTriangleBudgets(size_t haptic, size_t visual);
+		size_t hapticTriangles() const;
+		size_t visualTriangles() const;
+
+		//! Coarser levels of the mesh, built by load() and kept in its cache.
+		//!
+		LodHierarchy const &lod() const;
+
+		//! Bytes sent to the vertex and index buffers since the last call.
+		//!
+		size_t takeUploadBytes();
 		
 		void unitize(std::vector<glm::vec3> &vertices);
+
+		//! Unitizes the mesh's own positions, on the SoA blocks with that
+		//! layout.  buildSpatialIndex() must follow.
+		void unitize();
 		void Generate();
-		void Link(int a, int b);
-		void deformSurface(int nearestVertex, vec3 newProxyPosition, set<int>nearestNeighbour);
+
+		//! Moves nearestVertex onto newProxyPosition and each vertex of
+		//! nearestNeighbour by half as far, then publishes the result.
+		void deformSurface(int nearestVertex, vec3 newProxyPosition, set<int> const &nearestNeighbour);
+
+		//! Rebuilds the snapshots, with their vertex grid and triangle BVH,
+		//! from the editor's positions.  load() does this after unitize().
+		void buildSpatialIndex();
+
+		//! Index of the vertex closest to p, or -1 if the mesh is empty.  With
+		//! the SoA layout, meshes of up to kLinearNearestLimit vertices are
+		//! scanned linearly with the SIMD kernel instead of using the index.
+		int nearestVertex(glm::vec3 const &p) const;
+
+		//! The k vertices closest to p, nearest first.
+		//!
+		void nearestVertices(glm::vec3 const &p, int k, std::vector<int> &out) const;
+
+		//! Every vertex within radius of p, in no particular order.
+		//!
+		void verticesInRadius(glm::vec3 const &p, float radius, std::vector<int> &out) const;
+
+		//! Same as nearestVertex() but by a linear scan over every vertex,
+		//! without the spatial index.  The SoA layout scans with the widest
+		//! SIMD kernel the CPU supports.
+		int nearestVertexLinear(glm::vec3 const &p) const;
+
+		//! Closest point to p on the mesh surface, found through the triangle
+		//! BVH.  Returns false if the mesh has no triangles.
+		bool closestPoint(glm::vec3 const &p, SurfacePoint &out) const;
+
+		//! Per-vertex attributes interpolated across the triangle of a
+		//! closestPoint() result.
+		double frictionAt(SurfacePoint const &point) const;
+		glm::vec3 colorAt(SurfacePoint const &point) const;
+
+		//! Corner of the point's triangle with the largest weight, i.e. the
+		//! vertex the point lies closest to along the surface.
+		int nearestCorner(SurfacePoint const &point) const;
 		
 	private:
+		//! Keeps the SoA copy in step after mVertices[v] has moved and queues
+		//! v for the next snapshot.
+		void vertexMoved(int v);
+
+		bool applyJournal(bool redo);
+
+		//! The full mesh's indices or those of the level lodWithin budget.
+		//!
+		std::vector<int> const &lodIndices(size_t budget) const;
+
+		//! Graphics thread: pulls the latest snapshot's positions into
+		//! mDrawVertices, queueing the vertices that moved for updateNormals().
+		//! Only the vertices the snapshot lists as moved are looked at.
+		void syncDrawState();
+		void syncDrawVertex(int v, glm::vec3 const &position);
+
+		void drawColorObjImmediate();
+
+		//! Normal of vertex v summed from its incident triangles, in
+		//! increasing triangle order like computeNormals().
+		glm::vec3 vertexNormal(int v) const;
+
+		void computeNormalsParallel(std::vector<glm::vec3> const &vertices,
+			std::vector<int> const &indices,
+			std::vector<glm::vec3> &normals);
+		void computeNormalsSoA(std::vector<int> const &indices,
+			std::vector<glm::vec3> &normals);
+
+		//! Loads the binary cache for filename if it exists and is up to date.
+		//!
+		bool readCache(const char *filename);
+
+		//! Loads a file in the cache format whose header carries the given
+		//! source stamp; 0 and 0 for a saveBinary() snapshot.  The spatial
+		//! indices come from the file too, ready for queries.
+		bool readMeshFile(const char *path, uint64_t sourceSize, int64_t sourceTime);
+
+		//! Fills the snapshots from the editor's positions with the given
+		//! indices, and starts the graphics copy over.
+		void resetSnapshots(SpatialGrid const &grid, TriangleBVH const &bvh);
+
+		//! Lays out positions and the rest of the mesh in the cache format.
+		//! Returns false if the arrays do not match.
+		bool packMeshFile(std::vector<glm::vec3> const &positions, uint64_t sourceSize, int64_t sourceTime,
+			std::vector<char> &buffer) const;
+
+		//! Writes the binary cache for filename.  Failure only costs the next
+		//! start-up a full parse, so it is not reported.
+		void writeCache(const char *filename) const;
+
+		int mThreads;
+		VertexLayout mLayout;
+		RenderPath mRenderPath;
+		size_t mHapticBudget;
+		size_t mVisualBudget;
 		std::vector<glm::vec3> mVertices;
 		std::vector<glm::vec3> mNormals;
 		std::vector<glm::vec3> mColors;
@@ -67,6 +330,45 @@ class OBJLoader {
 		std::vector<int> vIndices;
 		std::vector<int> nIndices;
 		std::vector<Triangle> tris;
+		MeshSnapshots mSnapshots;
+		CSRGraph mAdjacency;
+		CSRGraph mVertexTriangles;    // triangles incident to each vertex
+		VertexSoA mPositionsSoA;
+		VertexSoA mFaceNormalsSoA;    // scratch for computeNormalsSoA()
+		VertexSoA mNormalsSoA;
+
+		// Scratch for brushRegion(), one entry per vertex.  Only the editing
+		// thread uses it, and it is back to unset after every call.
+		std::vector<float> mBrushDistance;    // < 0: not reached
+		std::vector<int> mBrushHops;
+		std::vector<char> mBrushSettled;
+
+		LodHierarchy mLod;
+
+		// Edits since load(), for undo; editing thread.
+		EditJournal mJournal;
+		std::vector<int> mJournalChanged;     // scratch for applyJournal()
+
+		// Everything below belongs to the graphics thread.  mDrawVertices is
+		// its copy of the positions, as of snapshot mDrawnEpoch.
+		std::vector<glm::vec3> mDrawVertices;
+		unsigned int mDrawnEpoch;
+
+		// Normals need a full recompute (after load() or unitize()); otherwise
+		// only the vertices on mDirty have moved since the last update.
+		bool mNormalsStale;
+		std::vector<char> mIsDirty;
+		std::vector<int> mDirty;
+		std::vector<char> mIsTouched;   // scratch for updateNormals()
+		std::vector<int> mTouched;
+
+		MeshBuffers mBuffers;
+		bool mBuffersStale;             // needs a full upload
+		std::vector<char> mIsChanged;
+		std::vector<int> mChanged;      // vertices to re-send at the next draw
+
+		ShapeList mHapticList;
+		bool mHapticStale;
 		
 	};
 
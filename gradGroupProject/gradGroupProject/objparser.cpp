@@ -0,0 +1,406 @@
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <stdint.h>
+#include "objparser.h"
+#include "threadpool.h"
+
+namespace {
+
+	// Exact powers of ten representable in a double.
+	const double kPow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	const uint64_t kMaxExactMantissa = (uint64_t)1 << 53;
+	const size_t kMinChunkBytes = 1 << 16;   // below this a chunk is not worth a thread
+
+	inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+	inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+	inline const char *skipBlanks(const char *p, const char *end)
+	{
+		while (p != end && isBlank(*p))
+			p++;
+		return p;
+	}
+
+	inline const char *nextLine(const char *p, const char *end)
+	{
+		const char *eol = (const char *)memchr(p, '\n', end - p);
+		return eol ? eol + 1 : end;
+	}
+
+	// Slow but exact path for numbers the fast path cannot represent.
+	const char *parseFloatFallback(const char *p, const char *end, float &value)
+	{
+		char buf[64];
+		size_t len = end - p < (ptrdiff_t)sizeof(buf) - 1 ? end - p : sizeof(buf) - 1;
+		memcpy(buf, p, len);
+		buf[len] = '\0';
+		char *stop;
+		double d = strtod(buf, &stop);
+		if (stop == buf)
+			return p;
+		value = (float)d;
+		return p + (stop - buf);
+	}
+
+	const int kBadIndex = INT_MIN;
+
+	// Index arrays of a chunk hold absolute zero-based indices, except for
+	// entries that came from negative (relative) OBJ indices.  Those are
+	// relative to the first element of the chunk and are listed here so the
+	// merge can add the chunk's base offset.
+	struct Fixups {
+		std::vector<size_t> positions;
+		std::vector<size_t> texcoords;
+		std::vector<size_t> normals;
+	};
+
+	// Converts a one-based or negative OBJ index.  Relative indices are
+	// resolved against the count elements seen so far in this chunk.
+	inline int chunkIndex(int index, size_t count, bool &relative)
+	{
+		relative = index < 0;
+		if (index > 0)
+			return index - 1;
+		if (index < 0)
+			return (int)count + index;
+		return kBadIndex;
+	}
+
+	struct Corner {
+		int v, vt, vn;
+		bool relV, relVt, relVn;
+	};
+
+	// Counts v/vn/vt/f statements and face corners so the output can be
+	// reserved in one go.
+	void reserveFor(const char *p, const char *end, ObjData &out)
+	{
+		size_t positions = 0, normals = 0, texcoords = 0, triangles = 0;
+		while (p != end) {
+			p = skipBlanks(p, end);
+			if (end - p >= 2 && p[0] == 'v') {
+				if (isBlank(p[1])) positions++;
+				else if (p[1] == 'n') normals++;
+				else if (p[1] == 't') texcoords++;
+			}
+			else if (end - p >= 2 && p[0] == 'f' && isBlank(p[1])) {
+				triangles++;
+			}
+			p = nextLine(p, end);
+		}
+		out.positions.reserve(out.positions.size() + positions);
+		out.normals.reserve(out.normals.size() + normals);
+		out.texcoords.reserve(out.texcoords.size() + texcoords);
+		// Most meshes are triangles; polygons just grow the arrays once.
+		out.positionIndices.reserve(out.positionIndices.size() + triangles * 3);
+		out.texcoordIndices.reserve(out.texcoordIndices.size() + triangles * 3);
+		out.normalIndices.reserve(out.normalIndices.size() + triangles * 3);
+	}
+}
+
+void ObjData::clear()
+{
+	positions.clear();
+	normals.clear();
+	texcoords.clear();
+	positionIndices.clear();
+	texcoordIndices.clear();
+	normalIndices.clear();
+}
+
+bool readFile(const char *path, std::vector<char> &out)
+{
+	out.clear();
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	bool ok = fseek(file, 0, SEEK_END) == 0;
+	long size = ok ? ftell(file) : -1;
+	ok = ok && size >= 0 && fseek(file, 0, SEEK_SET) == 0;
+	if (ok && size > 0) {
+		out.resize((size_t)size);
+		ok = fread(&out[0], 1, out.size(), file) == out.size();
+	}
+	fclose(file);
+	if (!ok)
+		out.clear();
+	return ok;
+}
+
+const char *parseInt(const char *p, const char *end, int &value)
+{
+	const char *start = p;
+	bool negative = false;
+	if (p != end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+	if (p == end || !isDigit(*p))
+		return start;
+
+	int result = 0;
+	while (p != end && isDigit(*p))
+		result = result * 10 + (*p++ - '0');
+	value = negative ? -result : result;
+	return p;
+}
+
+const char *parseFloat(const char *p, const char *end, float &value)
+{
+	const char *start = p;
+	bool negative = false;
+	if (p != end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+
+	uint64_t mantissa = 0;
+	int exponent = 0;
+	int digits = 0;       // significant digits kept in mantissa
+	bool any = false;
+
+	for (; p != end && isDigit(*p); p++) {
+		any = true;
+		if (digits < 19) {
+			mantissa = mantissa * 10 + (*p - '0');
+			if (mantissa)
+				digits++;
+		}
+		else {
+			exponent++;
+		}
+	}
+	if (p != end && *p == '.') {
+		p++;
+		for (; p != end && isDigit(*p); p++) {
+			any = true;
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				exponent--;
+				if (mantissa)
+					digits++;
+			}
+		}
+	}
+	if (!any)
+		return parseFloatFallback(start, end, value);  // inf, nan or nothing
+
+	if (p != end && (*p == 'e' || *p == 'E')) {
+		int e;
+		const char *q = parseInt(p + 1, end, e);
+		if (q != p + 1) {
+			exponent += e;
+			p = q;
+		}
+	}
+
+	if (mantissa == 0) {
+		value = negative ? -0.0f : 0.0f;
+		return p;
+	}
+	if (mantissa > kMaxExactMantissa || exponent < -22 || exponent > 22)
+		return parseFloatFallback(start, end, value);
+
+	// Both operands are exact, so a single multiply or divide rounds correctly.
+	double d = (double)mantissa;
+	d = exponent < 0 ? d / kPow10[-exponent] : d * kPow10[exponent];
+	value = (float)(negative ? -d : d);
+	return p;
+}
+
+// Parses the complete lines in [begin, end) into out without resolving
+// relative indices against anything outside the chunk.
+static void parseChunk(const char *begin, const char *end, ObjData &out, Fixups &fixups)
+{
+	reserveFor(begin, end, out);
+
+	std::vector<Corner> corners;
+	corners.reserve(16);
+
+	const char *p = begin;
+	while (p != end) {
+		p = skipBlanks(p, end);
+		if (p == end)
+			break;
+
+		if (*p == 'v' && end - p >= 2) {
+			if (isBlank(p[1])) {
+				glm::vec3 v;
+				const char *q = skipBlanks(p + 1, end);
+				q = skipBlanks(parseFloat(q, end, v.x), end);
+				q = skipBlanks(parseFloat(q, end, v.y), end);
+				parseFloat(q, end, v.z);
+				out.positions.push_back(v);
+			}
+			else if (p[1] == 'n' && end - p >= 3 && isBlank(p[2])) {
+				glm::vec3 n;
+				const char *q = skipBlanks(p + 2, end);
+				q = skipBlanks(parseFloat(q, end, n.x), end);
+				q = skipBlanks(parseFloat(q, end, n.y), end);
+				parseFloat(q, end, n.z);
+				out.normals.push_back(n);
+			}
+			else if (p[1] == 't' && end - p >= 3 && isBlank(p[2])) {
+				glm::vec2 t;
+				const char *q = skipBlanks(p + 2, end);
+				q = skipBlanks(parseFloat(q, end, t.x), end);
+				parseFloat(q, end, t.y);
+				out.texcoords.push_back(t);
+			}
+		}
+		else if (*p == 'f' && end - p >= 2 && isBlank(p[1])) {
+			corners.clear();
+			const char *q = skipBlanks(p + 1, end);
+			while (q != end && *q != '\n') {
+				Corner c;
+				int index;
+				const char *r = parseInt(q, end, index);
+				if (r == q)
+					break;
+				c.v = chunkIndex(index, out.positions.size(), c.relV);
+				c.vt = c.vn = -1;
+				c.relVt = c.relVn = false;
+				if (r != end && *r == '/') {
+					r++;
+					const char *s = parseInt(r, end, index);
+					if (s != r)
+						c.vt = chunkIndex(index, out.texcoords.size(), c.relVt);
+					r = s;
+					if (r != end && *r == '/') {
+						r++;
+						s = parseInt(r, end, index);
+						if (s != r)
+							c.vn = chunkIndex(index, out.normals.size(), c.relVn);
+						r = s;
+					}
+				}
+				corners.push_back(c);
+				q = skipBlanks(r, end);
+			}
+
+			for (size_t i = 2; i < corners.size(); i++) {
+				Corner const *fan[3] = { &corners[0], &corners[i - 1], &corners[i] };
+				for (int k = 0; k < 3; k++) {
+					if (fan[k]->relV)
+						fixups.positions.push_back(out.positionIndices.size());
+					if (fan[k]->relVt)
+						fixups.texcoords.push_back(out.texcoordIndices.size());
+					if (fan[k]->relVn)
+						fixups.normals.push_back(out.normalIndices.size());
+					out.positionIndices.push_back(fan[k]->v);
+					out.texcoordIndices.push_back(fan[k]->vt);
+					out.normalIndices.push_back(fan[k]->vn);
+				}
+			}
+		}
+		p = nextLine(p, end);
+	}
+}
+
+// Offsets relative indices by base and checks every index against count.
+// Position indices must be valid; bad texture/normal references become -1.
+static bool resolveIndices(int *indices, size_t n, std::vector<size_t> const &fixups,
+	int base, size_t count, bool required)
+{
+	for (size_t i = 0; i < fixups.size(); i++)
+		indices[fixups[i]] += base;
+	for (size_t i = 0; i < n; i++) {
+		if (indices[i] < 0 || (size_t)indices[i] >= count) {
+			if (required)
+				return false;
+			indices[i] = -1;
+		}
+	}
+	return true;
+}
+
+template <typename T>
+static void copyInto(std::vector<T> &dst, size_t offset, std::vector<T> const &src)
+{
+	if (!src.empty())
+		std::copy(src.begin(), src.end(), dst.begin() + offset);
+}
+
+bool parseOBJ(const char *begin, const char *end, ObjData &out, int threads)
+{
+	out.clear();
+	size_t size = end - begin;
+	int chunks = threads;
+	if ((size_t)chunks > size / kMinChunkBytes)
+		chunks = (int)(size / kMinChunkBytes);
+
+	if (chunks <= 1) {
+		Fixups fixups;
+		parseChunk(begin, end, out, fixups);
+		return resolveIndices(out.positionIndices.empty() ? 0 : &out.positionIndices[0],
+				out.positionIndices.size(), fixups.positions, 0, out.positions.size(), true) &&
+			resolveIndices(out.texcoordIndices.empty() ? 0 : &out.texcoordIndices[0],
+				out.texcoordIndices.size(), fixups.texcoords, 0, out.texcoords.size(), false) &&
+			resolveIndices(out.normalIndices.empty() ? 0 : &out.normalIndices[0],
+				out.normalIndices.size(), fixups.normals, 0, out.normals.size(), false);
+	}
+
+	// Cut the buffer into newline-aligned chunks and parse them independently.
+	std::vector<const char *> cuts(chunks + 1);
+	cuts[0] = begin;
+	cuts[chunks] = end;
+	for (int c = 1; c < chunks; c++) {
+		const char *guess = begin + size * c / chunks;
+		cuts[c] = guess < cuts[c - 1] ? cuts[c - 1] : nextLine(guess, end);
+	}
+
+	std::vector<ObjData> parts(chunks);
+	std::vector<Fixups> fixups(chunks);
+	parallelFor(chunks, chunks, [&](size_t lo, size_t hi) {
+		for (size_t c = lo; c < hi; c++)
+			parseChunk(cuts[c], cuts[c + 1], parts[c], fixups[c]);
+	});
+
+	// Element offsets of each chunk in the merged arrays.
+	std::vector<size_t> positionBase(chunks + 1, 0), normalBase(chunks + 1, 0),
+		texcoordBase(chunks + 1, 0), indexBase(chunks + 1, 0);
+	for (int c = 0; c < chunks; c++) {
+		positionBase[c + 1] = positionBase[c] + parts[c].positions.size();
+		normalBase[c + 1] = normalBase[c] + parts[c].normals.size();
+		texcoordBase[c + 1] = texcoordBase[c] + parts[c].texcoords.size();
+		indexBase[c + 1] = indexBase[c] + parts[c].positionIndices.size();
+	}
+	out.positions.resize(positionBase[chunks]);
+	out.normals.resize(normalBase[chunks]);
+	out.texcoords.resize(texcoordBase[chunks]);
+	out.positionIndices.resize(indexBase[chunks]);
+	out.texcoordIndices.resize(indexBase[chunks]);
+	out.normalIndices.resize(indexBase[chunks]);
+
+	std::vector<char> valid(chunks, 1);
+	parallelFor(chunks, chunks, [&](size_t lo, size_t hi) {
+		for (size_t c = lo; c < hi; c++) {
+			ObjData &part = parts[c];
+			size_t n = part.positionIndices.size();
+			copyInto(out.positions, positionBase[c], part.positions);
+			copyInto(out.normals, normalBase[c], part.normals);
+			copyInto(out.texcoords, texcoordBase[c], part.texcoords);
+			copyInto(out.positionIndices, indexBase[c], part.positionIndices);
+			copyInto(out.texcoordIndices, indexBase[c], part.texcoordIndices);
+			copyInto(out.normalIndices, indexBase[c], part.normalIndices);
+			if (n == 0)
+				continue;
+			valid[c] =
+				resolveIndices(&out.positionIndices[indexBase[c]], n, fixups[c].positions,
+					(int)positionBase[c], out.positions.size(), true) &&
+				resolveIndices(&out.texcoordIndices[indexBase[c]], n, fixups[c].texcoords,
+					(int)texcoordBase[c], out.texcoords.size(), false) &&
+				resolveIndices(&out.normalIndices[indexBase[c]], n, fixups[c].normals,
+					(int)normalBase[c], out.normals.size(), false);
+		}
+	});
+	return std::find(valid.begin(), valid.end(), 0) == valid.end();
+}
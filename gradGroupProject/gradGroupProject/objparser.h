@@ -0,0 +1,51 @@
+#ifndef OBJPARSER_H
+#define OBJPARSER_H
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+
+//! Geometry read from an OBJ file, before any post-processing.
+//!
+//! Faces are fan-triangulated; every index array holds three zero-based
+//! entries per triangle.  texcoordIndices and normalIndices hold -1 for
+//! corners that did not reference a texture coordinate or normal.
+struct ObjData {
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> texcoords;
+	std::vector<int> positionIndices;
+	std::vector<int> texcoordIndices;
+	std::vector<int> normalIndices;
+
+	void clear();
+};
+
+//! Reads the whole file into out in one call.
+//!
+bool readFile(const char *path, std::vector<char> &out);
+
+//! Single-pass parser over an in-memory OBJ file, replacing the contents of out.
+//!
+//! Understands v, vn, vt and f (with v, v/vt, v//vn and v/vt/vn corners and
+//! negative, relative indices).  Polygons are triangulated as fans.  Every
+//! other statement (comments, o, g, s, mtllib, usemtl, ...) is skipped.
+//! Returns false if a face references a vertex that does not exist; bad
+//! texture coordinate or normal references are dropped to -1.
+//!
+//! With threads > 1 the buffer is cut into newline-aligned chunks that are
+//! parsed in parallel and then merged, shifting relative indices by the
+//! number of elements in the preceding chunks.  The result is identical to a
+//! single-threaded parse.
+bool parseOBJ(const char *begin, const char *end, ObjData &out, int threads = 1);
+
+//! Parses a decimal floating point number starting at p, in the style of
+//! std::from_chars.  Returns the first character after the number, or p
+//! itself if there is no number there.
+const char *parseFloat(const char *p, const char *end, float &value);
+
+//! Parses an optionally signed decimal integer; same contract as parseFloat.
+//!
+const char *parseInt(const char *p, const char *end, int &value);
+
+#endif
@@ -0,0 +1,146 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include "objwriter.h"
+#include "threadpool.h"
+
+namespace {
+
+	const double kScale = 1e6;                 // 10^kFloatDecimals
+	const double kFastLimit = 1e12;            // keeps value * kScale well inside 64 bits
+	const size_t kLinesPerChunk = 1 << 14;
+
+	// Longest lines, so a chunk can be sized before it is formatted.
+	const size_t kMaxVertexLine = 2 + 6 * (kMaxFloatChars + 1);
+	const size_t kMaxNormalLine = 3 + 3 * (kMaxFloatChars + 1);
+	const size_t kMaxFaceLine = 2 + 3 * (2 * 10 + 3);
+
+	char *formatVec3(char *p, glm::vec3 const &v)
+	{
+		p = formatFloat(p, v.x);
+		*p++ = ' ';
+		p = formatFloat(p, v.y);
+		*p++ = ' ';
+		return formatFloat(p, v.z);
+	}
+
+	// Formats lines [begin, end) of one section into chunk, each by line(p, i).
+	template <typename Line>
+	void formatLines(std::vector<char> &chunk, size_t begin, size_t end, size_t maxLine, Line line)
+	{
+		chunk.resize((end - begin) * maxLine);
+		char *start = chunk.empty() ? 0 : &chunk[0], *p = start;
+		for (size_t i = begin; i < end; i++)
+			p = line(p, i);
+		chunk.resize((size_t)(p - start));
+	}
+
+	// Cuts count lines into chunks, formats them on up to threads threads and
+	// appends them to out in order.
+	template <typename Line>
+	void formatSection(std::vector<char> &out, size_t count, size_t maxLine, int threads, Line line)
+	{
+		size_t chunkCount = (count + kLinesPerChunk - 1) / kLinesPerChunk;
+		std::vector<std::vector<char> > chunks(chunkCount);
+		parallelFor(threads, chunkCount, [&](size_t first, size_t last) {
+			for (size_t c = first; c < last; c++) {
+				size_t end = (c + 1) * kLinesPerChunk < count ? (c + 1) * kLinesPerChunk : count;
+				formatLines(chunks[c], c * kLinesPerChunk, end, maxLine, line);
+			}
+		});
+		for (size_t c = 0; c < chunkCount; c++)
+			out.insert(out.end(), chunks[c].begin(), chunks[c].end());
+	}
+}
+
+char *formatInt(char *out, unsigned int value)
+{
+	char digits[10];
+	int n = 0;
+	do {
+		digits[n++] = (char)('0' + value % 10);
+		value /= 10;
+	} while (value);
+	while (n)
+		*out++ = digits[--n];
+	return out;
+}
+
+// Rounds to an integer count of millionths and prints the two halves; the
+// only division is by a constant.
+char *formatFloat(char *out, float value)
+{
+	double v = value;
+	if (!(std::fabs(v) < kFastLimit))
+		return out + snprintf(out, kMaxFloatChars, "%g", v);
+
+	uint64_t scaled = (uint64_t)(std::fabs(v) * kScale + 0.5);
+	uint64_t whole = scaled / (uint64_t)kScale;
+	unsigned int fraction = (unsigned int)(scaled - whole * (uint64_t)kScale);
+	if (v < 0.0 && scaled != 0)
+		*out++ = '-';
+
+	char digits[20];
+	int n = 0;
+	do {
+		digits[n++] = (char)('0' + whole % 10);
+		whole /= 10;
+	} while (whole);
+	while (n)
+		*out++ = digits[--n];
+
+	if (fraction) {
+		*out++ = '.';
+		int places = kFloatDecimals;
+		while (fraction % 10 == 0) {
+			fraction /= 10;
+			places--;
+		}
+		for (int i = places - 1; i >= 0; i--) {
+			out[i] = (char)('0' + fraction % 10);
+			fraction /= 10;
+		}
+		out += places;
+	}
+	return out;
+}
+
+void formatOBJ(std::vector<char> &out, std::vector<glm::vec3> const &positions,
+	std::vector<glm::vec3> const &normals, std::vector<glm::vec3> const &colors,
+	std::vector<int> const &indices, int threads)
+{
+	bool withColors = colors.size() == positions.size();
+	formatSection(out, positions.size(), kMaxVertexLine, threads, [&](char *p, size_t i) {
+		*p++ = 'v';
+		*p++ = ' ';
+		p = formatVec3(p, positions[i]);
+		if (withColors) {
+			*p++ = ' ';
+			p = formatVec3(p, colors[i]);
+		}
+		*p++ = '\n';
+		return p;
+	});
+	formatSection(out, normals.size(), kMaxNormalLine, threads, [&](char *p, size_t i) {
+		*p++ = 'v';
+		*p++ = 'n';
+		*p++ = ' ';
+		p = formatVec3(p, normals[i]);
+		*p++ = '\n';
+		return p;
+	});
+	formatSection(out, indices.size() / 3, kMaxFaceLine, threads, [&](char *p, size_t t) {
+		*p++ = 'f';
+		for (int corner = 0; corner < 3; corner++) {
+			unsigned int index = (unsigned int)indices[3 * t + corner] + 1;
+			*p++ = ' ';
+			p = formatInt(p, index);
+			*p++ = '/';
+			*p++ = '/';
+			p = formatInt(p, index);
+		}
+		*p++ = '\n';
+		return p;
+	});
+}
@@ -0,0 +1,35 @@
+#ifndef OBJWRITER_H
+#define OBJWRITER_H
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+
+//! Most characters formatFloat() writes.
+//!
+const size_t kMaxFloatChars = 32;
+
+//! Decimal places formatFloat() keeps.  Positions of a unitized mesh lie in
+//! [-1, 1], where this is within a few float steps of the exact value.
+const int kFloatDecimals = 6;
+
+//! Writes value to out in fixed point with kFloatDecimals places, trailing
+//! zeros dropped ("0.5", "-12", "0.000001"), and returns the end.  parseFloat()
+//! reads it back to within half a unit of the last place.  Magnitudes too
+//! large for the fast path, infinities and NaN go through snprintf.
+char *formatFloat(char *out, float value);
+
+//! Writes a non-negative integer to out and returns the end.
+//!
+char *formatInt(char *out, unsigned int value);
+
+//! Appends a triangle mesh to out as OBJ text: "v x y z r g b" lines with the
+//! colour after the position (the extension MeshLab and others read), "vn"
+//! lines, then "f a//a b//b c//c" faces, normals sharing the vertex indices.
+//! colors may be empty.  With threads > 1 the lines are formatted in
+//! parallel chunks; the text is the same.
+void formatOBJ(std::vector<char> &out, std::vector<glm::vec3> const &positions,
+	std::vector<glm::vec3> const &normals, std::vector<glm::vec3> const &colors,
+	std::vector<int> const &indices, int threads = 1);
+
+#endif
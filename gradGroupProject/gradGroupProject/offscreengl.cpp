@@ -0,0 +1,84 @@
+#include "offscreengl.h"
+#ifdef TVO_EGL
+#include <cstring>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#ifdef TVO_EGL
+namespace {
+
+	bool hasClientExtension(const char *name)
+	{
+		const char *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+		if (!extensions)
+			return false;
+		size_t length = strlen(name);
+		for (const char *at = strstr(extensions, name); at; at = strstr(at + length, name))
+			if ((at == extensions || at[-1] == ' ') && (at[length] == ' ' || at[length] == '\0'))
+				return true;
+		return false;
+	}
+
+	// A small pbuffer is enough: drawing is timed for submitting the meshes,
+	// not for filling pixels.  Releases everything it made if any step fails.
+	bool makeCurrent(EGLDisplay display)
+	{
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, 0, 0))
+			return false;
+
+		EGLint configAttributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_DEPTH_SIZE, 24,
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+		EGLConfig config;
+		EGLint configs = 0;
+		EGLSurface surface = EGL_NO_SURFACE;
+		EGLContext context = EGL_NO_CONTEXT;
+		if (eglChooseConfig(display, configAttributes, &config, 1, &configs) && configs > 0 &&
+			eglBindAPI(EGL_OPENGL_API)) {
+			EGLint surfaceAttributes[] = { EGL_WIDTH, kOffscreenSize, EGL_HEIGHT, kOffscreenSize, EGL_NONE };
+			surface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+			context = eglCreateContext(display, config, EGL_NO_CONTEXT, 0);
+			if (surface != EGL_NO_SURFACE && context != EGL_NO_CONTEXT &&
+				eglMakeCurrent(display, surface, surface, context))
+				return true;
+		}
+
+		if (context != EGL_NO_CONTEXT)
+			eglDestroyContext(display, context);
+		if (surface != EGL_NO_SURFACE)
+			eglDestroySurface(display, surface);
+		eglTerminate(display);
+		return false;
+	}
+}
+#endif
+
+// Mesa's surfaceless platform and the first EGL device need neither X nor
+// Wayland, so they are tried before the default display.
+bool makeOffscreenContext()
+{
+#ifdef TVO_EGL
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = 0;
+	if (hasClientExtension("EGL_EXT_platform_base"))
+		getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+	if (getPlatformDisplay && hasClientExtension("EGL_MESA_platform_surfaceless") &&
+		makeCurrent(getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0)))
+		return true;
+
+	if (getPlatformDisplay && hasClientExtension("EGL_EXT_platform_device") &&
+		hasClientExtension("EGL_EXT_device_enumeration")) {
+		PFNEGLQUERYDEVICESEXTPROC queryDevices =
+			(PFNEGLQUERYDEVICESEXTPROC)eglGetProcAddress("eglQueryDevicesEXT");
+		EGLDeviceEXT device;
+		EGLint devices = 0;
+		if (queryDevices && queryDevices(1, &device, &devices) && devices > 0 &&
+			makeCurrent(getPlatformDisplay(EGL_PLATFORM_DEVICE_EXT, device, 0)))
+			return true;
+	}
+
+	return makeCurrent(eglGetDisplay(EGL_DEFAULT_DISPLAY));
+#else
+	return false;
+#endif
+}
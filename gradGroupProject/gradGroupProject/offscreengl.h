@@ -0,0 +1,15 @@
+#ifndef OFFSCREENGL_H
+#define OFFSCREENGL_H
+
+//! Makes a small offscreen OpenGL context current on the calling thread, for
+//! drawing without a window (the headless driver and the benchmarks).
+//!
+//! Only available on Linux builds with TVO_EGL defined and linked with EGL;
+//! elsewhere, or when no EGL display is available, returns false.  Mesa's
+//! surfaceless platform or an EGL device is used when there is one, so no X
+//! server is needed.  The surface is kOffscreenSize pixels square.
+bool makeOffscreenContext();
+
+const int kOffscreenSize = 256;
+
+#endif
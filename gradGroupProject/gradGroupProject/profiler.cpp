@@ -0,0 +1,163 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+#include "profiler.h"
+#include "spscqueue.h"
+
+namespace {
+
+	struct ThreadRing {
+		SPSCQueue<ProfileEvent, Profiler::kRingSize> events;
+		const char *name;       // written under gLock by the owning thread only
+		int index;
+	};
+
+	std::mutex gLock;
+	std::vector<ThreadRing *> gRings;        // never freed: threads may outlive a collect
+	std::vector<ProfileEvent> gCollected;
+	std::atomic<long long> gDropped(0);
+
+	thread_local ThreadRing *tRing = 0;
+
+	ThreadRing *ring()
+	{
+		if (!tRing) {
+			ThreadRing *created = new ThreadRing;
+			created->name = 0;
+			std::lock_guard<std::mutex> lock(gLock);
+			created->index = (int)gRings.size();
+			gRings.push_back(created);
+			tRing = created;
+		}
+		return tRing;
+	}
+
+	void record(const char *name, long long start, long long value, ProfileEventType type)
+	{
+		ProfileEvent event;
+		event.name = name;
+		event.start = start;
+		event.value = value;
+		event.type = type;
+		event.thread = 0;
+		if (!ring()->events.push(event))
+			gDropped.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Names are literals from the source, but a quote or a backslash would
+	// still break the file.
+	void writeString(FILE *file, const char *s)
+	{
+		fputc('"', file);
+		for (; *s; s++) {
+			if (*s == '"' || *s == '\\')
+				fputc('\\', file);
+			fputc(*s, file);
+		}
+		fputc('"', file);
+	}
+}
+
+long long Profiler::now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Profiler::span(const char *name, long long start, long long end)
+{
+	record(name, start, end - start, ProfileSpan);
+}
+
+void Profiler::counter(const char *name, long long value)
+{
+	record(name, now(), value, ProfileCounter);
+}
+
+void Profiler::nameThread(const char *name)
+{
+	ThreadRing *r = ring();
+	if (r->name == name)
+		return;
+	std::lock_guard<std::mutex> lock(gLock);
+	r->name = name;
+}
+
+void Profiler::collect()
+{
+	std::lock_guard<std::mutex> lock(gLock);
+	ProfileEvent event;
+	for (size_t i = 0; i < gRings.size(); i++)
+		while (gRings[i]->events.pop(event)) {
+			if (gCollected.size() >= kMaxCollected) {
+				gDropped.fetch_add(1, std::memory_order_relaxed);
+				continue;
+			}
+			event.thread = gRings[i]->index;
+			gCollected.push_back(event);
+		}
+}
+
+void Profiler::clear()
+{
+	collect();
+	std::lock_guard<std::mutex> lock(gLock);
+	gCollected.clear();
+	gDropped.store(0);
+}
+
+size_t Profiler::collected()
+{
+	std::lock_guard<std::mutex> lock(gLock);
+	return gCollected.size();
+}
+
+long long Profiler::dropped()
+{
+	return gDropped.load();
+}
+
+// Complete ("X") events for spans and counter ("C") events, timestamps in
+// microseconds from the first event, plus a metadata event per named thread.
+bool Profiler::writeChromeTrace(const char *filename)
+{
+	collect();
+	FILE *file = fopen(filename, "w");
+	if (!file)
+		return false;
+
+	std::lock_guard<std::mutex> lock(gLock);
+	long long origin = 0;
+	for (size_t i = 0; i < gCollected.size(); i++)
+		if (i == 0 || gCollected[i].start < origin)
+			origin = gCollected[i].start;
+
+	fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	bool first = true;
+	for (size_t i = 0; i < gRings.size(); i++) {
+		if (!gRings[i]->name)
+			continue;
+		fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+			first ? "" : ",", gRings[i]->index);
+		writeString(file, gRings[i]->name);
+		fprintf(file, "}}");
+		first = false;
+	}
+	for (size_t i = 0; i < gCollected.size(); i++) {
+		ProfileEvent const &event = gCollected[i];
+		fprintf(file, "%s\n{\"name\":", first ? "" : ",");
+		writeString(file, event.name);
+		if (event.type == ProfileSpan)
+			fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+				event.thread, (event.start - origin) / 1000.0, event.value / 1000.0);
+		else
+			fprintf(file, ",\"ph\":\"C\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"args\":{\"value\":%lld}}",
+				event.thread, (event.start - origin) / 1000.0, event.value);
+		first = false;
+	}
+	fprintf(file, "\n]}\n");
+	fclose(file);
+	return true;
+}
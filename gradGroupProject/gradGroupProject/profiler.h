@@ -0,0 +1,94 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstddef>
+
+//! Build with TVO_PROFILE set to 0 to compile every PROFILE_ macro out.
+//!
+#ifndef TVO_PROFILE
+#define TVO_PROFILE 1
+#endif
+
+enum ProfileEventType {
+	ProfileSpan,
+	ProfileCounter
+};
+
+//! One timed scope or counter sample.
+//!
+struct ProfileEvent {
+	const char *name;     // a string literal; never copied
+	long long start;      // nanoseconds on the steady clock
+	long long value;      // ProfileSpan: duration in nanoseconds; ProfileCounter: the value
+	int type;             // a ProfileEventType
+	int thread;           // index of the recording thread, set by collect()
+};
+
+//! Per-thread timers and counters that are cheap enough for the servo loop.
+//!
+//! Each thread records into its own lock-free ring, made the first time the
+//! thread records anything (which takes a lock, once).  Recording never
+//! blocks: when a ring is full the event is dropped and counted.  collect()
+//! moves what the rings hold to one list, so it has to run often enough to
+//! keep them from filling up, e.g. once a frame; writeChromeTrace() saves that
+//! list for chrome://tracing or Perfetto.
+//!
+//! Use the PROFILE_ macros rather than calling these directly, so builds with
+//! TVO_PROFILE 0 carry no trace of them.
+class Profiler {
+	public:
+		static const int kRingSize = 1 << 15;          // events per thread between collects
+		static const size_t kMaxCollected = 1 << 22;   // about 128 MB of events
+
+		static long long now();
+
+		static void span(const char *name, long long start, long long end);
+		static void counter(const char *name, long long value);
+
+		//! Names the calling thread in the trace.  Cheap to call again with
+		//! the same name.
+		static void nameThread(const char *name);
+
+		//! Any thread; serialized with the other calls below by a lock the
+		//! recording threads never take after their first event.
+		static void collect();
+		static void clear();
+		static size_t collected();
+
+		//! Events lost to full rings or to the kMaxCollected limit.
+		//!
+		static long long dropped();
+
+		//! Collects, then writes everything collected as Chrome trace JSON.
+		//!
+		static bool writeChromeTrace(const char *filename);
+	};
+
+//! Records the time from construction to destruction as a span.
+//!
+class ProfileScope {
+	public:
+		explicit ProfileScope(const char *name) : mName(name), mStart(Profiler::now()) {}
+		~ProfileScope() { Profiler::span(mName, mStart, Profiler::now()); }
+
+	private:
+		ProfileScope(ProfileScope const &);
+		ProfileScope &operator=(ProfileScope const &);
+
+		const char *mName;
+		long long mStart;
+	};
+
+#if TVO_PROFILE
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_JOIN(profileScope, __LINE__)(name)
+#define PROFILE_COUNTER(name, value) Profiler::counter(name, (long long)(value))
+#define PROFILE_THREAD(name) Profiler::nameThread(name)
+#else
+#define PROFILE_SCOPE(name) do {} while (0)
+#define PROFILE_COUNTER(name, value) do {} while (0)
+#define PROFILE_THREAD(name) do {} while (0)
+#endif
+
+#endif
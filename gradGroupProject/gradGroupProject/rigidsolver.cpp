@@ -0,0 +1,205 @@
+#include <cmath>
+#include <unordered_map>
+#include "profiler.h"
+#include "rigidsolver.h"
+
+RigidSolver::RigidSolver()
+{
+}
+
+// The unknowns are the region vertices after the handle, in the region's
+// order.  brushRegion() lists them by distance from the handle, so a vertex's
+// neighbours are never far before it and the envelope stays about one ring
+// of the region wide.
+bool RigidSolver::begin(CSRGraph const &adjacency, std::vector<glm::vec3> const &positions,
+	std::vector<int> const &region)
+{
+	PROFILE_SCOPE("rigid begin");
+	mVertices.clear();
+	mOffsets.clear();
+	mNeighbours.clear();
+	mFixed.clear();
+	if (region.size() < 2)
+		return false;
+
+	std::unordered_map<int, int> local, fixed;
+	for (size_t i = 0; i < region.size(); i++)
+		local[region[i]] = (int)i;
+
+	mOffsets.push_back(0);
+	for (size_t i = 0; i < region.size(); i++) {
+		ConstSpan<int> ring = adjacency.neighbours(region[i]);
+		for (size_t k = 0; k < ring.size(); k++) {
+			std::unordered_map<int, int>::const_iterator found = local.find(ring[k]);
+			if (found != local.end()) {
+				mNeighbours.push_back(found->second);
+				continue;
+			}
+			std::pair<std::unordered_map<int, int>::iterator, bool> added =
+				fixed.insert(std::make_pair(ring[k], (int)mFixed.size()));
+			if (added.second)
+				mFixed.push_back(positions[ring[k]]);
+			mNeighbours.push_back(~added.first->second);
+		}
+		mOffsets.push_back((int)mNeighbours.size());
+	}
+
+	// Row i - 1 is vertex i: its degree on the diagonal and -1 for each
+	// neighbour that is also unknown.  The handle and the fixed vertices go
+	// to the right-hand side.
+	int unknowns = (int)region.size() - 1;
+	mSystem.reset(unknowns);
+	for (int i = 1; i <= unknowns; i++) {
+		mSystem.add(i - 1, i - 1, (double)(mOffsets[i + 1] - mOffsets[i]));
+		for (int k = mOffsets[i]; k < mOffsets[i + 1]; k++) {
+			int j = mNeighbours[k];
+			if (j > 0 && j < i)
+				mSystem.add(i - 1, j - 1, -1.0);
+		}
+	}
+	if (!mSystem.factorize()) {
+		mOffsets.clear();
+		mNeighbours.clear();
+		mFixed.clear();
+		return false;
+	}
+
+	mVertices = region;
+	mRest.resize(region.size());
+	for (size_t i = 0; i < region.size(); i++)
+		mRest[i] = positions[region[i]];
+	mCurrent = mRest;
+	Rotation identity = { 1.0, 0.0, 0.0, 0.0 };
+	mRotations.assign(region.size(), identity);
+	Matrix eye = { { { 1.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0 }, { 0.0, 0.0, 1.0 } } };
+	mMatrices.assign(region.size(), eye);
+	mRhs.resize(3 * (size_t)unknowns);
+	return true;
+}
+
+void RigidSolver::iterate(glm::vec3 const &target, std::vector<glm::vec3> &positions)
+{
+	PROFILE_SCOPE("rigid iterate");
+	if (mVertices.empty())
+		return;
+	mCurrent[0] = target;
+	fitRotations();
+	solveGlobal();
+	positions = mCurrent;
+}
+
+// The rotation closest to each one-ring's covariance, by Mueller et al., "A
+// Robust Method to Extract the Rotational Part of Deformations": repeatedly
+// turn the current rotation about the axis that best lines its columns up
+// with the covariance's.  Starting from last iteration's answer, a few turns
+// are enough, and unlike an SVD it cannot flip into a reflection.
+void RigidSolver::fitRotations()
+{
+	for (size_t i = 0; i < mVertices.size(); i++) {
+		double a[3][3] = { { 0.0 } };
+		for (int k = mOffsets[i]; k < mOffsets[i + 1]; k++) {
+			int j = mNeighbours[k];
+			glm::vec3 rest = mRest[i] - (j >= 0 ? mRest[j] : mFixed[~j]);
+			glm::vec3 moved = mCurrent[i] - (j >= 0 ? mCurrent[j] : mFixed[~j]);
+			double r[3] = { rest.x, rest.y, rest.z };
+			double m[3] = { moved.x, moved.y, moved.z };
+			for (int row = 0; row < 3; row++)
+				for (int col = 0; col < 3; col++)
+					a[row][col] += m[row] * r[col];
+		}
+
+		Rotation &q = mRotations[i];
+		double (*R)[3] = mMatrices[i].m;
+		for (int iteration = 0; iteration < kRotationIterations; iteration++) {
+			// sum over columns c of R_c x A_c, over |sum of R_c . A_c|
+			double omega[3] = { 0.0, 0.0, 0.0 }, dot = 0.0;
+			for (int c = 0; c < 3; c++) {
+				omega[0] += R[1][c] * a[2][c] - R[2][c] * a[1][c];
+				omega[1] += R[2][c] * a[0][c] - R[0][c] * a[2][c];
+				omega[2] += R[0][c] * a[1][c] - R[1][c] * a[0][c];
+				dot += R[0][c] * a[0][c] + R[1][c] * a[1][c] + R[2][c] * a[2][c];
+			}
+			double scale = 1.0 / (std::fabs(dot) + 1.0e-9);
+			double angle = scale * std::sqrt(omega[0] * omega[0] + omega[1] * omega[1] + omega[2] * omega[2]);
+			if (angle < 1.0e-9)
+				break;
+
+			double s = std::sin(0.5 * angle) * scale / angle;
+			Rotation turn = { std::cos(0.5 * angle), omega[0] * s, omega[1] * s, omega[2] * s };
+			Rotation next = {
+				turn.w * q.w - turn.x * q.x - turn.y * q.y - turn.z * q.z,
+				turn.w * q.x + turn.x * q.w + turn.y * q.z - turn.z * q.y,
+				turn.w * q.y - turn.x * q.z + turn.y * q.w + turn.z * q.x,
+				turn.w * q.z + turn.x * q.y - turn.y * q.x + turn.z * q.w
+			};
+			double norm = 1.0 / std::sqrt(next.w * next.w + next.x * next.x + next.y * next.y + next.z * next.z);
+			q.w = next.w * norm;
+			q.x = next.x * norm;
+			q.y = next.y * norm;
+			q.z = next.z * norm;
+
+			R[0][0] = 1.0 - 2.0 * (q.y * q.y + q.z * q.z);
+			R[0][1] = 2.0 * (q.x * q.y - q.w * q.z);
+			R[0][2] = 2.0 * (q.x * q.z + q.w * q.y);
+			R[1][0] = 2.0 * (q.x * q.y + q.w * q.z);
+			R[1][1] = 1.0 - 2.0 * (q.x * q.x + q.z * q.z);
+			R[1][2] = 2.0 * (q.y * q.z - q.w * q.x);
+			R[2][0] = 2.0 * (q.x * q.z - q.w * q.y);
+			R[2][1] = 2.0 * (q.y * q.z + q.w * q.x);
+			R[2][2] = 1.0 - 2.0 * (q.x * q.x + q.y * q.y);
+		}
+	}
+}
+
+// For each unknown i: deg(i) x_i - sum of unknown neighbours x_j = sum over
+// all neighbours of (R_i + R_j) / 2 (p_i - p_j), plus the known neighbours'
+// positions.  Vertices outside the region keep the identity.
+void RigidSolver::solveGlobal()
+{
+	size_t unknowns = mVertices.size() - 1;
+	double *bx = &mRhs[0], *by = bx + unknowns, *bz = by + unknowns;
+	for (size_t i = 1; i <= unknowns; i++) {
+		double const (*Ri)[3] = mMatrices[i].m;
+		double b[3] = { 0.0, 0.0, 0.0 };
+		for (int k = mOffsets[i]; k < mOffsets[i + 1]; k++) {
+			int j = mNeighbours[k];
+			glm::vec3 edge = mRest[i] - (j >= 0 ? mRest[j] : mFixed[~j]);
+			double e[3] = { edge.x, edge.y, edge.z };
+			for (int row = 0; row < 3; row++) {
+				double turned = Ri[row][0] * e[0] + Ri[row][1] * e[1] + Ri[row][2] * e[2];
+				if (j >= 0) {
+					double const *Rj = mMatrices[j].m[row];
+					turned += Rj[0] * e[0] + Rj[1] * e[1] + Rj[2] * e[2];
+				}
+				else
+					turned += e[row];
+				b[row] += 0.5 * turned;
+			}
+			if (j <= 0) {
+				glm::vec3 known = j == 0 ? mCurrent[0] : mFixed[~j];
+				b[0] += known.x;
+				b[1] += known.y;
+				b[2] += known.z;
+			}
+		}
+		bx[i - 1] = b[0];
+		by[i - 1] = b[1];
+		bz[i - 1] = b[2];
+	}
+
+	mSystem.solve(bx);
+	mSystem.solve(by);
+	mSystem.solve(bz);
+	for (size_t i = 1; i <= unknowns; i++)
+		mCurrent[i] = glm::vec3((float)bx[i - 1], (float)by[i - 1], (float)bz[i - 1]);
+}
+
+std::vector<int> const &RigidSolver::vertices() const
+{
+	return mVertices;
+}
+
+size_t RigidSolver::factorSize() const
+{
+	return mSystem.envelopeSize();
+}
@@ -0,0 +1,79 @@
+#ifndef RIGIDSOLVER_H
+#define RIGIDSOLVER_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "csrgraph.h"
+#include "envelopecholesky.h"
+
+//! As-rigid-as-possible editing of a region of a mesh, for BrushRigid.
+//!
+//! The region's first vertex is the handle and follows the target exactly;
+//! the vertices just outside the region stay where they were; the rest move
+//! so that each one-ring turns and shifts as rigidly as it can (Sorkine and
+//! Alexa, "As-Rigid-As-Possible Surface Modeling").  Unlike the falloff
+//! brush, a long pull bends the surface instead of shearing it.
+//!
+//! Each iterate() is one local step, fitting a rotation to every one-ring,
+//! and one global step, solving for the positions that best follow those
+//! rotations.  With uniform edge weights the global system depends only on
+//! the region and its edges, not on the target, so begin() factorizes it
+//! once and each iteration is two triangular solves per coordinate.  The
+//! rotations are warm-started from the previous iteration, so a moving
+//! target converges over a few ticks rather than within each.
+class RigidSolver {
+	public:
+		//! Iterations of rotation fitting per vertex and local step.
+		//!
+		static const int kRotationIterations = 4;
+
+		RigidSolver();
+
+		//! Sets up an edit of region, handle first, of the mesh with the given
+		//! adjacency and positions, and factorizes its system.  Returns false,
+		//! leaving the solver empty, if the region has nothing to move.
+		bool begin(CSRGraph const &adjacency, std::vector<glm::vec3> const &positions,
+			std::vector<int> const &region);
+
+		//! One local and one global step toward the handle sitting on target.
+		//! positions receives the new position of each region vertex, in the
+		//! order begin() was given.
+		void iterate(glm::vec3 const &target, std::vector<glm::vec3> &positions);
+
+		//! Vertices of the region, handle first; empty before begin().
+		//!
+		std::vector<int> const &vertices() const;
+
+		//! Stored entries of the factor, a measure of each iteration's cost.
+		//!
+		size_t factorSize() const;
+
+	private:
+		struct Rotation {
+			double w, x, y, z;
+		};
+
+		struct Matrix {
+			double m[3][3];
+		};
+
+		void fitRotations();
+		void solveGlobal();
+
+		std::vector<int> mVertices;
+		EnvelopeCholesky mSystem;         // over every region vertex but the handle
+
+		// Each region vertex's neighbours: i >= 0 is region vertex i, ~i is
+		// mFixed[i], a vertex just outside the region.
+		std::vector<int> mOffsets;
+		std::vector<int> mNeighbours;
+		std::vector<glm::vec3> mFixed;
+
+		std::vector<glm::vec3> mRest;     // region positions at begin()
+		std::vector<glm::vec3> mCurrent;
+		std::vector<Rotation> mRotations;
+		std::vector<Matrix> mMatrices;    // mRotations as matrices
+		std::vector<double> mRhs;         // scratch, x then y then z
+	};
+
+#endif
@@ -0,0 +1,24 @@
+#include "sampledlog.h"
+
+namespace {
+
+	std::atomic<int> gInterval(0);
+}
+
+void SampledLog::setInterval(int interval)
+{
+	gInterval.store(interval > 0 ? interval : 0);
+}
+
+int SampledLog::interval()
+{
+	return gInterval.load();
+}
+
+bool SampledLog::sample(std::atomic<int> &count)
+{
+	int interval = gInterval.load(std::memory_order_relaxed);
+	if (interval == 0)
+		return false;
+	return count.fetch_add(1, std::memory_order_relaxed) % interval == 0;
+}
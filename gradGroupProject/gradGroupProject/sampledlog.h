@@ -0,0 +1,29 @@
+#ifndef SAMPLEDLOG_H
+#define SAMPLEDLOG_H
+
+#include <atomic>
+#include <cstdio>
+
+//! Console output from callbacks that fire hundreds of times a second.
+//!
+//! Printing every touch and motion event costs more than handling it, so
+//! SAMPLED_LOG() prints only every interval-th message from each call site,
+//! and nothing at all with the default interval of 0.
+class SampledLog {
+	public:
+		static void setInterval(int interval);
+		static int interval();
+
+		//! Counts a message at the call site that owns count; true if this
+		//! one should be printed.
+		static bool sample(std::atomic<int> &count);
+	};
+
+#define SAMPLED_LOG(...) \
+	do { \
+		static std::atomic<int> sampledLogCount(0); \
+		if (SampledLog::sample(sampledLogCount)) \
+			printf(__VA_ARGS__); \
+	} while (0)
+
+#endif
@@ -0,0 +1,245 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include "profiler.h"
+#include "scene.h"
+#include "threadpool.h"
+
+namespace {
+
+	const double kPi = 3.14159265358979323846;
+
+	// Where a file named in the scene file is looked for: beside the scene
+	// file, unless the name is absolute.
+	std::string resolvePath(std::string const &sceneFile, std::string const &name)
+	{
+		bool absolute = name[0] == '/' || name[0] == '\\' || (name.size() > 1 && name[1] == ':');
+		size_t slash = sceneFile.find_last_of("/\\");
+		if (absolute || slash == std::string::npos)
+			return name;
+		return sceneFile.substr(0, slash + 1) + name;
+	}
+
+	// Scale, then rotation by degrees about axis, then translation, as one
+	// matrix in OpenGL order.  False if the axis has no direction.
+	bool composeTransform(double const translate[3], double degrees, double const axis[3], double scale,
+		double m[16])
+	{
+		double length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+		if (length == 0.0)
+			return false;
+		double x = axis[0] / length, y = axis[1] / length, z = axis[2] / length;
+		double c = std::cos(degrees * kPi / 180.0), s = std::sin(degrees * kPi / 180.0), t = 1.0 - c;
+		double r[3][3] = {
+			{t * x * x + c, t * x * y - s * z, t * x * z + s * y},
+			{t * x * y + s * z, t * y * y + c, t * y * z - s * x},
+			{t * x * z - s * y, t * y * z + s * x, t * z * z + c}};
+		for (int col = 0; col < 3; col++) {
+			for (int row = 0; row < 3; row++)
+				m[4 * col + row] = scale * r[row][col];
+			m[4 * col + 3] = 0.0;
+		}
+		for (int row = 0; row < 3; row++)
+			m[12 + row] = translate[row];
+		m[15] = 1.0;
+		return true;
+	}
+
+	// The next word of the line, or false at its end.
+	bool nextWord(const char *&cursor, std::string &word)
+	{
+		while (*cursor == ' ' || *cursor == '\t' || *cursor == '\r' || *cursor == '\n')
+			cursor++;
+		const char *begin = cursor;
+		while (*cursor && *cursor != ' ' && *cursor != '\t' && *cursor != '\r' && *cursor != '\n')
+			cursor++;
+		word.assign(begin, cursor);
+		return !word.empty();
+	}
+
+	bool nextNumbers(const char *&cursor, double *out, int count)
+	{
+		for (int i = 0; i < count; i++) {
+			char *end;
+			out[i] = strtod(cursor, &end);
+			if (end == cursor)
+				return false;
+			cursor = end;
+		}
+		return true;
+	}
+
+	struct ParsedObject {
+		std::string mesh;
+		double transform[16];
+		SceneMaterial material;
+	};
+
+	bool parseObject(std::string const &sceneFile, const char *line, ParsedObject &object)
+	{
+		const char *cursor = line;
+		std::string word;
+		if (!nextWord(cursor, word))
+			return false;
+		object.mesh = resolvePath(sceneFile, word);
+		object.material = kDefaultMaterial;
+
+		double translate[3] = {0.0, 0.0, 0.0}, axis[3] = {0.0, 0.0, 1.0};
+		double degrees = 0.0, scale = 1.0, values[2];
+		while (nextWord(cursor, word)) {
+			if (word == "translate") {
+				if (!nextNumbers(cursor, translate, 3))
+					return false;
+			}
+			else if (word == "rotate") {
+				if (!nextNumbers(cursor, &degrees, 1) || !nextNumbers(cursor, axis, 3))
+					return false;
+			}
+			else if (word == "scale") {
+				if (!nextNumbers(cursor, &scale, 1) || scale <= 0.0)
+					return false;
+			}
+			else if (word == "stiffness" && nextNumbers(cursor, values, 1))
+				object.material.stiffness = (float)values[0];
+			else if (word == "damping" && nextNumbers(cursor, values, 1))
+				object.material.damping = (float)values[0];
+			else if (word == "friction" && nextNumbers(cursor, values, 2)) {
+				object.material.staticFriction = (float)values[0];
+				object.material.dynamicFriction = (float)values[1];
+			}
+			else
+				return false;
+		}
+		return composeTransform(translate, degrees, axis, scale, object.transform);
+	}
+}
+
+Scene::Scene() :
+mErrorLine(0)
+{
+}
+
+bool Scene::read(const char *path)
+{
+	mErrorLine = 0;
+	FILE *file = fopen(path, "r");
+	if (!file)
+		return false;
+
+	std::vector<ParsedObject> objects;
+	char line[1024];
+	int lineNumber = 0;
+	bool ok = true;
+	while (ok && fgets(line, sizeof(line), file)) {
+		lineNumber++;
+		const char *cursor = line;
+		std::string word;
+		if (!nextWord(cursor, word) || word[0] == '#')
+			continue;
+		objects.push_back(ParsedObject());
+		ok = parseObject(path, line, objects.back());
+	}
+	fclose(file);
+	if (!ok) {
+		mErrorLine = lineNumber;
+		return false;
+	}
+
+	for (size_t i = 0; i < objects.size(); i++)
+		addObject(objects[i].mesh, objects[i].transform, objects[i].material);
+	return true;
+}
+
+int Scene::errorLine() const
+{
+	return mErrorLine;
+}
+
+int Scene::addObject(std::string const &meshPath, double const transform[16], SceneMaterial const &material)
+{
+	SceneObject object;
+	object.mesh = -1;
+	for (size_t m = 0; m < mMeshPaths.size() && object.mesh < 0; m++)
+		if (mMeshPaths[m] == meshPath)
+			object.mesh = (int)m;
+	if (object.mesh < 0) {
+		object.mesh = (int)mMeshPaths.size();
+		mMeshPaths.push_back(meshPath);
+	}
+	for (int i = 0; i < 16; i++)
+		object.transform[i] = transform ? transform[i] : (i % 5 == 0 ? 1.0 : 0.0);
+	object.material = material;
+	mObjects.push_back(object);
+	return (int)mObjects.size() - 1;
+}
+
+bool Scene::loadMeshes(int threads)
+{
+	PROFILE_SCOPE("loadMeshes");
+	// Made in place: a loader is never copied.
+	std::vector<OBJLoader>(mMeshPaths.size()).swap(mMeshes);
+	std::vector<char> loaded(mMeshes.size(), 0);
+	if (threads <= 1 || mMeshes.size() == 1) {
+		for (size_t m = 0; m < mMeshes.size(); m++)
+			loaded[m] = mMeshes[m].load(mMeshPaths[m].c_str(), threads);
+	}
+	else {
+		// Whole meshes are handed out one at a time, so a large one does not
+		// hold up a range of small ones.  Each loads on one thread: the pool
+		// runs one batch at a time, so a load may not start its own.
+		std::function<void(int)> task = [&](int m) {
+			loaded[m] = mMeshes[m].load(mMeshPaths[m].c_str(), 1);
+		};
+		ThreadPool::shared().run((int)mMeshes.size(), task);
+	}
+
+	mFailedMesh.clear();
+	for (size_t m = 0; m < mMeshes.size(); m++) {
+		if (!loaded[m]) {
+			mFailedMesh = mMeshPaths[m];
+			return false;
+		}
+	}
+	return true;
+}
+
+std::string const &Scene::failedMesh() const
+{
+	return mFailedMesh;
+}
+
+size_t Scene::objectCount() const
+{
+	return mObjects.size();
+}
+
+SceneObject const &Scene::object(size_t object) const
+{
+	return mObjects[object];
+}
+
+OBJLoader &Scene::loader(size_t object)
+{
+	return mMeshes[mObjects[object].mesh];
+}
+
+OBJLoader const &Scene::loader(size_t object) const
+{
+	return mMeshes[mObjects[object].mesh];
+}
+
+size_t Scene::meshCount() const
+{
+	return mMeshPaths.size();
+}
+
+OBJLoader &Scene::mesh(size_t mesh)
+{
+	return mMeshes[mesh];
+}
+
+std::string const &Scene::meshPath(size_t mesh) const
+{
+	return mMeshPaths[mesh];
+}
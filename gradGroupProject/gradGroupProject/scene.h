@@ -0,0 +1,95 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <string>
+#include <vector>
+#include "objloader.h"
+
+//! How an object feels, as the HL material properties of its shape.
+//!
+struct SceneMaterial {
+	float stiffness;
+	float damping;
+	float staticFriction;
+	float dynamicFriction;
+};
+
+const SceneMaterial kDefaultMaterial = {0.8f, 0.0f, 0.5f, 0.0f};
+
+//! One object of a scene: a mesh placed in the world.
+//!
+struct SceneObject {
+	int mesh;                   // index of its mesh in the scene
+	double transform[16];       // model to world, in OpenGL order
+	SceneMaterial material;
+};
+
+//! The objects that can be touched and edited, and the meshes they use.
+//!
+//! Objects naming the same mesh file share one OBJLoader, so memory grows
+//! with the distinct meshes rather than the objects, and an edit to one
+//! such object shows on all of them.  Objects are numbered in the order they
+//! were added; that is the numbering Interaction and session traces use.
+//!
+//! A scene file has one object per line:
+//!
+//!     mesh.obj [translate x y z] [rotate degrees x y z] [scale s]
+//!              [stiffness k] [damping d] [friction static dynamic]
+//!
+//! Mesh paths are relative to the scene file and may not contain spaces.
+//! The mesh is scaled, then rotated about the axis, then translated,
+//! whatever order the words come in; anything left out is the identity or
+//! kDefaultMaterial.  Lines starting with '#' are comments.
+class Scene {
+	public:
+		Scene();
+
+		//! Adds the objects of a scene file.  Returns false, with
+		//! errorLine() set, if the file cannot be read or a line is not
+		//! understood; no object is added then.
+		bool read(const char *path);
+
+		//! Line of the error read() last returned false for; 0 if the file
+		//! could not be opened.
+		int errorLine() const;
+
+		//! Adds an object and returns its index.  transform may be 0 for the
+		//! identity.
+		int addObject(std::string const &meshPath, double const transform[16] = 0,
+			SceneMaterial const &material = kDefaultMaterial);
+
+		//! Loads every mesh, each exactly once.  With threads > 1 different
+		//! meshes load side by side on the shared pool; a single mesh gets
+		//! the threads for its own parallel passes instead.  Call once, after
+		//! the objects are added; the loaders do not move afterwards.
+		//! Returns false, with failedMesh() set, if a mesh did not load.
+		bool loadMeshes(int threads = 1);
+
+		//! Path of a mesh that loadMeshes() could not load.
+		//!
+		std::string const &failedMesh() const;
+
+		size_t objectCount() const;
+		SceneObject const &object(size_t object) const;
+
+		//! The mesh an object uses, once loaded.
+		//!
+		OBJLoader &loader(size_t object);
+		OBJLoader const &loader(size_t object) const;
+
+		size_t meshCount() const;
+		OBJLoader &mesh(size_t mesh);
+		std::string const &meshPath(size_t mesh) const;
+
+	private:
+		Scene(Scene const &);
+		Scene &operator=(Scene const &);
+
+		std::vector<SceneObject> mObjects;
+		std::vector<std::string> mMeshPaths;
+		std::vector<OBJLoader> mMeshes;     // one per path, made by loadMeshes()
+		std::string mFailedMesh;
+		int mErrorLine;
+	};
+
+#endif
@@ -0,0 +1,84 @@
+#include <cstdlib>
+#include "servotiming.h"
+
+namespace {
+
+	const ServoSummary kEmptySummary = { 0, 0.0, 0, 0, 0, 0 };
+}
+
+ServoTiming::ServoTiming(int servoRate) :
+mStarted(false),
+mPeriodSum(0),
+mPeriods(0),
+mCurrent(kEmptySummary)
+{
+	setServoRate(servoRate);
+}
+
+void ServoTiming::setServoRate(int servoRate)
+{
+	if (servoRate < 1)
+		servoRate = kDefaultServoRate;
+	mPeriod = 1000000 / servoRate;
+	mWindow = servoRate;
+	// A window half measured at the old rate would mean nothing.
+	mStarted = false;
+	mCurrent = kEmptySummary;
+	mPeriodSum = 0;
+	mPeriods = 0;
+}
+
+long long ServoTiming::period() const
+{
+	return mPeriod;
+}
+
+int ServoTiming::window() const
+{
+	return mWindow;
+}
+
+void ServoTiming::beginTick()
+{
+	Clock::time_point now = Clock::now();
+	if (mStarted) {
+		long long period = std::chrono::duration_cast<std::chrono::microseconds>(now - mTickStart).count();
+		long long jitter = std::llabs(period - mPeriod);
+		mPeriodSum += period;
+		mPeriods++;
+		if (jitter > mCurrent.maxJitter)
+			mCurrent.maxJitter = jitter;
+	}
+	mTickStart = now;
+	mStarted = true;
+}
+
+void ServoTiming::endTick()
+{
+	long long busy = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - mTickStart).count();
+	if (busy > mCurrent.maxBusy)
+		mCurrent.maxBusy = busy;
+	if (busy > mPeriod)
+		mCurrent.overruns++;
+
+	if (++mCurrent.ticks < mWindow)
+		return;
+
+	// The very first tick has no period before it.
+	mCurrent.meanPeriod = mPeriods ? (double)mPeriodSum / mPeriods : 0.0;
+	// A full queue means nobody is reading; losing a window then costs nothing.
+	mFinished.push(mCurrent);
+	mCurrent = kEmptySummary;
+	mPeriodSum = 0;
+	mPeriods = 0;
+}
+
+void ServoTiming::noteDropped()
+{
+	mCurrent.dropped++;
+}
+
+bool ServoTiming::takeSummary(ServoSummary &summary)
+{
+	return mFinished.pop(summary);
+}
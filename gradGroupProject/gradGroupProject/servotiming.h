@@ -0,0 +1,67 @@
+#ifndef SERVOTIMING_H
+#define SERVOTIMING_H
+
+#include <chrono>
+#include "spscqueue.h"
+
+//! Timing of one window of servo ticks.  Times are in microseconds.
+//!
+struct ServoSummary {
+	int ticks;
+	double meanPeriod;            // between the starts of consecutive ticks
+	long long maxJitter;          // largest |period - the servo period|
+	long long maxBusy;            // longest time spent inside one tick
+	int overruns;                 // ticks busy for longer than the servo period
+	int dropped;                  // deformation targets the solver had no room for
+};
+
+//! The rate the servo loop runs at unless told otherwise, in ticks per
+//! second.
+const int kDefaultServoRate = 1000;
+
+//! Measures the servo loop from inside its own callback.
+//!
+//! The servo thread brackets each tick with beginTick() and endTick().  Each
+//! tick's budget is one period of the servo rate, and every second's worth of
+//! ticks it hands a ServoSummary to a queue that another thread drains with
+//! takeSummary(), so the servo side never locks, allocates or prints.
+class ServoTiming {
+	public:
+		explicit ServoTiming(int servoRate = kDefaultServoRate);
+
+		//! The rate the servo loop runs at, in ticks per second.  Not to be
+		//! called while the loop is running.
+		void setServoRate(int servoRate);
+
+		//! Microseconds per tick, and ticks per summary.
+		//!
+		long long period() const;
+		int window() const;
+
+		//! Servo thread: start and end of one tick.
+		//!
+		void beginTick();
+		void endTick();
+
+		//! Servo thread: a deformation target was dropped during this tick.
+		//!
+		void noteDropped();
+
+		//! Any one other thread: the oldest finished window, if there is one.
+		//!
+		bool takeSummary(ServoSummary &summary);
+
+	private:
+		typedef std::chrono::steady_clock Clock;
+
+		long long mPeriod;
+		int mWindow;
+		Clock::time_point mTickStart;
+		bool mStarted;
+		long long mPeriodSum;
+		int mPeriods;
+		ServoSummary mCurrent;
+		SPSCQueue<ServoSummary, 8> mFinished;
+	};
+
+#endif
@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <cstring>
+#include "sessiontrace.h"
+
+namespace {
+
+	const char kMagic[4] = { 'T', 'V', 'O', 'T' };
+
+	bool earlier(TraceRecord const &l, TraceRecord const &r)
+	{
+		return l.time < r.time;
+	}
+}
+
+TraceWriter::TraceWriter() :
+mFile(0),
+mDroppedTicks(0)
+{
+}
+
+TraceWriter::~TraceWriter()
+{
+	close();
+}
+
+bool TraceWriter::open(const char *filename)
+{
+	close();
+	mFile = fopen(filename, "wb");
+	if (!mFile)
+		return false;
+
+	TraceHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.version = kTraceVersion;
+	header.recordSize = sizeof(TraceRecord);
+	fwrite(&header, sizeof(header), 1, mFile);
+
+	mStart = Clock::now();
+	mDroppedTicks.store(0);
+	return true;
+}
+
+void TraceWriter::close()
+{
+	if (!mFile)
+		return;
+	flush();
+	fclose(mFile);
+	mFile = 0;
+}
+
+bool TraceWriter::isOpen() const
+{
+	return mFile != 0;
+}
+
+int TraceWriter::droppedTicks() const
+{
+	return mDroppedTicks.load();
+}
+
+TraceRecord TraceWriter::make(TraceRecordType type, int object, glm::vec3 const &a, glm::vec3 const &b) const
+{
+	TraceRecord record;
+	record.time = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - mStart).count();
+	record.type = (uint8_t)type;
+	record.value = 0;
+	record.object = (int16_t)object;
+	for (int i = 0; i < 3; i++) {
+		record.a[i] = a[i];
+		record.b[i] = b[i];
+	}
+	return record;
+}
+
+void TraceWriter::servo(glm::vec3 const &device, glm::vec3 const &deviceWorld, int buttons)
+{
+	TraceRecord record = make(TraceServo, -1, device, deviceWorld);
+	record.value = (uint8_t)buttons;
+	if (!mServo.push(record))
+		mDroppedTicks.fetch_add(1);
+}
+
+void TraceWriter::log(TraceRecord const &record)
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	mEvents.push_back(record);
+}
+
+void TraceWriter::touch(int object, glm::vec3 const &proxy)
+{
+	log(make(TraceTouch, object, proxy, glm::vec3(0.0f, 0.0f, 0.0f)));
+}
+
+void TraceWriter::motion(int object, glm::vec3 const &proxy)
+{
+	log(make(TraceMotion, object, proxy, glm::vec3(0.0f, 0.0f, 0.0f)));
+}
+
+void TraceWriter::untouch()
+{
+	log(make(TraceUntouch, -1, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f)));
+}
+
+void TraceWriter::key(char key, glm::vec3 const &device, glm::vec3 const &proxy)
+{
+	TraceRecord record = make(TraceKey, -1, device, proxy);
+	record.value = (uint8_t)key;
+	log(record);
+}
+
+void TraceWriter::transform(int object, double const worldToModel[16])
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	for (int half = 0; half < 2; half++) {
+		glm::vec3 rows[2];
+		for (int r = 0; r < 2; r++)
+			for (int c = 0; c < 3; c++)
+				rows[r][c] = (float)worldToModel[4 * (2 * half + r) + c];
+		TraceRecord record = make(TraceTransform, object, rows[0], rows[1]);
+		record.value = (uint8_t)half;
+		mEvents.push_back(record);
+	}
+}
+
+// Ticks and events are written as they come out of their queues; the two
+// streams interleave out of order, which readTrace() sorts out.
+void TraceWriter::flush()
+{
+	if (!mFile)
+		return;
+
+	mWriting.clear();
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		mWriting.swap(mEvents);
+	}
+	TraceRecord record;
+	while (mServo.pop(record))
+		mWriting.push_back(record);
+
+	if (!mWriting.empty())
+		fwrite(&mWriting[0], sizeof(TraceRecord), mWriting.size(), mFile);
+	fflush(mFile);
+}
+
+bool readTrace(const char *filename, std::vector<TraceRecord> &records)
+{
+	records.clear();
+	FILE *file = fopen(filename, "rb");
+	if (!file)
+		return false;
+
+	TraceHeader header;
+	bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+		memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 &&
+		header.version == kTraceVersion && header.recordSize == sizeof(TraceRecord);
+	if (valid) {
+		TraceRecord record;
+		while (fread(&record, sizeof(record), 1, file) == 1)
+			records.push_back(record);
+	}
+	fclose(file);
+
+	std::stable_sort(records.begin(), records.end(), earlier);
+	return valid;
+}
@@ -0,0 +1,119 @@
+#ifndef SESSIONTRACE_H
+#define SESSIONTRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+#include <glm/glm.hpp>
+#include "spscqueue.h"
+
+//! What a TraceRecord holds.  Positions are world space unless noted.
+//!
+//!   TraceServo    one servo tick: a = device in workspace, b = device in
+//!                 world, value = button bits
+//!   TraceTouch    object = touched object, a = proxy in its model space
+//!   TraceMotion   as TraceTouch
+//!   TraceUntouch  no data
+//!   TraceKey      value = the key ('A', 'E', 'T', 'Z', 'Y' or a brush key,
+//!                 see adjustBrush()), a = device in workspace, b = proxy
+//!   TraceTransform  object's world-to-model transform, in two records:
+//!                 value 0 has rows 0 and 1 in a and b, value 1 rows 2 and
+//!                 3, three columns each (the fourth is always 0 0 0 1)
+enum TraceRecordType {
+	TraceServo,
+	TraceTouch,
+	TraceMotion,
+	TraceUntouch,
+	TraceKey,
+	TraceTransform
+};
+
+//! One entry of a session trace; 32 bytes on disk.
+//!
+struct TraceRecord {
+	uint32_t time;                // microseconds since the trace started
+	uint8_t type;                 // a TraceRecordType
+	uint8_t value;
+	int16_t object;
+	float a[3];
+	float b[3];
+};
+
+//! Session trace files are a TraceHeader and then TraceRecords, in the order
+//! they were written; readers sort them by time.
+struct TraceHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t recordSize;
+	uint32_t reserved;
+};
+
+const uint32_t kTraceVersion = 1;
+
+//! Writes the device input of a live session to a trace file.
+//!
+//! The servo thread logs its ticks into a lock-free queue; the other threads
+//! log events under a lock the servo thread never takes.  flush(), called
+//! regularly from the client thread, empties both into the file.  Ticks that
+//! do not fit in the queue between flushes are dropped and counted.
+class TraceWriter {
+	public:
+		static const int kServoQueueSize = 8192;   // eight seconds at 1 kHz
+
+		TraceWriter();
+		~TraceWriter();
+
+		//! Starts a new trace; its clock starts now.
+		//!
+		bool open(const char *filename);
+		void close();
+		bool isOpen() const;
+
+		//! Servo thread.
+		//!
+		void servo(glm::vec3 const &device, glm::vec3 const &deviceWorld, int buttons);
+
+		//! Any other thread.
+		//!
+		void touch(int object, glm::vec3 const &proxy);
+		void motion(int object, glm::vec3 const &proxy);
+		void untouch();
+		void key(char key, glm::vec3 const &device, glm::vec3 const &proxy);
+
+		//! worldToModel is 16 doubles in OpenGL order.  Log it for every
+		//! object at the start and whenever it changes.
+		void transform(int object, double const worldToModel[16]);
+
+		//! Client thread: writes everything logged so far.
+		//!
+		void flush();
+
+		int droppedTicks() const;
+
+	private:
+		typedef std::chrono::steady_clock Clock;
+
+		TraceWriter(TraceWriter const &);
+		TraceWriter &operator=(TraceWriter const &);
+
+		TraceRecord make(TraceRecordType type, int object, glm::vec3 const &a, glm::vec3 const &b) const;
+		void log(TraceRecord const &record);
+
+		FILE *mFile;
+		Clock::time_point mStart;
+		SPSCQueue<TraceRecord, kServoQueueSize> mServo;
+		std::atomic<int> mDroppedTicks;
+
+		std::mutex mLock;
+		std::vector<TraceRecord> mEvents;
+		std::vector<TraceRecord> mWriting;  // flush() scratch
+	};
+
+//! Reads a trace file into records sorted by time.  Returns false if the
+//! file is missing or not a trace.
+bool readTrace(const char *filename, std::vector<TraceRecord> &records);
+
+#endif
@@ -0,0 +1,218 @@
+#include <chrono>
+#include <cstdio>
+#include "simdevice.h"
+
+SimulatedDevice::SimulatedDevice(int servoRate) :
+mServoRate(servoRate > 0 ? servoRate : 1000),
+mMotionTolerance(0.001f),
+mStopping(false),
+mFinished(false),
+mTicks(0),
+mCursor(0),
+mTouched(-1),
+mButton(false),
+mPublishedButton(false)
+{
+}
+
+SimulatedDevice::~SimulatedDevice()
+{
+	stop();
+}
+
+int SimulatedDevice::servoRate() const
+{
+	return mServoRate;
+}
+
+void SimulatedDevice::setTrajectory(std::vector<TrajectorySample> const &trajectory)
+{
+	mTrajectory = trajectory;
+	mTicks = 0;
+	mCursor = 0;
+	mFinished.store(trajectory.empty());
+}
+
+bool SimulatedDevice::loadTrajectory(const char *filename)
+{
+	FILE *file = fopen(filename, "r");
+	if (!file)
+		return false;
+
+	std::vector<TrajectorySample> trajectory;
+	char line[256];
+	while (fgets(line, sizeof(line), file)) {
+		if (line[0] == '#')
+			continue;
+		TrajectorySample s;
+		int button = 0;
+		if (sscanf(line, "%lf %f %f %f %d", &s.time, &s.position.x, &s.position.y, &s.position.z, &button) < 4)
+			continue;
+		s.button = button != 0;
+		trajectory.push_back(s);
+	}
+	fclose(file);
+
+	setTrajectory(trajectory);
+	return !trajectory.empty();
+}
+
+void SimulatedDevice::setContact(ContactFunction const &contact)
+{
+	mContact = contact;
+}
+
+void SimulatedDevice::setServo(ServoFunction const &servo)
+{
+	mServo = servo;
+}
+
+void SimulatedDevice::setMotionTolerance(float tolerance)
+{
+	mMotionTolerance = tolerance;
+}
+
+void SimulatedDevice::start()
+{
+	if (mThread.joinable())
+		return;
+	mStopping.store(false);
+	mThread = std::thread(&SimulatedDevice::run, this);
+}
+
+void SimulatedDevice::stop()
+{
+	if (!mThread.joinable())
+		return;
+	mStopping.store(true);
+	mThread.join();
+}
+
+bool SimulatedDevice::finished() const
+{
+	return mFinished.load();
+}
+
+// Ticks are scheduled against absolute times, so a late tick does not push
+// back the ones after it.
+void SimulatedDevice::run()
+{
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point begin = Clock::now();
+	std::chrono::nanoseconds period(1000000000LL / mServoRate);
+
+	for (long long i = 0; !mStopping.load(); i++) {
+		std::this_thread::sleep_until(begin + period * i);
+		double now = std::chrono::duration<double>(Clock::now() - begin).count();
+		if (!tick(now))
+			break;
+	}
+}
+
+bool SimulatedDevice::step()
+{
+	return tick((double)mTicks / mServoRate);
+}
+
+glm::vec3 SimulatedDevice::sample(double time, bool &button)
+{
+	// Ticks only move forward, so the cursor does too.
+	size_t &i = mCursor;
+	while (i + 1 < mTrajectory.size() && mTrajectory[i + 1].time <= time)
+		i++;
+	TrajectorySample const &a = mTrajectory[i];
+	button = a.button;
+	if (i + 1 == mTrajectory.size() || time <= a.time)
+		return a.position;
+
+	TrajectorySample const &b = mTrajectory[i + 1];
+	float t = (float)((time - a.time) / (b.time - a.time));
+	return a.position + (b.position - a.position) * t;
+}
+
+void SimulatedDevice::raise(DeviceEventType type, int object, glm::vec3 const &proxy, double time)
+{
+	DeviceEvent event;
+	event.type = type;
+	event.object = object;
+	event.proxy = proxy;
+	event.time = time;
+	// A client that stopped checking has no use for more events.
+	mEvents.push(event);
+}
+
+bool SimulatedDevice::tick(double time)
+{
+	if (mTrajectory.empty() || time > mTrajectory.back().time) {
+		mFinished.store(true);
+		return false;
+	}
+	mTicks++;
+
+	bool button;
+	glm::vec3 device = sample(time, button);
+	glm::vec3 proxy = device;
+	int touched = mContact ? mContact(device, proxy) : -1;
+
+	if (touched != mTouched) {
+		if (mTouched != -1)
+			raise(DeviceUntouch, -1, proxy, time);
+		if (touched != -1)
+			raise(DeviceTouch, touched, proxy, time);
+		mLastMotion = proxy;
+	}
+	else if (touched != -1) {
+		glm::vec3 d = proxy - mLastMotion;
+		if (glm::dot(d, d) > mMotionTolerance * mMotionTolerance) {
+			raise(DeviceMotion, touched, proxy, time);
+			mLastMotion = proxy;
+		}
+	}
+	mTouched = touched;
+
+	if (button != mButton)
+		raise(button ? DeviceButtonDown : DeviceButtonUp, touched, proxy, time);
+	mButton = button;
+
+	glm::vec3 force = mServo ? mServo(device) : glm::vec3(0.0f, 0.0f, 0.0f);
+
+	std::unique_lock<std::mutex> lock(mStateLock, std::try_to_lock);
+	if (lock.owns_lock()) {
+		mDevice = device;
+		mProxy = proxy;
+		mForce = force;
+		mPublishedButton = button;
+	}
+	return true;
+}
+
+void SimulatedDevice::checkEvents(std::function<void(DeviceEvent const &)> const &handler)
+{
+	DeviceEvent event;
+	while (mEvents.pop(event))
+		handler(event);
+}
+
+glm::vec3 SimulatedDevice::devicePosition() const
+{
+	std::lock_guard<std::mutex> lock(mStateLock);
+	return mDevice;
+}
+
+glm::vec3 SimulatedDevice::proxyPosition() const
+{
+	std::lock_guard<std::mutex> lock(mStateLock);
+	return mProxy;
+}
+
+bool SimulatedDevice::button() const
+{
+	std::lock_guard<std::mutex> lock(mStateLock);
+	return mPublishedButton;
+}
+
+glm::vec3 SimulatedDevice::force() const
+{
+	std::lock_guard<std::mutex> lock(mStateLock);
+	return mForce;
+}
@@ -0,0 +1,138 @@
+#ifndef SIMDEVICE_H
+#define SIMDEVICE_H
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+#include "spscqueue.h"
+
+//! One point of a scripted device trajectory.  Time is in seconds from the
+//! start; positions between points are interpolated linearly.
+struct TrajectorySample {
+	double time;
+	glm::vec3 position;
+	bool button;
+};
+
+enum DeviceEventType {
+	DeviceTouch,
+	DeviceUntouch,
+	DeviceMotion,
+	DeviceButtonDown,
+	DeviceButtonUp
+};
+
+//! What the HL event callbacks would have been told.  object is -1 for
+//! untouch and for button events off any object.
+struct DeviceEvent {
+	DeviceEventType type;
+	int object;
+	glm::vec3 proxy;
+	double time;
+};
+
+//! Stand-in for the haptic device that follows a scripted trajectory.
+//!
+//! Each servo tick moves the device along the trajectory, asks the contact
+//! function what it touches, calls the servo function for a force and queues
+//! touch, untouch, motion and button events the way HL raises them.  The
+//! client thread collects the events with checkEvents(), like hlCheckEvents().
+//!
+//! start() runs the ticks in real time on a thread of their own, at the
+//! servo rate.  step() runs one tick on the calling thread with the clock
+//! advanced by exactly one period, for runs that must repeat exactly.  The
+//! device is in world space: workspace and world coordinates coincide.
+class SimulatedDevice {
+	public:
+		//! Object touched by a device at position, or -1; sets proxy to where
+		//! the proxy would sit on it.
+		typedef std::function<int(glm::vec3 const &position, glm::vec3 &proxy)> ContactFunction;
+
+		//! Force for the device at position.
+		//!
+		typedef std::function<glm::vec3(glm::vec3 const &position)> ServoFunction;
+
+		static const int kEventQueueSize = 1024;
+
+		explicit SimulatedDevice(int servoRate = 1000);
+		~SimulatedDevice();
+
+		int servoRate() const;
+
+		void setTrajectory(std::vector<TrajectorySample> const &trajectory);
+
+		//! Reads a trajectory from a text file, one "time x y z button" line
+		//! per sample; lines starting with '#' are comments.
+		bool loadTrajectory(const char *filename);
+
+		void setContact(ContactFunction const &contact);
+		void setServo(ServoFunction const &servo);
+
+		//! Runs the servo loop in real time until the trajectory ends or
+		//! stop() is called.
+		void start();
+		void stop();
+
+		//! Runs one servo tick now.  Returns false once the trajectory is
+		//! over.  Not to be mixed with start().
+		bool step();
+
+		//! True once the last tick of the trajectory has run.
+		//!
+		bool finished() const;
+
+		//! Client thread: hands every queued event to handler, oldest first.
+		//!
+		void checkEvents(std::function<void(DeviceEvent const &)> const &handler);
+
+		//! Latest device and proxy positions, button state and force.
+		//!
+		glm::vec3 devicePosition() const;
+		glm::vec3 proxyPosition() const;
+		bool button() const;
+		glm::vec3 force() const;
+
+		//! Motion events are only raised once the proxy has moved this far.
+		//!
+		void setMotionTolerance(float tolerance);
+
+	private:
+		SimulatedDevice(SimulatedDevice const &);
+		SimulatedDevice &operator=(SimulatedDevice const &);
+
+		void run();
+		bool tick(double time);
+		glm::vec3 sample(double time, bool &button);
+		void raise(DeviceEventType type, int object, glm::vec3 const &proxy, double time);
+
+		int mServoRate;
+		std::vector<TrajectorySample> mTrajectory;
+		ContactFunction mContact;
+		ServoFunction mServo;
+		float mMotionTolerance;
+
+		std::thread mThread;
+		std::atomic<bool> mStopping;
+		std::atomic<bool> mFinished;
+		long long mTicks;
+
+		// Servo thread state.
+		size_t mCursor;               // trajectory sample at or before the last tick
+		int mTouched;
+		bool mButton;
+		glm::vec3 mLastMotion;
+		SPSCQueue<DeviceEvent, kEventQueueSize> mEvents;
+
+		// Published for other threads.  The servo thread only try_locks, and
+		// skips publishing for a tick when a reader holds the lock.
+		mutable std::mutex mStateLock;
+		glm::vec3 mDevice;
+		glm::vec3 mProxy;
+		glm::vec3 mForce;
+		bool mPublishedButton;
+	};
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef SPAN_H
+#define SPAN_H
+
+#include <cstddef>
+#include <vector>
+
+//! Read-only, non-owning view of a contiguous array.
+//!
+//! Handing one out costs two words; nothing is copied.  The view is only valid
+//! while the array it was taken from is neither resized nor destroyed.
+template <typename T>
+class ConstSpan {
+	public:
+		ConstSpan() : mData(0), mSize(0) {}
+		ConstSpan(T const *data, std::size_t size) : mData(data), mSize(size) {}
+		ConstSpan(std::vector<T> const &v) : mData(v.empty() ? 0 : &v[0]), mSize(v.size()) {}
+
+		T const &operator[](std::size_t i) const { return mData[i]; }
+		T const *data() const { return mData; }
+		T const *begin() const { return mData; }
+		T const *end() const { return mData + mSize; }
+		std::size_t size() const { return mSize; }
+		bool empty() const { return mSize == 0; }
+
+	private:
+		T const *mData;
+		std::size_t mSize;
+	};
+
+#endif
@@ -0,0 +1,363 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <utility>
+#include "spatialgrid.h"
+
+namespace {
+
+	const int kMaxDim = 1024;        // cells along one axis
+	const int kCellsPerPoint = 4;    // surface meshes leave most cells empty
+	const int kMinMovedBeforeRebuild = 256;
+
+	float distance2(glm::vec3 const &a, glm::vec3 const &b)
+	{
+		float dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+		return dx * dx + dy * dy + dz * dz;
+	}
+
+	// Closest point so far, with ties going to the lower index.
+	struct NearestVisitor {
+		std::vector<glm::vec3> const &points;
+		std::vector<int> const &start;
+		std::vector<int> const &items;
+		std::vector<char> const &moved;
+		glm::vec3 p;
+		float bestDist;
+		int best;
+
+		NearestVisitor(std::vector<glm::vec3> const &pts, std::vector<int> const &s,
+			std::vector<int> const &it, std::vector<char> const &m, glm::vec3 const &q) :
+		points(pts), start(s), items(it), moved(m), p(q), bestDist(FLT_MAX), best(-1) {}
+
+		void consider(int id)
+		{
+			float d = distance2(p, points[id]);
+			if (d < bestDist || (d == bestDist && id < best)) {
+				bestDist = d;
+				best = id;
+			}
+		}
+
+		void operator()(int cell)
+		{
+			for (int i = start[cell]; i < start[cell + 1]; i++)
+				if (!moved[items[i]])
+					consider(items[i]);
+		}
+	};
+
+	// Bounded max-heap of the k closest points so far.
+	struct KNearestVisitor {
+		typedef std::pair<float, int> Entry;
+
+		std::vector<glm::vec3> const &points;
+		std::vector<int> const &start;
+		std::vector<int> const &items;
+		std::vector<char> const &moved;
+		glm::vec3 p;
+		size_t k;
+		std::vector<Entry> heap;
+
+		KNearestVisitor(std::vector<glm::vec3> const &pts, std::vector<int> const &s,
+			std::vector<int> const &it, std::vector<char> const &m, glm::vec3 const &q, size_t count) :
+		points(pts), start(s), items(it), moved(m), p(q), k(count)
+		{
+			heap.reserve(k + 1);
+		}
+
+		bool full() const { return heap.size() == k; }
+		float worst() const { return heap.front().first; }
+
+		void consider(int id)
+		{
+			Entry e(distance2(p, points[id]), id);
+			if (!full()) {
+				heap.push_back(e);
+				std::push_heap(heap.begin(), heap.end());
+			}
+			else if (e < heap.front()) {
+				std::pop_heap(heap.begin(), heap.end());
+				heap.back() = e;
+				std::push_heap(heap.begin(), heap.end());
+			}
+		}
+
+		void operator()(int cell)
+		{
+			for (int i = start[cell]; i < start[cell + 1]; i++)
+				if (!moved[items[i]])
+					consider(items[i]);
+		}
+	};
+}
+
+SpatialGrid::SpatialGrid() :
+mOrigin(0.0f, 0.0f, 0.0f),
+mCellSize(1.0f),
+mInvCellSize(1.0f)
+{
+	mDims[0] = mDims[1] = mDims[2] = 0;
+}
+
+void SpatialGrid::clear()
+{
+	mDims[0] = mDims[1] = mDims[2] = 0;
+	mCellStart.clear();
+	mCellItems.clear();
+	mPointCell.clear();
+	mIsMoved.clear();
+	mMoved.clear();
+}
+
+bool SpatialGrid::empty() const
+{
+	return mPointCell.empty();
+}
+
+void SpatialGrid::build(std::vector<glm::vec3> const &points)
+{
+	clear();
+	if (points.empty())
+		return;
+
+	glm::vec3 lo = points[0], hi = points[0];
+	for (size_t i = 1; i < points.size(); i++) {
+		lo = glm::min(lo, points[i]);
+		hi = glm::max(hi, points[i]);
+	}
+	glm::vec3 extent = hi - lo;
+	float maxExtent = glm::max(glm::max(extent.x, extent.y), extent.z);
+	if (maxExtent <= 0.0f)
+		maxExtent = 1.0f;
+
+	// Pick a cubic cell so that the grid holds roughly kCellsPerPoint cells per
+	// point.  Flat axes are padded to one cell so they do not shrink the cells.
+	float target = (float)points.size() * kCellsPerPoint;
+	float h = maxExtent / std::pow(target, 1.0f / 3.0f);
+	for (int iter = 0; iter < 4; iter++) {
+		float volume = glm::max(extent.x, h) * glm::max(extent.y, h) * glm::max(extent.z, h);
+		h = std::pow(volume / target, 1.0f / 3.0f);
+	}
+	h = glm::max(h, maxExtent / (kMaxDim - 1));
+
+	mOrigin = lo;
+	mCellSize = h;
+	mInvCellSize = 1.0f / h;
+	for (int a = 0; a < 3; a++)
+		mDims[a] = glm::min((int)(extent[a] * mInvCellSize) + 1, kMaxDim);
+
+	int cellCount = mDims[0] * mDims[1] * mDims[2];
+	mPointCell.resize(points.size());
+	mIsMoved.assign(points.size(), 0);
+	mCellStart.assign(cellCount + 1, 0);
+
+	// Counting sort of point indices by cell.
+	for (size_t i = 0; i < points.size(); i++) {
+		int c[3];
+		clampedCoords(points[i], c);
+		mPointCell[i] = (c[2] * mDims[1] + c[1]) * mDims[0] + c[0];
+		mCellStart[mPointCell[i] + 1]++;
+	}
+	for (int c = 0; c < cellCount; c++)
+		mCellStart[c + 1] += mCellStart[c];
+
+	mCellItems.resize(points.size());
+	std::vector<int> fill(mCellStart.begin(), mCellStart.end() - 1);
+	for (size_t i = 0; i < points.size(); i++)
+		mCellItems[fill[mPointCell[i]]++] = (int)i;
+}
+
+bool SpatialGrid::assign(std::vector<glm::vec3> const &points, glm::vec3 const &origin, float cellSize,
+	int const dims[3], std::vector<int> &cellStart, std::vector<int> &cellItems)
+{
+	clear();
+	if (!(cellSize > 0.0f) || cellItems.size() != points.size())
+		return false;
+	size_t cellCount = 1;
+	for (int a = 0; a < 3; a++) {
+		if (dims[a] < 1 || dims[a] > kMaxDim)
+			return false;
+		cellCount *= (size_t)dims[a];
+	}
+	if (cellStart.size() != cellCount + 1 || cellStart[0] != 0 || cellStart[cellCount] != (int)points.size())
+		return false;
+
+	// Every point must be in exactly one cell.
+	std::vector<int> pointCell(points.size(), -1);
+	for (size_t c = 0; c < cellCount; c++) {
+		if (cellStart[c] > cellStart[c + 1])
+			return false;
+		for (int i = cellStart[c]; i < cellStart[c + 1]; i++) {
+			int id = cellItems[i];
+			if (id < 0 || (size_t)id >= points.size() || pointCell[id] >= 0)
+				return false;
+			pointCell[id] = (int)c;
+		}
+	}
+
+	mOrigin = origin;
+	mCellSize = cellSize;
+	mInvCellSize = 1.0f / cellSize;
+	for (int a = 0; a < 3; a++)
+		mDims[a] = dims[a];
+	mCellStart.swap(cellStart);
+	mCellItems.swap(cellItems);
+	mPointCell.swap(pointCell);
+	mIsMoved.assign(points.size(), 0);
+
+	// The same test as update(), for points saved after they had moved.
+	for (size_t i = 0; i < points.size(); i++) {
+		if (cellOf(points[i]) != mPointCell[i]) {
+			mIsMoved[i] = 1;
+			mMoved.push_back((int)i);
+		}
+	}
+	if ((int)mMoved.size() > glm::max(kMinMovedBeforeRebuild, (int)points.size() / 32))
+		build(points);
+	return true;
+}
+
+void SpatialGrid::update(std::vector<glm::vec3> const &points, int id)
+{
+	if (empty() || mIsMoved[id])
+		return;
+	if (cellOf(points[id]) == mPointCell[id])
+		return;
+
+	mIsMoved[id] = 1;
+	mMoved.push_back(id);
+	if ((int)mMoved.size() > glm::max(kMinMovedBeforeRebuild, (int)points.size() / 32))
+		build(points);
+}
+
+void SpatialGrid::clampedCoords(glm::vec3 const &p, int c[3]) const
+{
+	for (int a = 0; a < 3; a++) {
+		float f = (p[a] - mOrigin[a]) * mInvCellSize;
+		c[a] = f <= 0.0f ? 0 : glm::min((int)f, mDims[a] - 1);
+	}
+}
+
+// Cell index of p, or -1 when p lies outside the grid bounds.
+int SpatialGrid::cellOf(glm::vec3 const &p) const
+{
+	int c[3];
+	for (int a = 0; a < 3; a++) {
+		float f = (p[a] - mOrigin[a]) * mInvCellSize;
+		if (f < 0.0f || f >= (float)mDims[a])
+			return -1;
+		c[a] = (int)f;
+	}
+	return (c[2] * mDims[1] + c[1]) * mDims[0] + c[0];
+}
+
+// Visits every in-bounds cell whose Chebyshev distance from c is exactly ring.
+// Returns false once the ring lies entirely outside the grid.
+template <typename Visitor>
+bool SpatialGrid::visitRing(int const c[3], int ring, Visitor &visit) const
+{
+	int lo[3], hi[3];
+	for (int a = 0; a < 3; a++) {
+		lo[a] = glm::max(c[a] - ring, 0);
+		hi[a] = glm::min(c[a] + ring, mDims[a] - 1);
+	}
+	if (ring > 0 &&
+		c[0] - ring < 0 && c[0] + ring >= mDims[0] &&
+		c[1] - ring < 0 && c[1] + ring >= mDims[1] &&
+		c[2] - ring < 0 && c[2] + ring >= mDims[2])
+		return false;
+
+	for (int z = lo[2]; z <= hi[2]; z++) {
+		bool zShell = (z == c[2] - ring || z == c[2] + ring);
+		for (int y = lo[1]; y <= hi[1]; y++) {
+			bool yShell = zShell || (y == c[1] - ring || y == c[1] + ring);
+			int row = (z * mDims[1] + y) * mDims[0];
+			if (yShell) {
+				for (int x = lo[0]; x <= hi[0]; x++)
+					visit(row + x);
+			}
+			else {
+				if (c[0] - ring >= 0)
+					visit(row + c[0] - ring);
+				if (ring > 0 && c[0] + ring < mDims[0])
+					visit(row + c[0] + ring);
+			}
+		}
+	}
+	return true;
+}
+
+int SpatialGrid::nearest(std::vector<glm::vec3> const &points, glm::vec3 const &p) const
+{
+	if (empty())
+		return -1;
+
+	NearestVisitor visit(points, mCellStart, mCellItems, mIsMoved, p);
+	for (size_t i = 0; i < mMoved.size(); i++)
+		visit.consider(mMoved[i]);
+
+	// Cells on ring r + 1 are at least r cells away from p, so the search can
+	// stop as soon as the best candidate is closer than that.
+	int c[3];
+	clampedCoords(p, c);
+	for (int ring = 0; visitRing(c, ring, visit); ring++) {
+		float bound = ring * mCellSize;
+		if (visit.best != -1 && visit.bestDist < bound * bound)
+			break;
+	}
+	return visit.best;
+}
+
+void SpatialGrid::kNearest(std::vector<glm::vec3> const &points, glm::vec3 const &p,
+	int k, std::vector<int> &out) const
+{
+	out.clear();
+	if (empty() || k <= 0)
+		return;
+
+	KNearestVisitor visit(points, mCellStart, mCellItems, mIsMoved, p,
+		glm::min((size_t)k, points.size()));
+	for (size_t i = 0; i < mMoved.size(); i++)
+		visit.consider(mMoved[i]);
+
+	int c[3];
+	clampedCoords(p, c);
+	for (int ring = 0; visitRing(c, ring, visit); ring++) {
+		float bound = ring * mCellSize;
+		if (visit.full() && visit.worst() < bound * bound)
+			break;
+	}
+
+	std::sort_heap(visit.heap.begin(), visit.heap.end());
+	out.resize(visit.heap.size());
+	for (size_t i = 0; i < visit.heap.size(); i++)
+		out[i] = visit.heap[i].second;
+}
+
+void SpatialGrid::withinRadius(std::vector<glm::vec3> const &points, glm::vec3 const &p,
+	float radius, std::vector<int> &out) const
+{
+	out.clear();
+	if (empty() || radius < 0.0f)
+		return;
+
+	float r2 = radius * radius;
+	for (size_t i = 0; i < mMoved.size(); i++)
+		if (distance2(p, points[mMoved[i]]) <= r2)
+			out.push_back(mMoved[i]);
+
+	int lo[3], hi[3];
+	clampedCoords(p - glm::vec3(radius, radius, radius), lo);
+	clampedCoords(p + glm::vec3(radius, radius, radius), hi);
+	for (int z = lo[2]; z <= hi[2]; z++)
+		for (int y = lo[1]; y <= hi[1]; y++)
+			for (int x = lo[0]; x <= hi[0]; x++) {
+				int cell = (z * mDims[1] + y) * mDims[0] + x;
+				for (int i = mCellStart[cell]; i < mCellStart[cell + 1]; i++) {
+					int id = mCellItems[i];
+					if (!mIsMoved[id] && distance2(p, points[id]) <= r2)
+						out.push_back(id);
+				}
+			}
+}
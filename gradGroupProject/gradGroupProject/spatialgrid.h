@@ -0,0 +1,78 @@
+#ifndef SPATIALGRID_H
+#define SPATIALGRID_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+//! Uniform grid over a point set used to answer nearest, k-nearest and radius
+//! queries without scanning every point.
+//!
+//! The grid stores point indices only; callers pass the position array to each
+//! query so the grid stays valid when its owner is copied.  Points that leave
+//! the cell they were binned into are kept on a small "moved" list that every
+//! query scans linearly, and the grid is rebuilt once that list grows too long.
+class SpatialGrid {
+	public:
+		SpatialGrid();
+
+		//! Bins every point into the grid, replacing any previous contents.
+		//!
+		void build(std::vector<glm::vec3> const &points);
+
+		//! Takes back a grid saved from the accessors below, without binning
+		//! the points again.  Points that are no longer in the cell they were
+		//! saved in go on the moved list.  Returns false, leaving the grid
+		//! empty, if the arrays do not describe a grid over points.
+		bool assign(std::vector<glm::vec3> const &points, glm::vec3 const &origin, float cellSize,
+			int const dims[3], std::vector<int> &cellStart, std::vector<int> &cellItems);
+
+		//! Drops all cells and points.
+		//!
+		void clear();
+
+		//! Must be called after points[id] has been moved.
+		//!
+		void update(std::vector<glm::vec3> const &points, int id);
+
+		bool empty() const;
+
+		//! Index of the point closest to p, or -1 if the grid is empty.  Ties are
+		//! broken towards the lower index, matching a linear scan.
+		int nearest(std::vector<glm::vec3> const &points, glm::vec3 const &p) const;
+
+		//! The k points closest to p, ordered by increasing distance.
+		//!
+		void kNearest(std::vector<glm::vec3> const &points, glm::vec3 const &p,
+			int k, std::vector<int> &out) const;
+
+		//! Every point within radius of p, in no particular order.
+		//!
+		void withinRadius(std::vector<glm::vec3> const &points, glm::vec3 const &p,
+			float radius, std::vector<int> &out) const;
+
+		//! The grid as last built, for storing it with the points.  Points
+		//! moved since are still in the cell they were built into.
+		glm::vec3 const &origin() const { return mOrigin; }
+		float cellSize() const { return mCellSize; }
+		int const *dims() const { return mDims; }
+		std::vector<int> const &cellStarts() const { return mCellStart; }
+		std::vector<int> const &cellItems() const { return mCellItems; }
+
+	private:
+		int cellOf(glm::vec3 const &p) const;
+		void clampedCoords(glm::vec3 const &p, int c[3]) const;
+		template <typename Visitor> bool visitRing(int const c[3], int ring, Visitor &visit) const;
+
+		glm::vec3 mOrigin;
+		float mCellSize;
+		float mInvCellSize;
+		int mDims[3];
+
+		std::vector<int> mCellStart;  // CSR offsets, one per cell plus one
+		std::vector<int> mCellItems;  // point indices grouped by cell
+		std::vector<int> mPointCell;  // cell each point was binned into at build time
+		std::vector<char> mIsMoved;   // points that left their cell since the last build
+		std::vector<int> mMoved;
+	};
+
+#endif
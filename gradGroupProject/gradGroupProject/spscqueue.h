@@ -0,0 +1,62 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+//! Bounded single-producer, single-consumer ring buffer.
+//!
+//! push() and pop() never block and never allocate: each side owns one index
+//! and only reads the other's, so one thread may push while another pops
+//! without a lock.  Capacity must be a power of two; one slot is kept free to
+//! tell a full ring from an empty one.
+template <typename T, size_t Capacity>
+class SPSCQueue {
+	public:
+		SPSCQueue() : mHead(0), mTail(0) {}
+
+		//! Producer: appends item, or returns false if the ring is full.
+		//!
+		bool push(T const &item)
+		{
+			size_t tail = mTail.load(std::memory_order_relaxed);
+			size_t next = (tail + 1) & kMask;
+			if (next == mHead.load(std::memory_order_acquire))
+				return false;
+			mItems[tail] = item;
+			mTail.store(next, std::memory_order_release);
+			return true;
+		}
+
+		//! Consumer: removes the oldest item into item, or returns false if
+		//! the ring is empty.
+		bool pop(T &item)
+		{
+			size_t head = mHead.load(std::memory_order_relaxed);
+			if (head == mTail.load(std::memory_order_acquire))
+				return false;
+			item = mItems[head];
+			mHead.store((head + 1) & kMask, std::memory_order_release);
+			return true;
+		}
+
+		//! Consumer: true if there is nothing to pop.
+		//!
+		bool empty() const
+		{
+			return mHead.load(std::memory_order_relaxed) == mTail.load(std::memory_order_acquire);
+		}
+
+	private:
+		static const size_t kMask = Capacity - 1;
+		static_assert(Capacity >= 2 && (Capacity & kMask) == 0, "SPSCQueue capacity must be a power of two");
+
+		SPSCQueue(SPSCQueue const &);
+		SPSCQueue &operator=(SPSCQueue const &);
+
+		T mItems[Capacity];
+		std::atomic<size_t> mHead;    // next slot to pop, written by the consumer
+		std::atomic<size_t> mTail;    // next slot to push, written by the producer
+	};
+
+#endif
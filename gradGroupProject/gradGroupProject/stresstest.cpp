@@ -0,0 +1,211 @@
+// Stress test for the threads that share a mesh: the servo and solver threads
+// edit it, a collision thread queries it and the graphics thread keeps its
+// own copy.  A separate program built by the CMake build, which runs it
+// under ThreadSanitizer where the compiler supports it; not part of the
+// Visual Studio project.
+//
+//   stresstest [--soa] mesh.obj
+//
+// A SimulatedDevice in real time anchors edits on a spread of vertices and
+// pulls them about while the collision thread runs the HL shape's queries
+// flat out and the main thread handles device events and updates the
+// normals at the frame rate.  Once every thread has stopped, the graphics
+// copy, the normals and the spatial indices must all agree with the edited
+// mesh.  Exits with 1 if anything disagrees or nothing was edited.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "interaction.h"
+#include "objloader.h"
+#include "scene.h"
+#include "simdevice.h"
+
+namespace {
+
+	const float kContactDistance = 0.02f;
+	const int kFrameRate = 60;
+	const int kEdits = 8;                 // anchored edits in the trajectory
+	const double kEditSeconds = 0.4;
+	const double kIdentity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+	// Sits on each of kEdits vertices spread over the mesh, presses the
+	// button, pulls away and lets go.
+	std::vector<TrajectorySample> editTrajectory(OBJLoader const &loader)
+	{
+		std::vector<glm::vec3> const &points = loader.getVertices();
+		glm::vec3 pull(0.05f, 0.08f, 0.03f);
+		std::vector<TrajectorySample> path;
+		for (int i = 0; i < kEdits; i++) {
+			glm::vec3 point = points[(points.size() - 1) * i / (kEdits - 1)];
+			double begin = i * kEditSeconds;
+			TrajectorySample samples[] = {
+				{ begin, point, false },
+				{ begin + 0.1 * kEditSeconds, point, true },
+				{ begin + 0.8 * kEditSeconds, point + pull, true },
+				{ begin + 0.9 * kEditSeconds, point + pull, false }
+			};
+			path.insert(path.end(), samples, samples + 4);
+		}
+		return path;
+	}
+
+	// What the HL shape asks of the mesh while the device is near it.
+	void collide(OBJLoader const &loader, std::atomic<bool> const &stop, long &queries)
+	{
+		std::vector<int> inRadius;
+		SurfacePoint point;
+		for (size_t i = 0; !stop.load(); i++) {
+			// Only the editor may read the positions while it runs, so walk a
+			// fixed line through the unit box instead.
+			float t = (float)(i % 1024) / 1024.0f;
+			glm::vec3 p(t - 0.5f, 0.5f - t, 0.25f * t);
+			loader.nearestVertex(p);
+			if (loader.closestPoint(p, point))
+				loader.frictionAt(point);
+			loader.verticesInRadius(p, 0.1f, inRadius);
+			queries++;
+		}
+	}
+
+	int check(OBJLoader &loader)
+	{
+		int failures = 0;
+		std::vector<glm::vec3> const &points = loader.getVertices();
+		MeshView view = loader.view();
+		size_t different = 0;
+		for (size_t v = 0; v < points.size(); v++)
+			if (!(view.positions[v] == points[v]))
+				different++;
+		if (different) {
+			printf("FAIL: %zu drawn positions differ from the mesh\n", different);
+			failures++;
+		}
+
+		std::vector<glm::vec3> normals;
+		loader.computeNormals(points, loader.getVertexIndices(), normals);
+		different = 0;
+		for (size_t v = 0; v < points.size(); v++)
+			if (!(view.normals[v] == normals[v]))
+				different++;
+		if (different) {
+			printf("FAIL: %zu drawn normals differ from a full recompute\n", different);
+			failures++;
+		}
+
+		// The grid and the BVH in the latest snapshot against brute force, at
+		// every vertex nudged off the surface.
+		different = 0;
+		for (size_t v = 0; v < points.size(); v += 7) {
+			glm::vec3 p = points[v] + glm::vec3(0.01f, -0.02f, 0.015f);
+			int indexed = loader.nearestVertex(p), linear = loader.nearestVertexLinear(p);
+			if (indexed < 0 || glm::length(points[indexed] - p) != glm::length(points[linear] - p))
+				different++;
+			SurfacePoint point;
+			if (!loader.closestPoint(p, point) || point.distance2 > glm::dot(points[linear] - p, points[linear] - p))
+				different++;
+		}
+		if (different) {
+			printf("FAIL: %zu queries disagree with brute force\n", different);
+			failures++;
+		}
+		return failures;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const char *meshFile = 0;
+	bool soa = false;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--soa"))
+			soa = true;
+		else
+			meshFile = argv[i];
+	}
+	if (!meshFile) {
+		fprintf(stderr, "usage: stresstest [--soa] mesh.obj\n");
+		return 2;
+	}
+
+	Scene scene;
+	scene.addObject(meshFile);
+	if (!scene.loadMeshes(2)) {
+		fprintf(stderr, "Could not load %s\n", meshFile);
+		return 2;
+	}
+	OBJLoader &loader = scene.loader(0);
+	if (soa)
+		loader.setVertexLayout(VertexLayoutSoA);
+
+	Interaction interaction;
+	interaction.setScene(&scene);
+	SimulatedDevice device;
+	device.setTrajectory(editTrajectory(loader));
+	device.setContact([&](glm::vec3 const &position, glm::vec3 &proxy) {
+		SurfacePoint point;
+		if (!loader.closestPoint(position, point) || point.distance2 > kContactDistance * kContactDistance)
+			return -1;
+		proxy = point.position;
+		return 0;
+	});
+	device.setServo([&](glm::vec3 const &position) {
+		glm::vec3 force(0.0f, 0.0f, 0.0f);
+		interaction.servoTick(position, position, force);
+		return force;
+	});
+
+	int anchors = 0;
+	std::function<void(DeviceEvent const &)> handle = [&](DeviceEvent const &event) {
+		switch (event.type) {
+		case DeviceTouch:
+			interaction.touch(event.object, event.proxy);
+			break;
+		case DeviceMotion:
+			interaction.motion(event.object, event.proxy);
+			break;
+		case DeviceUntouch:
+			interaction.untouch();
+			break;
+		case DeviceButtonDown:
+			if (interaction.beginAnchor(device.devicePosition(), device.devicePosition(), event.proxy, kIdentity))
+				anchors++;
+			break;
+		case DeviceButtonUp:
+			interaction.endAnchor();
+			break;
+		}
+	};
+
+	std::atomic<bool> stop(false);
+	long queries = 0;
+	std::thread collision(collide, std::cref(loader), std::cref(stop), std::ref(queries));
+	interaction.start();
+	device.start();
+	int frames = 0;
+	while (!device.finished()) {
+		device.checkEvents(handle);
+		loader.updateNormals();
+		frames++;
+		std::this_thread::sleep_for(std::chrono::microseconds(1000000 / kFrameRate));
+	}
+	device.stop();
+	device.checkEvents(handle);
+	interaction.stop();
+	stop.store(true);
+	collision.join();
+	loader.updateNormals();
+
+	int edits = interaction.solver().applied();
+	printf("%s: %d frames, %ld queries, %d anchors, %d edits applied\n", meshFile, frames, queries, anchors, edits);
+	int failures = check(loader);
+	if (edits == 0) {
+		printf("FAIL: no edits applied\n");
+		failures++;
+	}
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,95 @@
+#include <algorithm>
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(int threads) :
+mTask(0),
+mCount(0),
+mNext(0),
+mPending(0),
+mActive(0),
+mGeneration(0),
+mStopping(false)
+{
+	for (int i = 1; i < threads; i++)
+		mWorkers.push_back(std::thread(&ThreadPool::workerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		mStopping = true;
+	}
+	mWake.notify_all();
+	for (size_t i = 0; i < mWorkers.size(); i++)
+		mWorkers[i].join();
+}
+
+ThreadPool &ThreadPool::shared()
+{
+	static ThreadPool pool((int)std::max(1u, std::thread::hardware_concurrency()));
+	return pool;
+}
+
+void ThreadPool::run(int count, std::function<void(int)> const &task)
+{
+	if (count <= 0)
+		return;
+
+	std::lock_guard<std::mutex> batch(mRunLock);
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		mTask = &task;
+		mCount = count;
+		mNext.store(0);
+		mPending = count;
+		mGeneration++;
+	}
+	mWake.notify_all();
+
+	int finished = drain(task, count);
+
+	// Wait for the tasks and for every worker to leave this batch, so that no
+	// straggler can claim an index from the next one.
+	std::unique_lock<std::mutex> lock(mLock);
+	mPending -= finished;
+	mDone.wait(lock, [this] { return mPending == 0 && mActive == 0; });
+	mTask = 0;
+}
+
+// Claims and runs tasks of the current batch until none are left.  Returns
+// how many this thread ran.
+int ThreadPool::drain(std::function<void(int)> const &task, int count)
+{
+	int finished = 0;
+	for (int i = mNext.fetch_add(1); i < count; i = mNext.fetch_add(1)) {
+		task(i);
+		finished++;
+	}
+	return finished;
+}
+
+void ThreadPool::workerLoop()
+{
+	unsigned seen = 0;
+	std::unique_lock<std::mutex> lock(mLock);
+	for (;;) {
+		mWake.wait(lock, [&] { return mStopping || mGeneration != seen; });
+		if (mStopping)
+			return;
+		seen = mGeneration;
+		if (mPending == 0)
+			continue;
+
+		std::function<void(int)> const *task = mTask;
+		int count = mCount;
+		mActive++;
+		lock.unlock();
+		int finished = drain(*task, count);
+		lock.lock();
+		mActive--;
+		mPending -= finished;
+		if (mPending == 0 && mActive == 0)
+			mDone.notify_all();
+	}
+}
@@ -0,0 +1,77 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! Fixed set of worker threads that run batches of indexed tasks.
+//!
+//! run() hands out task indices to the workers and the calling thread and
+//! returns once every task has finished.  Only one batch runs at a time;
+//! concurrent callers are serialized.
+class ThreadPool {
+	public:
+		explicit ThreadPool(int threads);
+		~ThreadPool();
+
+		//! Number of threads a batch can use, including the caller.
+		//!
+		int size() const { return (int)mWorkers.size() + 1; }
+
+		//! Runs task(i) for every i in [0, count).
+		//!
+		void run(int count, std::function<void(int)> const &task);
+
+		//! Process-wide pool with one thread per hardware thread.
+		//!
+		static ThreadPool &shared();
+
+	private:
+		ThreadPool(ThreadPool const &);
+		ThreadPool &operator=(ThreadPool const &);
+
+		void workerLoop();
+		int drain(std::function<void(int)> const &task, int count);
+
+		std::vector<std::thread> mWorkers;
+		std::mutex mRunLock;        // one batch at a time
+		std::mutex mLock;
+		std::condition_variable mWake;
+		std::condition_variable mDone;
+
+		std::function<void(int)> const *mTask;
+		int mCount;
+		std::atomic<int> mNext;
+		int mPending;               // tasks not yet finished, guarded by mLock
+		int mActive;                // workers inside the current batch, guarded by mLock
+		unsigned mGeneration;
+		bool mStopping;
+	};
+
+//! Splits [0, count) into at most `threads` contiguous ranges and calls
+//! body(begin, end) for each, in parallel on the shared pool.  With one
+//! thread the body simply runs inline.
+template <typename Body>
+void parallelFor(int threads, size_t count, Body body)
+{
+	if (threads > ThreadPool::shared().size())
+		threads = ThreadPool::shared().size();
+	if (threads <= 1 || count < 2) {
+		body((size_t)0, count);
+		return;
+	}
+	if ((size_t)threads > count)
+		threads = (int)count;
+
+	std::function<void(int)> task = [&](int i) {
+		body(count * i / threads, count * (i + 1) / threads);
+	};
+	ThreadPool::shared().run(threads, task);
+}
+
+#endif
@@ -0,0 +1,181 @@
+#include <chrono>
+#include <thread>
+#include "interaction.h"
+#include "objloader.h"
+#include "scene.h"
+#include "tracereplay.h"
+
+namespace {
+
+	typedef std::chrono::steady_clock Clock;
+
+	long long since(Clock::time_point start)
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+	}
+
+	glm::vec3 toVec3(float const v[3])
+	{
+		return glm::vec3(v[0], v[1], v[2]);
+	}
+}
+
+TraceReplay::TraceReplay(Interaction &interaction, Scene &scene) :
+mInteraction(interaction),
+mScene(scene),
+mRealTime(false),
+mFrameRate(60),
+mAnchoredEditing(false),
+mProxyConstrained(false),
+mTouching(false),
+mDeviceWorld(0.0f, 0.0f, 0.0f)
+{
+	mStats.servoTicks = mStats.events = mStats.frames = 0;
+	mWorldToModel.assign(16 * scene.objectCount(), 0.0);
+	for (size_t i = 0; i < mWorldToModel.size(); i++)
+		mWorldToModel[i] = i % 5 == 0 ? 1.0 : 0.0;
+}
+
+void TraceReplay::setRealTime(bool realTime)
+{
+	mRealTime = realTime;
+}
+
+void TraceReplay::setFrameRate(int frameRate)
+{
+	mFrameRate = frameRate > 0 ? frameRate : 60;
+}
+
+void TraceReplay::setDraw(std::function<void()> const &draw)
+{
+	mDraw = draw;
+}
+
+ReplayStats const &TraceReplay::stats() const
+{
+	return mStats;
+}
+
+void TraceReplay::run(std::vector<TraceRecord> const &records)
+{
+	Clock::time_point start = Clock::now();
+	long long framePeriod = 1000000 / mFrameRate;
+	long long nextFrame = 0;
+
+	for (size_t i = 0; i < records.size(); i++) {
+		TraceRecord const &record = records[i];
+		while (record.time >= nextFrame) {
+			frame();
+			nextFrame += framePeriod;
+		}
+		if (mRealTime)
+			std::this_thread::sleep_until(start + std::chrono::microseconds(record.time));
+
+		bool inScene = record.object >= 0 && record.object < (int)mScene.objectCount();
+		switch (record.type) {
+		case TraceServo: {
+			mDeviceWorld = toVec3(record.b);
+			glm::vec3 force(0.0f, 0.0f, 0.0f);
+			mInteraction.servoTick(toVec3(record.a), mDeviceWorld, force);
+			mStats.servoTicks++;
+
+			int applied = mInteraction.solver().applied();
+			Clock::time_point begin = Clock::now();
+			mInteraction.applyEdits();
+			if (mInteraction.solver().applied() != applied)
+				mStats.deformation.record(since(begin));
+			break;
+		}
+		case TraceTouch:
+		case TraceMotion:
+			if (inScene) {
+				Clock::time_point begin = Clock::now();
+				if (record.type == TraceTouch)
+					mInteraction.touch(record.object, toVec3(record.a));
+				else
+					mInteraction.motion(record.object, toVec3(record.a));
+				mStats.nearest.record(since(begin));
+				mTouching = true;
+			}
+			mStats.events++;
+			break;
+		case TraceUntouch:
+			mInteraction.untouch();
+			mTouching = false;
+			mStats.events++;
+			break;
+		case TraceKey:
+			key(record);
+			mStats.events++;
+			break;
+		case TraceTransform:
+			if (inScene) {
+				double *m = &mWorldToModel[16 * record.object];
+				for (int c = 0; c < 3; c++) {
+					m[4 * (2 * record.value) + c] = record.a[c];
+					m[4 * (2 * record.value + 1) + c] = record.b[c];
+				}
+			}
+			break;
+		}
+	}
+	frame();
+}
+
+// Same rules as the keyboard handler: 'A' toggles anchored editing, which
+// only anchors while something is touched and the proxy is constrained, 'Z'
+// and 'Y' undo and redo, and the brush keys change the brush for the next
+// anchor.
+void TraceReplay::key(TraceRecord const &record)
+{
+	switch (record.value) {
+	case 'A':
+		mAnchoredEditing = !mAnchoredEditing;
+		if (mAnchoredEditing && mTouching && mProxyConstrained)
+			mInteraction.beginAnchor(toVec3(record.a), mDeviceWorld, toVec3(record.b),
+				&mWorldToModel[16 * mInteraction.object()]);
+		else
+			mInteraction.endAnchor();
+		break;
+	case 'E':
+		mProxyConstrained = !mProxyConstrained;
+		break;
+	case 'Z':
+		mInteraction.undo();
+		break;
+	case 'Y':
+		mInteraction.redo();
+		break;
+	default: {
+		Brush brush = mInteraction.brush();
+		if (adjustBrush(brush, (char)record.value))
+			mInteraction.setBrush(brush);
+		break;
+	}
+	}
+}
+
+void TraceReplay::frame()
+{
+	Clock::time_point begin = Clock::now();
+	for (size_t i = 0; i < mScene.meshCount(); i++)
+		mScene.mesh(i).updateNormals();
+	mStats.normals.record(since(begin));
+
+	if (mDraw) {
+		begin = Clock::now();
+		mDraw();
+		mStats.draw.record(since(begin));
+	}
+	mStats.frames++;
+}
+
+void TraceReplay::print(FILE *out) const
+{
+	fprintf(out, "%d servo ticks, %d events, %d frames\n", mStats.servoTicks, mStats.events, mStats.frames);
+	mStats.nearest.print(out, "nearest");
+	mStats.deformation.print(out, "deformation");
+	mStats.normals.print(out, "normals");
+	if (mDraw)
+		mStats.draw.print(out, "draw");
+}
@@ -0,0 +1,71 @@
+#ifndef TRACEREPLAY_H
+#define TRACEREPLAY_H
+
+#include <functional>
+#include <vector>
+#include "latencyhistogram.h"
+#include "sessiontrace.h"
+
+class Interaction;
+class Scene;
+
+//! Time spent in each stage while replaying a trace.
+//!
+struct ReplayStats {
+	LatencyHistogram nearest;      // touch and motion: contact and nearest vertex
+	LatencyHistogram deformation;  // applying one queued edit
+	LatencyHistogram normals;      // updateNormals() over every mesh, per frame
+	LatencyHistogram draw;         // the draw function, per frame
+	int servoTicks;
+	int events;
+	int frames;
+};
+
+//! Feeds a recorded session back through an Interaction, the way the HL
+//! callbacks, the keyboard handler and the servo loop fed the live one.
+//!
+//! Everything runs on the calling thread, one stage after another, so each
+//! stage can be timed on its own: edits are applied right after the servo
+//! tick that queued them, and a frame (normals, then draw) runs whenever the
+//! trace clock passes a frame boundary.  With real time off, records are
+//! replayed as fast as they can be; otherwise each waits for its timestamp.
+class TraceReplay {
+	public:
+		TraceReplay(Interaction &interaction, Scene &scene);
+
+		void setRealTime(bool realTime);
+		void setFrameRate(int frameRate);
+
+		//! Called once per frame after the normals, and timed as the draw
+		//! stage.  Without one the draw stage stays empty.
+		void setDraw(std::function<void()> const &draw);
+
+		void run(std::vector<TraceRecord> const &records);
+
+		ReplayStats const &stats() const;
+
+		//! Prints one line per stage.
+		//!
+		void print(FILE *out) const;
+
+	private:
+		void key(TraceRecord const &record);
+		void frame();
+
+		Interaction &mInteraction;
+		Scene &mScene;
+		bool mRealTime;
+		int mFrameRate;
+		std::function<void()> mDraw;
+		ReplayStats mStats;
+
+		// The app's state that the keys toggle, and what the trace has said
+		// about the device and the objects so far.
+		bool mAnchoredEditing;
+		bool mProxyConstrained;
+		bool mTouching;
+		glm::vec3 mDeviceWorld;
+		std::vector<double> mWorldToModel;  // 16 per object
+	};
+
+#endif
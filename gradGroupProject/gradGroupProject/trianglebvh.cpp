@@ -0,0 +1,374 @@
+#include <algorithm>
+#include <cfloat>
+#include <functional>
+#include "trianglebvh.h"
+
+namespace {
+
+	const int kLeafSize = 4;         // triangles per leaf
+	const int kMaxDepth = 64;        // median splits stay far below this
+
+	float boxDistance2(glm::vec3 const &lo, glm::vec3 const &hi, glm::vec3 const &p)
+	{
+		float d = 0.0f;
+		for (int a = 0; a < 3; a++) {
+			float e = p[a] < lo[a] ? lo[a] - p[a] : (p[a] > hi[a] ? p[a] - hi[a] : 0.0f);
+			d += e * e;
+		}
+		return d;
+	}
+}
+
+// Ericson, Real-Time Collision Detection, 5.1.5: classify p against the
+// Voronoi regions of the corners, then the edges, then the face.
+glm::vec3 closestPointOnTriangle(glm::vec3 const &p, glm::vec3 const &a, glm::vec3 const &b,
+	glm::vec3 const &c, glm::vec3 &barycentric)
+{
+	glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+	float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f) {
+		barycentric = glm::vec3(1.0f, 0.0f, 0.0f);
+		return a;
+	}
+
+	glm::vec3 bp = p - b;
+	float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3) {
+		barycentric = glm::vec3(0.0f, 1.0f, 0.0f);
+		return b;
+	}
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+		float v = d1 / (d1 - d3);
+		barycentric = glm::vec3(1.0f - v, v, 0.0f);
+		return a + v * ab;
+	}
+
+	glm::vec3 cp = p - c;
+	float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6) {
+		barycentric = glm::vec3(0.0f, 0.0f, 1.0f);
+		return c;
+	}
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+		float w = d2 / (d2 - d6);
+		barycentric = glm::vec3(1.0f - w, 0.0f, w);
+		return a + w * ac;
+	}
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+		float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+		barycentric = glm::vec3(0.0f, 1.0f - w, w);
+		return b + w * (c - b);
+	}
+
+	// Inside the face.  A sliver with no area can still land here; snap it to
+	// its first corner rather than divide by zero.
+	if (!(va + vb + vc > 0.0f)) {
+		barycentric = glm::vec3(1.0f, 0.0f, 0.0f);
+		return a;
+	}
+	float denom = 1.0f / (va + vb + vc);
+	float v = vb * denom, w = vc * denom;
+	barycentric = glm::vec3(1.0f - v - w, v, w);
+	return a + ab * v + ac * w;
+}
+
+TriangleBVH::TriangleBVH()
+{
+}
+
+void TriangleBVH::clear()
+{
+	mNodes.clear();
+	mParent.clear();
+	mItems.clear();
+	mLeafOf.clear();
+	mStale.clear();
+	mIsStale.clear();
+}
+
+bool TriangleBVH::empty() const
+{
+	return mNodes.empty();
+}
+
+void TriangleBVH::fitLeaf(std::vector<glm::vec3> const &points, std::vector<int> const &indices, Node &node) const
+{
+	node.lo = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+	node.hi = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (int i = node.first; i < node.first + node.count; i++) {
+		int const *corner = &indices[3 * mItems[i]];
+		for (int k = 0; k < 3; k++) {
+			node.lo = glm::min(node.lo, points[corner[k]]);
+			node.hi = glm::max(node.hi, points[corner[k]]);
+		}
+	}
+}
+
+// Top-down median split on the longest axis of the triangle centroids.
+void TriangleBVH::build(std::vector<glm::vec3> const &points, std::vector<int> const &indices)
+{
+	clear();
+	int triangleCount = (int)(indices.size() / 3);
+	if (triangleCount == 0)
+		return;
+
+	std::vector<glm::vec3> centroids(triangleCount);
+	for (int t = 0; t < triangleCount; t++)
+		centroids[t] = (points[indices[3 * t]] + points[indices[3 * t + 1]] + points[indices[3 * t + 2]]) / 3.0f;
+
+	mItems.resize(triangleCount);
+	for (int t = 0; t < triangleCount; t++)
+		mItems[t] = t;
+	mLeafOf.resize(triangleCount);
+	mNodes.reserve(2 * (triangleCount / kLeafSize + 1));
+	mParent.reserve(mNodes.capacity());
+
+	Node root;
+	root.first = 0;
+	root.count = triangleCount;
+	mNodes.push_back(root);
+	mParent.push_back(-1);
+
+	std::vector<int> pending(1, 0);
+	while (!pending.empty()) {
+		int id = pending.back();
+		pending.pop_back();
+		Node node = mNodes[id];
+		fitLeaf(points, indices, node);
+
+		if (node.count <= kLeafSize) {
+			for (int i = node.first; i < node.first + node.count; i++)
+				mLeafOf[mItems[i]] = id;
+			mNodes[id] = node;
+			continue;
+		}
+
+		glm::vec3 lo = centroids[mItems[node.first]], hi = lo;
+		for (int i = node.first + 1; i < node.first + node.count; i++) {
+			lo = glm::min(lo, centroids[mItems[i]]);
+			hi = glm::max(hi, centroids[mItems[i]]);
+		}
+		glm::vec3 extent = hi - lo;
+		int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+		int half = node.count / 2;
+		std::vector<int>::iterator first = mItems.begin() + node.first;
+		std::nth_element(first, first + half, first + node.count, [&](int l, int r) {
+			return centroids[l][axis] < centroids[r][axis];
+		});
+
+		Node left, right;
+		left.first = node.first;
+		left.count = half;
+		right.first = node.first + half;
+		right.count = node.count - half;
+
+		node.first = (int)mNodes.size();
+		node.count = 0;
+		mNodes[id] = node;
+		mNodes.push_back(left);
+		mNodes.push_back(right);
+		mParent.push_back(id);
+		mParent.push_back(id);
+		pending.push_back(node.first);
+		pending.push_back(node.first + 1);
+	}
+
+	fitInner();
+}
+
+// Children come after their parent, so a reverse sweep fits every inner box
+// from boxes that are already final.
+void TriangleBVH::fitInner()
+{
+	for (int id = (int)mNodes.size() - 1; id >= 0; id--) {
+		Node &node = mNodes[id];
+		if (node.count == 0) {
+			node.lo = glm::min(mNodes[node.first].lo, mNodes[node.first + 1].lo);
+			node.hi = glm::max(mNodes[node.first].hi, mNodes[node.first + 1].hi);
+		}
+	}
+}
+
+bool TriangleBVH::assign(std::vector<glm::vec3> const &points, std::vector<int> const &indices,
+	int const *nodes, size_t nodeCount, std::vector<int> &items)
+{
+	clear();
+	int triangleCount = (int)(indices.size() / 3);
+	if (nodeCount == 0)
+		return triangleCount == 0 && items.empty();
+	if (items.size() != (size_t)triangleCount)
+		return false;
+
+	// Children after their parent, each node but the root a child of
+	// exactly one inner node, no deeper than the query stack allows, and
+	// every triangle in exactly one leaf.
+	std::vector<int> parent(nodeCount, -1), depth(nodeCount, 0), leafOf(triangleCount, -1);
+	for (size_t id = 0; id < nodeCount; id++) {
+		int first = nodes[2 * id], count = nodes[2 * id + 1];
+		if (id > 0 && parent[id] < 0)
+			return false;
+		if (count == 0) {
+			if (first <= (int)id || (size_t)first + 1 >= nodeCount || parent[first] >= 0 ||
+				depth[id] + 1 >= kMaxDepth)
+				return false;
+			parent[first] = parent[first + 1] = (int)id;
+			depth[first] = depth[first + 1] = depth[id] + 1;
+			continue;
+		}
+		if (count < 0 || first < 0 || first > triangleCount - count)
+			return false;
+		for (int i = first; i < first + count; i++) {
+			int t = items[i];
+			if (t < 0 || t >= triangleCount || leafOf[t] >= 0)
+				return false;
+			leafOf[t] = (int)id;
+		}
+	}
+	for (int t = 0; t < triangleCount; t++)
+		if (leafOf[t] < 0)
+			return false;
+
+	mItems.swap(items);
+	mNodes.resize(nodeCount);
+	for (size_t id = 0; id < nodeCount; id++) {
+		mNodes[id].first = nodes[2 * id];
+		mNodes[id].count = nodes[2 * id + 1];
+		if (mNodes[id].count > 0)
+			fitLeaf(points, indices, mNodes[id]);
+	}
+	mParent.swap(parent);
+	mLeafOf.swap(leafOf);
+	fitInner();
+	return true;
+}
+
+void TriangleBVH::shape(int *nodes) const
+{
+	for (size_t id = 0; id < mNodes.size(); id++) {
+		nodes[2 * id] = mNodes[id].first;
+		nodes[2 * id + 1] = mNodes[id].count;
+	}
+}
+
+void TriangleBVH::update(std::vector<glm::vec3> const &points, std::vector<int> const &indices, int triangle)
+{
+	if (empty())
+		return;
+
+	int id = mLeafOf[triangle];
+	fitLeaf(points, indices, mNodes[id]);
+
+	// Refit ancestors until a box comes out unchanged.
+	for (id = mParent[id]; id != -1; id = mParent[id]) {
+		Node &node = mNodes[id];
+		glm::vec3 lo = glm::min(mNodes[node.first].lo, mNodes[node.first + 1].lo);
+		glm::vec3 hi = glm::max(mNodes[node.first].hi, mNodes[node.first + 1].hi);
+		if (lo == node.lo && hi == node.hi)
+			break;
+		node.lo = lo;
+		node.hi = hi;
+	}
+}
+
+void TriangleBVH::refit(std::vector<glm::vec3> const &points, std::vector<int> const &indices,
+	std::vector<int> const &triangles)
+{
+	if (empty() || triangles.empty())
+		return;
+	if (mIsStale.size() != mNodes.size())
+		mIsStale.assign(mNodes.size(), 0);
+
+	// The leaves, then every ancestor of them, each listed once.
+	mStale.clear();
+	for (size_t i = 0; i < triangles.size(); i++) {
+		int id = mLeafOf[triangles[i]];
+		if (!mIsStale[id]) {
+			mIsStale[id] = 1;
+			mStale.push_back(id);
+		}
+	}
+	for (size_t i = 0; i < mStale.size(); i++) {
+		int parent = mParent[mStale[i]];
+		if (parent >= 0 && !mIsStale[parent]) {
+			mIsStale[parent] = 1;
+			mStale.push_back(parent);
+		}
+	}
+
+	// Children come after their parent, so fitting in decreasing order
+	// finishes both children of a box before the box itself.
+	std::sort(mStale.begin(), mStale.end(), std::greater<int>());
+	for (size_t i = 0; i < mStale.size(); i++) {
+		Node &node = mNodes[mStale[i]];
+		if (node.count > 0)
+			fitLeaf(points, indices, node);
+		else {
+			node.lo = glm::min(mNodes[node.first].lo, mNodes[node.first + 1].lo);
+			node.hi = glm::max(mNodes[node.first].hi, mNodes[node.first + 1].hi);
+		}
+		mIsStale[mStale[i]] = 0;
+	}
+}
+
+bool TriangleBVH::closestPoint(std::vector<glm::vec3> const &points, std::vector<int> const &indices,
+	glm::vec3 const &p, SurfacePoint &out) const
+{
+	out.triangle = -1;
+	out.distance2 = FLT_MAX;
+	if (empty())
+		return false;
+
+	// Depth-first, nearer child first, on a fixed stack so the haptic
+	// callbacks never allocate.  A box is only skipped when it is strictly
+	// farther than the best so far, which keeps ties going to the lower id.
+	int stack[kMaxDepth];
+	float stackDist[kMaxDepth];
+	int top = 0;
+	stack[top] = 0;
+	stackDist[top++] = boxDistance2(mNodes[0].lo, mNodes[0].hi, p);
+
+	while (top > 0) {
+		top--;
+		if (stackDist[top] > out.distance2)
+			continue;
+		Node const &node = mNodes[stack[top]];
+
+		if (node.count > 0) {
+			for (int i = node.first; i < node.first + node.count; i++) {
+				int t = mItems[i];
+				glm::vec3 weights;
+				glm::vec3 q = closestPointOnTriangle(p, points[indices[3 * t]], points[indices[3 * t + 1]],
+					points[indices[3 * t + 2]], weights);
+				glm::vec3 d = q - p;
+				float dist = glm::dot(d, d);
+				if (dist < out.distance2 || (dist == out.distance2 && t < out.triangle)) {
+					out.position = q;
+					out.barycentric = weights;
+					out.triangle = t;
+					out.distance2 = dist;
+				}
+			}
+			continue;
+		}
+
+		int nearChild = node.first, farChild = node.first + 1;
+		float nearDist = boxDistance2(mNodes[nearChild].lo, mNodes[nearChild].hi, p);
+		float farDist = boxDistance2(mNodes[farChild].lo, mNodes[farChild].hi, p);
+		if (farDist < nearDist) {
+			std::swap(nearChild, farChild);
+			std::swap(nearDist, farDist);
+		}
+		stack[top] = farChild;
+		stackDist[top++] = farDist;
+		stack[top] = nearChild;
+		stackDist[top++] = nearDist;
+	}
+	return true;
+}
@@ -0,0 +1,87 @@
+#ifndef TRIANGLEBVH_H
+#define TRIANGLEBVH_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+//! A point on a triangle of the mesh.  barycentric holds the weights of the
+//! triangle's three corners, in the order they appear in the index array.
+struct SurfacePoint {
+	glm::vec3 position;
+	glm::vec3 barycentric;
+	int triangle;         // -1 if the mesh has no triangles
+	float distance2;      // squared distance from the query point
+};
+
+//! Bounding volume hierarchy over the triangles of an indexed mesh, used to
+//! find the closest point on the surface without testing every triangle.
+//!
+//! Like SpatialGrid it stores triangle ids only; callers pass the position
+//! and index arrays to each call.  When vertices move, update() refits the
+//! boxes of one triangle's leaf and its ancestors, so the tree stays exact
+//! without a rebuild; its shape is only as good as the positions at build().
+class TriangleBVH {
+	public:
+		TriangleBVH();
+
+		//! Builds the tree over every triangle, replacing any previous contents.
+		//!
+		void build(std::vector<glm::vec3> const &points, std::vector<int> const &indices);
+
+		//! Takes back a tree saved from nodeCount(), shape() and items() for
+		//! the same triangles, and fits its boxes to points.  Returns false,
+		//! leaving the tree empty, if the arrays do not describe such a tree.
+		bool assign(std::vector<glm::vec3> const &points, std::vector<int> const &indices,
+			int const *nodes, size_t nodeCount, std::vector<int> &items);
+
+		void clear();
+
+		//! Must be called for every triangle with a corner that has moved.
+		//!
+		void update(std::vector<glm::vec3> const &points, std::vector<int> const &indices, int triangle);
+
+		//! Same as update() for every triangle listed, duplicates allowed,
+		//! but fitting each leaf and each box above them only once.
+		void refit(std::vector<glm::vec3> const &points, std::vector<int> const &indices,
+			std::vector<int> const &triangles);
+
+		bool empty() const;
+
+		//! Closest point to p on any triangle.  Ties go to the lower triangle
+		//! id.  Returns false, with out.triangle = -1, if there are no triangles.
+		bool closestPoint(std::vector<glm::vec3> const &points, std::vector<int> const &indices,
+			glm::vec3 const &p, SurfacePoint &out) const;
+
+		//! The tree without its boxes, for storing it with the mesh: shape()
+		//! writes first and count of every node, root first, into
+		//! 2 * nodeCount() ints.
+		size_t nodeCount() const { return mNodes.size(); }
+		void shape(int *nodes) const;
+		std::vector<int> const &items() const { return mItems; }
+
+	private:
+		struct Node {
+			glm::vec3 lo, hi;
+			int first;    // leaf: first slot in mItems; inner: index of the left child
+			int count;    // leaf: number of triangles; inner: 0
+		};
+
+		void fitLeaf(std::vector<glm::vec3> const &points, std::vector<int> const &indices, Node &node) const;
+		void fitInner();
+
+		std::vector<Node> mNodes;       // root first; the two children of a node are adjacent
+		std::vector<int> mParent;       // parent of each node, -1 for the root
+		std::vector<int> mItems;        // triangle ids grouped by leaf
+		std::vector<int> mLeafOf;       // leaf node holding each triangle
+
+		// Scratch for refit(): nodes to fit, and which are on the list.
+		std::vector<int> mStale;
+		std::vector<char> mIsStale;
+	};
+
+//! Closest point to p on the triangle (a, b, c), with its barycentric weights.
+//!
+glm::vec3 closestPointOnTriangle(glm::vec3 const &p, glm::vec3 const &a, glm::vec3 const &b,
+	glm::vec3 const &c, glm::vec3 &barycentric);
+
+#endif
@@ -0,0 +1,1089 @@
+// Checks for the parts of the geometry and editing code that have a right
+// answer to compare against.  A separate program built by the CMake build,
+// which registers each test with CTest; not part of the Visual Studio
+// project.
+//
+//   tvotests [--mesh-dir dir] [test...]
+//
+// Runs the named tests, or every one, and exits with 1 if any check failed.
+// --mesh-dir defaults to the source directory.  Files the tests write go to
+// the current directory.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+#include "backgroundwriter.h"
+#include "deformsolver.h"
+#include "editjournal.h"
+#include "lodhierarchy.h"
+#include "envelopecholesky.h"
+#include "meshcache.h"
+#include "objloader.h"
+#include "objparser.h"
+#include "objwriter.h"
+#include "offscreengl.h"
+#include "rigidsolver.h"
+#include "scene.h"
+#include "trianglebvh.h"
+
+namespace {
+
+	std::string gMeshDir = TVO_MESH_DIR;
+	int gFailures = 0;
+
+	void check(bool passed, const char *what, const char *file, int line)
+	{
+		if (passed)
+			return;
+		printf("%s:%d: FAILED: %s\n", file, line, what);
+		gFailures++;
+	}
+}
+
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+
+namespace {
+
+	std::string meshPath(const char *mesh)
+	{
+		return gMeshDir + "/" + mesh + ".obj";
+	}
+
+	bool loadMesh(OBJLoader &loader, const char *mesh)
+	{
+		bool loaded = loader.load(meshPath(mesh).c_str());
+		CHECK(loaded);
+		return loaded;
+	}
+
+	// The vertex with the largest y, a handle every bundled mesh has room
+	// around.
+	int topVertex(OBJLoader const &loader)
+	{
+		std::vector<glm::vec3> const &points = loader.getVertices();
+		int top = 0;
+		for (size_t v = 1; v < points.size(); v++)
+			if (points[v].y > points[top].y)
+				top = (int)v;
+		return top;
+	}
+
+	// Solves the n x n system a x = b by Gaussian elimination with partial
+	// pivoting, destroying a; b receives x.
+	void denseSolve(std::vector<double> &a, std::vector<double> &b)
+	{
+		int n = (int)b.size();
+		for (int col = 0; col < n; col++) {
+			int pivot = col;
+			for (int row = col + 1; row < n; row++)
+				if (std::fabs(a[row * n + col]) > std::fabs(a[pivot * n + col]))
+					pivot = row;
+			if (pivot != col) {
+				for (int k = 0; k < n; k++)
+					std::swap(a[col * n + k], a[pivot * n + k]);
+				std::swap(b[col], b[pivot]);
+			}
+			for (int row = col + 1; row < n; row++) {
+				double factor = a[row * n + col] / a[col * n + col];
+				for (int k = col; k < n; k++)
+					a[row * n + k] -= factor * a[col * n + k];
+				b[row] -= factor * b[col];
+			}
+		}
+		for (int row = n - 1; row >= 0; row--) {
+			for (int k = row + 1; k < n; k++)
+				b[row] -= a[row * n + k] * b[k];
+			b[row] /= a[row * n + row];
+		}
+	}
+
+	bool samePositions(std::vector<glm::vec3> const &a, ConstSpan<glm::vec3> b)
+	{
+		if (a.size() != b.size())
+			return false;
+		for (size_t i = 0; i < a.size(); i++)
+			if (!(a[i] == b[i]))
+				return false;
+		return true;
+	}
+
+	bool samePositions(std::vector<glm::vec3> const &a, std::vector<glm::vec3> const &b)
+	{
+		return samePositions(a, ConstSpan<glm::vec3>(b.empty() ? 0 : &b[0], b.size()));
+	}
+
+	template <typename T>
+	bool sameSpans(ConstSpan<T> a, ConstSpan<T> b)
+	{
+		return a.size() == b.size() && (a.size() == 0 || !memcmp(&a[0], &b[0], a.size() * sizeof(T)));
+	}
+
+	bool sameFiles(const char *a, const char *b)
+	{
+		std::vector<char> first, second;
+		return readFile(a, first) && readFile(b, second) && first == second;
+	}
+
+	bool writeFile(const char *path, std::vector<char> const &bytes)
+	{
+		FILE *file = fopen(path, "wb");
+		if (!file)
+			return false;
+		bool written = bytes.empty() || fwrite(&bytes[0], 1, bytes.size(), file) == bytes.size();
+		return fclose(file) == 0 && written;
+	}
+
+	bool copyFile(std::string const &from, const char *to)
+	{
+		std::vector<char> bytes;
+		return readFile(from.c_str(), bytes) && writeFile(to, bytes);
+	}
+
+	bool writeText(const char *path, const char *text)
+	{
+		return writeFile(path, std::vector<char>(text, text + strlen(text)));
+	}
+
+	double largestDifference(std::vector<double> const &a, std::vector<double> const &b)
+	{
+		double largest = 0.0;
+		for (size_t i = 0; i < a.size(); i++)
+			largest = std::max(largest, std::fabs(a[i] - b[i]));
+		return largest;
+	}
+
+	// Mean relative change in length of the edges from each region vertex,
+	// with moved[i] the new position of region.vertices[i].
+	double edgeStrain(OBJLoader const &loader, BrushRegion const &region, std::vector<glm::vec3> const &moved)
+	{
+		std::vector<glm::vec3> const &rest = loader.getVertices();
+		std::vector<int> local(rest.size(), -1);
+		for (size_t i = 0; i < region.vertices.size(); i++)
+			local[region.vertices[i]] = (int)i;
+		double strain = 0.0;
+		int edges = 0;
+		for (size_t i = 0; i < region.vertices.size(); i++) {
+			int v = region.vertices[i];
+			ConstSpan<int> ring = loader.neighbours(v);
+			for (size_t k = 0; k < ring.size(); k++) {
+				int w = ring[k];
+				glm::vec3 other = local[w] >= 0 ? moved[local[w]] : rest[w];
+				double before = glm::length(rest[v] - rest[w]);
+				strain += std::fabs(glm::length(moved[i] - other) - before) / before;
+				edges++;
+			}
+		}
+		return edges ? strain / edges : 0.0;
+	}
+
+	float distance2(glm::vec3 const &a, glm::vec3 const &b)
+	{
+		float dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+		return dx * dx + dy * dy + dz * dz;
+	}
+
+	float randomCoordinate()
+	{
+		return 2.4f * rand() / (float)RAND_MAX - 1.2f;
+	}
+
+	// Moves count random vertices and their one-rings the way an anchored
+	// edit of the original kind does.
+	void randomEdits(OBJLoader &loader, int count)
+	{
+		for (int i = 0; i < count; i++) {
+			int v = rand() % (int)loader.getVertices().size();
+			ConstSpan<int> ring = loader.neighbours(v);
+			std::set<int> neighbours(ring.begin(), ring.end());
+			glm::vec3 step(randomCoordinate(), randomCoordinate(), randomCoordinate());
+			loader.deformSurface(v, loader.getVertices()[v] + step * 0.1f, neighbours);
+		}
+	}
+
+	// The sorted squared distances of the k vertices nearest p, by a scan
+	// over every vertex.
+	std::vector<float> nearestDistances(std::vector<glm::vec3> const &points, glm::vec3 const &p, size_t k)
+	{
+		std::vector<float> distances(points.size());
+		for (size_t v = 0; v < points.size(); v++)
+			distances[v] = distance2(p, points[v]);
+		std::sort(distances.begin(), distances.end());
+		distances.resize(std::min(k, distances.size()));
+		return distances;
+	}
+
+	// The grid and the BVH, kept up to date through random edits, against
+	// scans over every vertex and every triangle, with both layouts.
+	void spatialQueries()
+	{
+		const int kRounds = 10, kQueries = 40, kNearest = 8;
+		const float kRadius = 0.15f;
+		for (int layout = 0; layout < 2; layout++) {
+			OBJLoader loader;
+			if (!loadMesh(loader, "shrek"))
+				return;
+			if (layout)
+				loader.setVertexLayout(VertexLayoutSoA);
+			srand(7);
+			int wrongNearest = 0, wrongK = 0, wrongRadius = 0, wrongClosest = 0;
+			std::vector<int> found;
+			for (int round = 0; round < kRounds; round++) {
+				randomEdits(loader, 20);
+				std::vector<glm::vec3> const &points = loader.getVertices();
+				std::vector<int> const &indices = loader.getVertexIndices();
+				for (int q = 0; q < kQueries; q++) {
+					glm::vec3 p(randomCoordinate(), randomCoordinate(), randomCoordinate());
+					std::vector<float> nearest = nearestDistances(points, p, kNearest);
+
+					int indexed = loader.nearestVertex(p), linear = loader.nearestVertexLinear(p);
+					if (indexed < 0 || distance2(p, points[indexed]) != nearest[0])
+						wrongNearest++;
+					if (linear < 0 || distance2(p, points[linear]) != nearest[0])
+						wrongNearest++;
+
+					loader.nearestVertices(p, kNearest, found);
+					std::vector<float> distances;
+					for (size_t i = 0; i < found.size(); i++)
+						distances.push_back(distance2(p, points[found[i]]));
+					if (distances != nearest)
+						wrongK++;
+
+					loader.verticesInRadius(p, kRadius, found);
+					std::vector<int> inside;
+					for (size_t i = 0; i < points.size(); i++)
+						if (distance2(p, points[i]) <= kRadius * kRadius)
+							inside.push_back((int)i);
+					std::sort(found.begin(), found.end());
+					if (found != inside)
+						wrongRadius++;
+
+					SurfacePoint point;
+					glm::vec3 barycentric;
+					float best = HUGE_VALF;
+					for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+						glm::vec3 c = closestPointOnTriangle(p, points[indices[t]], points[indices[t + 1]],
+							points[indices[t + 2]], barycentric);
+						best = std::min(best, distance2(p, c));
+					}
+					if (!loader.closestPoint(p, point) || point.triangle < 0 ||
+						std::fabs(point.distance2 - best) > 1.0e-6f * (1.0f + best))
+						wrongClosest++;
+					else {
+						int t = 3 * point.triangle;
+						glm::vec3 c = closestPointOnTriangle(p, points[indices[t]], points[indices[t + 1]],
+							points[indices[t + 2]], barycentric);
+						if (distance2(c, point.position) > 1.0e-10f)
+							wrongClosest++;
+					}
+				}
+			}
+			CHECK(wrongNearest == 0);
+			CHECK(wrongK == 0);
+			CHECK(wrongRadius == 0);
+			CHECK(wrongClosest == 0);
+		}
+	}
+
+	// updateNormals() only redoes the normals around moved vertices; after
+	// every round of random edits they must match a full computeNormals()
+	// bit for bit, in the drawn copy as well as the positions.
+	void incrementalNormals()
+	{
+		for (int layout = 0; layout < 2; layout++) {
+			OBJLoader loader;
+			if (!loadMesh(loader, "shrek"))
+				return;
+			if (layout)
+				loader.setVertexLayout(VertexLayoutSoA);
+			srand(11);
+			int wrongPositions = 0, wrongNormals = 0;
+			std::vector<glm::vec3> normals;
+			for (int round = 0; round < 50; round++) {
+				randomEdits(loader, 1 + round % 5);
+				loader.updateNormals();
+				MeshView view = loader.view();
+				if (!samePositions(loader.getVertices(), view.positions))
+					wrongPositions++;
+				loader.computeNormals(loader.getVertices(), loader.getVertexIndices(), normals);
+				if (!samePositions(normals, view.normals))
+					wrongNormals++;
+			}
+			CHECK(wrongPositions == 0);
+			CHECK(wrongNormals == 0);
+		}
+	}
+
+	// A random banded symmetric positive definite matrix, factorized by
+	// envelope and solved against the dense solution.
+	void envelopeCholesky()
+	{
+		const int n = 60, band = 7;
+		srand(3);
+		std::vector<double> dense(n * n, 0.0);
+		EnvelopeCholesky cholesky;
+		cholesky.reset(n);
+		for (int row = 0; row < n; row++)
+			for (int col = std::max(0, row - band); col < row; col++)
+				if (rand() % 3 == 0) {
+					double value = -(rand() % 100) / 100.0;
+					dense[row * n + col] = dense[col * n + row] = value;
+					cholesky.add(row, col, value);
+				}
+		// Diagonally dominant, so positive definite.
+		for (int row = 0; row < n; row++) {
+			double diagonal = 1.0;
+			for (int col = 0; col < n; col++)
+				diagonal += std::fabs(dense[row * n + col]);
+			dense[row * n + row] = diagonal;
+			cholesky.add(row, row, diagonal);
+		}
+		CHECK(cholesky.factorize());
+
+		std::vector<double> b(n), x(n);
+		for (int i = 0; i < n; i++)
+			b[i] = x[i] = rand() / (double)RAND_MAX - 0.5;
+		cholesky.solve(&x[0]);
+		denseSolve(dense, b);
+		CHECK(largestDifference(x, b) < 1.0e-9);
+
+		// Not positive definite.
+		EnvelopeCholesky indefinite;
+		indefinite.reset(2);
+		indefinite.add(0, 0, 1.0);
+		indefinite.add(1, 0, 2.0);
+		indefinite.add(1, 1, 1.0);
+		CHECK(!indefinite.factorize());
+	}
+
+	// RigidSolver's system over a real brush region, rebuilt densely: the
+	// degree on the diagonal and -1 for each neighbour inside the region,
+	// the handle and the vertices around the region known.
+	void rigidSystem()
+	{
+		OBJLoader loader;
+		if (!loadMesh(loader, "shrek"))
+			return;
+		Brush brush = kDefaultBrush;
+		brush.radius = 0.3f;
+		BrushRegion region;
+		loader.brushRegion(topVertex(loader), brush, region);
+		int n = (int)region.vertices.size() - 1;
+		CHECK(n > 10);
+
+		std::vector<int> local(loader.getVertices().size(), -1);
+		for (size_t i = 0; i < region.vertices.size(); i++)
+			local[region.vertices[i]] = (int)i;
+		std::vector<double> dense(n * n, 0.0);
+		EnvelopeCholesky cholesky;
+		cholesky.reset(n);
+		for (int i = 1; i <= n; i++) {
+			ConstSpan<int> ring = loader.neighbours(region.vertices[i]);
+			dense[(i - 1) * n + i - 1] = (double)ring.size();
+			cholesky.add(i - 1, i - 1, (double)ring.size());
+			for (size_t k = 0; k < ring.size(); k++) {
+				int j = local[ring[k]];
+				if (j <= 0)
+					continue;
+				dense[(i - 1) * n + j - 1] = -1.0;
+				if (j < i)
+					cholesky.add(i - 1, j - 1, -1.0);
+			}
+		}
+		CHECK(cholesky.factorize());
+
+		RigidSolver solver;
+		CHECK(solver.begin(loader.adjacency(), loader.getVertices(), region.vertices));
+		CHECK(solver.factorSize() == cholesky.envelopeSize());
+
+		std::vector<double> b(n), x(n);
+		srand(5);
+		for (int i = 0; i < n; i++)
+			b[i] = x[i] = rand() / (double)RAND_MAX - 0.5;
+		cholesky.solve(&x[0]);
+		denseSolve(dense, b);
+		CHECK(largestDifference(x, b) < 1.0e-9);
+	}
+
+	// The edit itself: a handle left where it was moves nothing, a moved one
+	// lands on its target, and the region keeps its edge lengths better than
+	// the falloff brush does.
+	void rigidSolver()
+	{
+		OBJLoader loader;
+		if (!loadMesh(loader, "shrek"))
+			return;
+		int handle = topVertex(loader);
+		Brush brush = kDefaultBrush;
+		brush.radius = 0.3f;
+		BrushRegion region;
+		loader.brushRegion(handle, brush, region);
+		std::vector<glm::vec3> const &points = loader.getVertices();
+
+		RigidSolver solver;
+		CHECK(solver.begin(loader.adjacency(), points, region.vertices));
+		CHECK(solver.vertices() == region.vertices);
+		std::vector<glm::vec3> moved;
+		glm::vec3 rest = points[handle];
+		solver.iterate(rest, moved);
+		CHECK(moved.size() == region.vertices.size());
+		double drift = 0.0;
+		for (size_t i = 0; i < moved.size(); i++)
+			drift = std::max(drift, (double)glm::length(moved[i] - points[region.vertices[i]]));
+		CHECK(drift < 1.0e-5);
+
+		glm::vec3 target = rest + glm::vec3(0.1f, 0.15f, 0.0f);
+		for (int i = 0; i < 20; i++)
+			solver.iterate(target, moved);
+		CHECK(moved[0] == target);
+		std::vector<glm::vec3> falloff(region.vertices.size());
+		for (size_t i = 0; i < falloff.size(); i++)
+			falloff[i] = points[region.vertices[i]] + (target - rest) * region.weights[i];
+		CHECK(edgeStrain(loader, region, moved) < edgeStrain(loader, region, falloff));
+
+		// A region of the handle alone has nothing to solve for.
+		std::vector<int> alone(1, handle);
+		RigidSolver empty;
+		CHECK(!empty.begin(loader.adjacency(), points, alone));
+		CHECK(empty.vertices().empty());
+	}
+
+	// The journal on its own: sessions past the limit are dropped whole,
+	// undo and redo stop at the ends, and a new session drops what was
+	// undone.
+	void editJournal()
+	{
+		const size_t kVertices = 100;
+		EditJournal journal;
+		journal.clear(kVertices);
+		journal.setLimit(10);
+		std::vector<glm::vec3> positions(kVertices, glm::vec3(0.0f, 0.0f, 0.0f));
+		for (int session = 0; session < 20; session++) {
+			for (int v = session; v < session + 4; v++) {
+				// Moved twice in a session, recorded once.
+				journal.moving(v, positions[v]);
+				positions[v].x += 1.0f;
+				journal.moving(v, positions[v]);
+				positions[v].y += 1.0f;
+			}
+			journal.close();
+		}
+		// Four records a session, so two sessions fit under the limit of ten
+		// and the third would not.
+		CHECK(journal.undoable() == 2);
+		CHECK(journal.redoable() == 0);
+
+		std::vector<glm::vec3> last = positions;
+		std::vector<int> changed;
+		CHECK(journal.undo(positions, changed));
+		CHECK(changed.size() == 4);
+		CHECK(journal.undo(positions, changed));
+		CHECK(!journal.undo(positions, changed));
+		CHECK(journal.redoable() == 2);
+		CHECK(journal.redo(positions, changed));
+		CHECK(journal.redo(positions, changed));
+		CHECK(!journal.redo(positions, changed));
+		CHECK(samePositions(last, positions));
+
+		CHECK(journal.undo(positions, changed));
+		journal.moving(0, positions[0]);
+		positions[0].z += 1.0f;
+		journal.close();
+		CHECK(journal.redoable() == 0);
+		CHECK(journal.undoable() == 2);
+	}
+
+	// Edits through DeformSolver, one of them rigid, undone and redone back
+	// to exactly each state, with the drawn copy following.
+	void undoRedo()
+	{
+		OBJLoader loader;
+		if (!loadMesh(loader, "shrek"))
+			return;
+		size_t count = loader.getVertices().size();
+		DeformSolver solver;
+		std::vector<std::vector<glm::vec3> > states(1, loader.getVertices());
+		for (int edit = 0; edit < 4; edit++) {
+			Brush brush = kDefaultBrush;
+			if (edit == 2)
+				brush.mode = BrushRigid;
+			int anchor = (int)(count / 5 * edit + 100);
+			solver.beginEdit(&loader, anchor, brush);
+			glm::vec3 start = loader.getVertices()[anchor];
+			for (int tick = 0; tick < 50; tick++) {
+				solver.submit(start + glm::vec3(0.0f, 0.002f * tick, 0.0f));
+				solver.drain();
+			}
+			// Lets the rigid solve settle on the last target.
+			for (int tick = 0; tick < 20; tick++)
+				solver.drain();
+			states.push_back(loader.getVertices());
+		}
+		CHECK(!samePositions(states[0], states[4]));
+		CHECK(loader.journal().undoable() == 4);
+
+		for (int edit = 4; edit > 0; edit--) {
+			CHECK(solver.undo(&loader));
+			CHECK(samePositions(states[edit - 1], loader.getVertices()));
+		}
+		CHECK(!solver.undo(&loader));
+		loader.updateNormals();
+		CHECK(samePositions(states[0], loader.view().positions));
+
+		for (int edit = 1; edit <= 4; edit++) {
+			CHECK(solver.redo(&loader));
+			CHECK(samePositions(states[edit], loader.getVertices()));
+		}
+		CHECK(!solver.redo(&loader));
+		loader.updateNormals();
+		CHECK(samePositions(states[4], loader.view().positions));
+
+		// A new edit after two undos drops them from redo.
+		CHECK(solver.undo(&loader));
+		CHECK(solver.undo(&loader));
+		solver.beginEdit(&loader, 7, kDefaultBrush);
+		solver.submit(loader.getVertices()[7] + glm::vec3(0.05f, 0.0f, 0.0f));
+		solver.drain();
+		CHECK(loader.journal().undoable() == 3);
+		CHECK(loader.journal().redoable() == 0);
+		CHECK(solver.undo(&loader));
+		CHECK(samePositions(states[2], loader.getVertices()));
+
+		// A target still queued when the edit is undone is dropped.
+		solver.beginEdit(&loader, 7, kDefaultBrush);
+		solver.submit(loader.getVertices()[7] + glm::vec3(0.05f, 0.0f, 0.0f));
+		CHECK(solver.undo(&loader));
+		solver.drain();
+		CHECK(samePositions(states[1], loader.getVertices()));
+	}
+
+	// formatFloat() and parseFloat() round-trip to within half of the last
+	// decimal place kept.
+	void floatText()
+	{
+		float values[] = { 0.0f, -0.0f, 0.5f, -1.0f, 1.0e-7f, -4.0e-7f, 6.0e-7f, 0.9999996f, 123456.789f, 1.0e13f, -3.0e20f };
+		char text[kMaxFloatChars];
+		for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+			char *end = formatFloat(text, values[i]);
+			CHECK(end - text < (ptrdiff_t)kMaxFloatChars);
+			float back;
+			CHECK(parseFloat(text, end, back) == end);
+			CHECK(std::fabs(back - values[i]) <= 0.5e-6 + std::fabs(values[i]) * 1.0e-6);
+		}
+
+		srand(1);
+		double worst = 0.0;
+		for (int i = 0; i < 100000; i++) {
+			float value = (rand() / (float)RAND_MAX - 0.5f) * 4.0f;
+			char *end = formatFloat(text, value);
+			float back;
+			parseFloat(text, end, back);
+			worst = std::max(worst, (double)std::fabs(back - value));
+		}
+		// Half the last place, plus a float step at 2.
+		CHECK(worst <= 0.5e-6 + 2.5e-7);
+	}
+
+	template <typename T>
+	bool sameBytes(std::vector<T> const &a, std::vector<T> const &b)
+	{
+		return a.size() == b.size() && (a.empty() || !memcmp(&a[0], &b[0], a.size() * sizeof(T)));
+	}
+
+	bool sameObjData(ObjData const &a, ObjData const &b)
+	{
+		return sameBytes(a.positions, b.positions) && sameBytes(a.normals, b.normals) &&
+			sameBytes(a.texcoords, b.texcoords) && a.positionIndices == b.positionIndices &&
+			a.texcoordIndices == b.texcoordIndices && a.normalIndices == b.normalIndices;
+	}
+
+	void appendTriangle(ObjData &data, int v0, int v1, int v2, int t0, int t1, int t2, int n0, int n1, int n2)
+	{
+		int v[] = { v0, v1, v2 }, t[] = { t0, t1, t2 }, n[] = { n0, n1, n2 };
+		data.positionIndices.insert(data.positionIndices.end(), v, v + 3);
+		data.texcoordIndices.insert(data.texcoordIndices.end(), t, t + 3);
+		data.normalIndices.insert(data.normalIndices.end(), n, n + 3);
+	}
+
+	// Blocks of four vertices with a quad over them by relative indices, now
+	// and then a face reaching back into the block before by absolute and
+	// relative ones, a pentagon and statements to skip.  expected receives
+	// the triangles the parser should make.  Long enough to be cut into
+	// chunks on four threads.
+	std::string syntheticOBJ(ObjData &expected)
+	{
+		const int kBlocks = 3000;
+		std::string text;
+		char line[128];
+		for (int b = 0; b < kBlocks; b++) {
+			int v = 4 * b, t = 4 * b, n = b;
+			for (int k = 0; k < 4; k++) {
+				snprintf(line, sizeof(line), "v %d.25 %d.5 -%d\nvt 0.%d 0.%d\n", b, k, b + k, k, b % 10);
+				text += line;
+			}
+			text += "vn 0 0 1\n";
+			text += "f -4/-4/-1 -3/-3/-1 -2/-2/-1 -1/-1/-1\n";
+			appendTriangle(expected, v, v + 1, v + 2, t, t + 1, t + 2, n, n, n);
+			appendTriangle(expected, v, v + 2, v + 3, t, t + 2, t + 3, n, n, n);
+			if (b > 0 && b % 7 == 0) {
+				text += "# reaches back\ng group\ns off\n";
+				text += "f 1 -5 -1 2\n";
+				appendTriangle(expected, 0, v - 1, v + 3, -1, -1, -1, -1, -1, -1);
+				appendTriangle(expected, 0, v + 3, 1, -1, -1, -1, -1, -1, -1);
+			}
+			if (b > 0 && b % 11 == 0) {
+				text += "f -4//-1 -3//-1 -2//-1 -1//-1 -6//-2\n";
+				appendTriangle(expected, v, v + 1, v + 2, -1, -1, -1, n, n, n);
+				appendTriangle(expected, v, v + 2, v + 3, -1, -1, -1, n, n, n);
+				appendTriangle(expected, v, v + 3, v - 2, -1, -1, -1, n, n, n - 1);
+			}
+			for (int k = 0; k < 4; k++)
+				expected.positions.push_back(glm::vec3(b + 0.25f, k + 0.5f, -(float)(b + k)));
+		}
+		return text;
+	}
+
+	bool parseText(std::string const &text, ObjData &out, int threads)
+	{
+		return parseOBJ(text.data(), text.data() + text.size(), out, threads);
+	}
+
+	// The chunked parse gives exactly what one pass does, whatever the
+	// thread count, relative indices crossing chunks included; a face with
+	// a missing vertex fails it from any chunk.
+	void parseChunks()
+	{
+		ObjData expected;
+		std::string text = syntheticOBJ(expected);
+		CHECK(text.size() > 4 * (64 << 10));
+
+		ObjData single;
+		CHECK(parseText(text, single, 1));
+		CHECK(single.positions.size() == expected.positions.size());
+		CHECK(samePositions(expected.positions, single.positions));
+		CHECK(single.positionIndices == expected.positionIndices);
+		CHECK(single.texcoordIndices == expected.texcoordIndices);
+		CHECK(single.normalIndices == expected.normalIndices);
+		int threads[] = { 2, 4 };
+		for (int i = 0; i < 2; i++) {
+			ObjData chunked;
+			CHECK(parseText(text, chunked, threads[i]));
+			CHECK(sameObjData(single, chunked));
+		}
+
+		// Bad texture coordinate and normal references only drop to -1.
+		ObjData dropped;
+		CHECK(parseText(text + "f 1/999999/1 2/1/999999 3/1/1\n", dropped, 4));
+		size_t last = dropped.positionIndices.size() - 3;
+		CHECK(dropped.positionIndices[last] == 0 && dropped.positionIndices[last + 2] == 2);
+		CHECK(dropped.texcoordIndices[last] == -1 && dropped.texcoordIndices[last + 1] == 0);
+		CHECK(dropped.normalIndices[last + 1] == -1 && dropped.normalIndices[last + 2] == 0);
+
+		const char *bad[] = { "f 0 1 2\n", "f 1 2 999999999\n", "f -999999 1 2\n" };
+		size_t firstBlock = text.find("f ", 0);
+		firstBlock = text.find('\n', firstBlock) + 1;
+		for (int b = 0; b < 3; b++) {
+			std::string atEnd = text + bad[b];
+			std::string atStart = text.substr(0, firstBlock) + bad[b] + text.substr(firstBlock);
+			for (int t = 1; t <= 4; t *= 2) {
+				ObjData out;
+				CHECK(!parseText(atEnd, out, t));
+				CHECK(!parseText(atStart, out, t));
+			}
+		}
+	}
+
+	// An edited mesh saved as a binary snapshot loads back bit for bit, and
+	// as OBJ parses back to the same triangles within formatFloat()'s
+	// precision.  The background writer writes the same bytes.
+	void saveRoundTrip()
+	{
+		OBJLoader loader;
+		if (!loadMesh(loader, "shrek"))
+			return;
+		BrushRegion region;
+		loader.brushRegion(10, kDefaultBrush, region);
+		loader.deformRegion(loader.getVertices()[10] + glm::vec3(0.0f, 0.1f, 0.0f), region);
+		loader.updateNormals();
+
+		CHECK(loader.saveBinary("tvotests.mesh"));
+		CHECK(loader.saveOBJ("tvotests.obj"));
+		int failures = BackgroundWriter::shared().failures();
+		CHECK(loader.saveBinary("tvotests-async.mesh", true));
+		CHECK(loader.saveOBJ("tvotests-async.obj", true));
+		BackgroundWriter::shared().flush();
+		CHECK(BackgroundWriter::shared().failures() == failures);
+		CHECK(sameFiles("tvotests.mesh", "tvotests-async.mesh"));
+		CHECK(sameFiles("tvotests.obj", "tvotests-async.obj"));
+
+		OBJLoader reloaded;
+		CHECK(reloaded.load("tvotests.mesh"));
+		MeshView saved = loader.view(), loaded = reloaded.view();
+		CHECK(sameSpans(saved.positions, loaded.positions));
+		CHECK(sameSpans(saved.normals, loaded.normals));
+		CHECK(sameSpans(saved.colors, loaded.colors));
+		CHECK(sameSpans(saved.friction, loaded.friction));
+		CHECK(sameSpans(saved.indices, loaded.indices));
+		CHECK(samePositions(loader.getVertices(), reloaded.getVertices()));
+
+		std::vector<char> text;
+		ObjData data;
+		CHECK(readFile("tvotests.obj", text) && !text.empty());
+		CHECK(parseOBJ(&text[0], &text[0] + text.size(), data));
+		CHECK(data.positions.size() == saved.positions.size());
+		CHECK(std::vector<int>(saved.indices.begin(), saved.indices.end()) == data.positionIndices);
+		double error = 0.0;
+		for (size_t v = 0; v < data.positions.size() && v < saved.positions.size(); v++)
+			error = std::max(error, (double)glm::length(data.positions[v] - saved.positions[v]));
+		CHECK(error < 2.0e-6);
+
+		// Nothing to save.
+		OBJLoader empty;
+		CHECK(!empty.saveBinary("tvotests-empty.mesh"));
+		CHECK(!empty.saveOBJ("tvotests-empty.obj"));
+	}
+
+	// A second load() on the same loader, through the OBJ parser rather than
+	// the cache, leaves it as a fresh loader would be, and the cache it writes
+	// holds the new mesh's colours.
+	void reload()
+	{
+		const char *path = "tvotests-reload.obj";
+		std::string cache = meshCachePath(path);
+		OBJLoader loader;
+		CHECK(loadMesh(loader, "shrek"));
+		remove(cache.c_str());
+		CHECK(copyFile(meshPath("pencil"), path));
+		CHECK(loader.load(path));
+
+		OBJLoader fresh;
+		CHECK(loadMesh(fresh, "pencil"));
+		size_t count = fresh.getVertices().size();
+		CHECK(samePositions(fresh.getVertices(), loader.getVertices()));
+		CHECK(samePositions(fresh.getColors(), loader.getColors()));
+		CHECK(loader.getFriction() == fresh.getFriction());
+		CHECK(loader.getColors().size() == count && loader.getFriction().size() == count);
+		CHECK(loader.getTriangles().size() == fresh.getTriangles().size());
+		CHECK(loader.view().triangles.size() == loader.getVertexIndices().size() / 3);
+
+		OBJLoader cached;
+		CHECK(cached.load(path));
+		CHECK(samePositions(fresh.getColors(), cached.getColors()));
+		CHECK(cached.getFriction() == fresh.getFriction());
+	}
+
+	// Each level halves the one before, stays a clean triangle mesh over the
+	// full mesh's vertices, and the budgets pick the finest level that fits.
+	void lodBudgets()
+	{
+		OBJLoader loader;
+		if (!loadMesh(loader, "swq"))
+			return;
+		LodHierarchy const &lod = loader.lod();
+		size_t full = loader.getVertexIndices().size() / 3;
+		size_t vertices = loader.getVertices().size();
+		CHECK(lod.levelCount() >= 2);
+
+		size_t previous = full;
+		for (size_t k = 0; k < lod.levelCount(); k++) {
+			std::vector<int> const &level = lod.level(k);
+			size_t triangles = level.size() / 3;
+			CHECK(level.size() % 3 == 0);
+			CHECK(triangles <= previous / 2 + 1);
+			CHECK(triangles >= LodHierarchy::kMinTriangles);
+			bool valid = true;
+			for (size_t i = 0; i < level.size(); i += 3) {
+				for (int c = 0; c < 3; c++)
+					valid = valid && level[i + c] >= 0 && (size_t)level[i + c] < vertices;
+				valid = valid && level[i] != level[i + 1] && level[i + 1] != level[i + 2] && level[i] != level[i + 2];
+			}
+			CHECK(valid);
+			CHECK(lod.levelWithin(triangles) == (int)k);
+			CHECK(lod.levelWithin(triangles - 1) == (int)(k + 1 < lod.levelCount() ? k + 1 : k));
+			previous = triangles;
+		}
+		CHECK(lod.levelWithin(full) == 0);
+		CHECK(lod.levelWithin(1) == (int)lod.levelCount() - 1);
+
+		loader.setTriangleBudgets(0, 0);
+		CHECK(loader.hapticTriangles() == full);
+		CHECK(loader.visualTriangles() == full);
+		size_t budget = lod.level(0).size() / 3 - 1;
+		loader.setTriangleBudgets(budget, 1);
+		CHECK(loader.hapticTriangles() == lod.level(1).size() / 3);
+		CHECK(loader.visualTriangles() == lod.level(lod.levelCount() - 1).size() / 3);
+		loader.setTriangleBudgets(full, full);
+		CHECK(loader.hapticTriangles() == full);
+
+		// Too small to simplify.
+		OBJLoader pencil;
+		if (loadMesh(pencil, "pencil")) {
+			CHECK(pencil.lod().levelCount() == 0);
+			pencil.setTriangleBudgets(10, 10);
+			CHECK(pencil.hapticTriangles() == pencil.getVertexIndices().size() / 3);
+		}
+	}
+
+	// The cache brings the levels back as they were built, and is rebuilt
+	// when the OBJ changes or the cache is damaged.
+	void lodCache()
+	{
+		const char *path = "tvotests-lod.obj";
+		std::string cache = meshCachePath(path);
+		remove(cache.c_str());
+		CHECK(copyFile(meshPath("swq"), path));
+
+		OBJLoader built;
+		CHECK(built.load(path));
+		std::vector<char> written;
+		CHECK(readFile(cache.c_str(), written) && !written.empty());
+		OBJLoader cached;
+		CHECK(cached.load(path));
+		CHECK(samePositions(built.getVertices(), cached.getVertices()));
+		CHECK(built.getVertexIndices() == cached.getVertexIndices());
+		CHECK(built.lod().levelCount() == cached.lod().levelCount());
+		for (size_t k = 0; k < built.lod().levelCount() && k < cached.lod().levelCount(); k++)
+			CHECK(built.lod().level(k) == cached.lod().level(k));
+
+		// A different mesh under the same name.
+		OBJLoader pencil;
+		CHECK(copyFile(meshPath("pencil"), path));
+		CHECK(loadMesh(pencil, "pencil"));
+		OBJLoader replaced;
+		CHECK(replaced.load(path));
+		CHECK(samePositions(pencil.getVertices(), replaced.getVertices()));
+		CHECK(replaced.lod().levelCount() == 0);
+		std::vector<char> rewritten;
+		CHECK(readFile(cache.c_str(), rewritten) && rewritten != written);
+
+		// A cache cut short is ignored and written again.
+		written.resize(rewritten.size() / 2);
+		CHECK(writeFile(cache.c_str(), written));
+		OBJLoader damaged;
+		CHECK(damaged.load(path));
+		CHECK(samePositions(pencil.getVertices(), damaged.getVertices()));
+		CHECK(readFile(cache.c_str(), written) && written == rewritten);
+	}
+
+	// Objects, transforms and materials as a scene file gives them, with
+	// each mesh file loaded once however many objects use it.
+	void sceneFile()
+	{
+		Scene bundled;
+		CHECK(bundled.read((gMeshDir + "/default.scene").c_str()));
+		CHECK(bundled.objectCount() == 2);
+		CHECK(bundled.meshCount() == 2);
+		if (bundled.objectCount() == 2) {
+			CHECK(bundled.meshPath(bundled.object(0).mesh) == meshPath("WavySurface"));
+			SceneObject const &second = bundled.object(1);
+			CHECK(second.transform[12] == 1.0 && second.transform[13] == 1.0 && second.transform[14] == -2.0);
+			CHECK(second.material.stiffness == 0.8f && second.material.staticFriction == 0.5f);
+		}
+
+		std::string swq = meshPath("swq"), shrek = meshPath("shrek");
+		std::string text = "# comment\n"
+			"  # indented comment\n"
+			"\n" +
+			swq + " rotate 90 0 0 1 scale 2 translate 1 2 3\n" +
+			shrek + "\n" +
+			swq + " stiffness 0.3 damping 0.1 friction 0.7 0.2\n" +
+			meshPath("pencil") + "\n" +
+			shrek + " translate -1 0 0\n";
+		CHECK(writeText("tvotests.scene", text.c_str()));
+		Scene scene;
+		CHECK(scene.read("tvotests.scene"));
+		CHECK(scene.objectCount() == 5);
+		CHECK(scene.meshCount() == 3);
+		if (scene.objectCount() != 5)
+			return;
+
+		// Scaled, then turned a quarter about z, then moved.
+		double const *turned = scene.object(0).transform;
+		double expected[16] = { 0, 2, 0, 0, -2, 0, 0, 0, 0, 0, 2, 0, 1, 2, 3, 1 };
+		double error = 0.0;
+		for (int i = 0; i < 16; i++)
+			error = std::max(error, std::fabs(turned[i] - expected[i]));
+		CHECK(error < 1.0e-12);
+		SceneMaterial const &material = scene.object(2).material;
+		CHECK(material.stiffness == 0.3f && material.damping == 0.1f);
+		CHECK(material.staticFriction == 0.7f && material.dynamicFriction == 0.2f);
+		CHECK(scene.object(1).material.stiffness == kDefaultMaterial.stiffness);
+
+		CHECK(scene.object(0).mesh == scene.object(2).mesh);
+		CHECK(scene.object(1).mesh == scene.object(4).mesh);
+		CHECK(scene.object(0).mesh != scene.object(1).mesh);
+
+		// Side by side, the meshes come out as they do one at a time.
+		Scene serial;
+		CHECK(serial.read("tvotests.scene"));
+		CHECK(scene.loadMeshes(4));
+		CHECK(serial.loadMeshes(1));
+		for (size_t m = 0; m < scene.meshCount() && m < serial.meshCount(); m++) {
+			CHECK(samePositions(scene.mesh(m).getVertices(), serial.mesh(m).getVertices()));
+			CHECK(scene.mesh(m).getVertexIndices() == serial.mesh(m).getVertexIndices());
+		}
+		CHECK(&scene.loader(0) == &scene.loader(2));
+		CHECK(&scene.loader(1) == &scene.loader(4));
+		CHECK(&scene.loader(0) != &scene.loader(1));
+
+		Scene missing;
+		missing.addObject("tvotests-missing.obj");
+		CHECK(!missing.loadMeshes(4));
+		CHECK(missing.failedMesh() == "tvotests-missing.obj");
+	}
+
+	// A line read() does not understand fails the whole file at that line.
+	void sceneErrors()
+	{
+		struct BadScene {
+			const char *text;
+			int line;
+		};
+		const BadScene kBad[] = {
+			{ "swq.obj\nswq.obj translate 1 2\n", 2 },
+			{ "# x\nswq.obj\nswq.obj wobble 3\n", 3 },
+			{ "swq.obj rotate 10 0 0 0\n", 1 },
+			{ "swq.obj scale -1\n", 1 },
+			{ "swq.obj friction 0.5\n", 1 }
+		};
+		for (size_t i = 0; i < sizeof(kBad) / sizeof(kBad[0]); i++) {
+			CHECK(writeText("tvotests-bad.scene", kBad[i].text));
+			Scene scene;
+			CHECK(!scene.read("tvotests-bad.scene"));
+			CHECK(scene.errorLine() == kBad[i].line);
+			CHECK(scene.objectCount() == 0);
+		}
+
+		Scene scene;
+		remove("tvotests-missing.scene");
+		CHECK(!scene.read("tvotests-missing.scene"));
+		CHECK(scene.errorLine() == 0);
+	}
+
+#ifdef TVO_EGL
+	// The mesh drawn lit into the offscreen surface along path, as RGBA rows.
+	std::vector<unsigned char> drawPixels(OBJLoader &loader, RenderPath path)
+	{
+		loader.setRenderPath(path);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		loader.drawColorObj();
+		std::vector<unsigned char> pixels(4 * kOffscreenSize * kOffscreenSize);
+		glReadPixels(0, 0, kOffscreenSize, kOffscreenSize, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+		return pixels;
+	}
+
+	size_t coveredPixels(std::vector<unsigned char> const &pixels)
+	{
+		size_t covered = 0;
+		for (size_t i = 0; i < pixels.size(); i += 4)
+			if (pixels[i] || pixels[i + 1] || pixels[i + 2])
+				covered++;
+		return covered;
+	}
+
+	// The immediate and retained paths draw the same pixels, before and after
+	// edits that the retained path sends as updates to its buffers.
+	void renderPaths()
+	{
+		bool context = makeOffscreenContext();
+		CHECK(context);
+		if (!context)
+			return;
+		glViewport(0, 0, kOffscreenSize, kOffscreenSize);
+		glMatrixMode(GL_PROJECTION);
+		glLoadIdentity();
+		glOrtho(-1.5, 1.5, -1.5, 1.5, -10.0, 10.0);
+		glMatrixMode(GL_MODELVIEW);
+		glLoadIdentity();
+		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+		glEnable(GL_DEPTH_TEST);
+		glEnable(GL_LIGHTING);
+		glEnable(GL_LIGHT0);
+		glEnable(GL_COLOR_MATERIAL);
+
+		const char *meshes[] = { "pencil", "shrek" };
+		for (int m = 0; m < 2; m++) {
+			OBJLoader loader;
+			if (!loadMesh(loader, meshes[m]))
+				continue;
+			std::vector<unsigned char> before = drawPixels(loader, RenderPathImmediate);
+			CHECK(coveredPixels(before) > 100);
+			CHECK(drawPixels(loader, RenderPathRetained) == before);
+
+			int top = topVertex(loader);
+			ConstSpan<int> ring = loader.neighbours(top);
+			std::set<int> neighbours(ring.begin(), ring.end());
+			loader.deformSurface(top, loader.getVertices()[top] + glm::vec3(0.0f, 0.3f, 0.0f), neighbours);
+			randomEdits(loader, 20);
+			std::vector<unsigned char> after = drawPixels(loader, RenderPathImmediate);
+			CHECK(after != before);
+			CHECK(drawPixels(loader, RenderPathRetained) == after);
+		}
+		CHECK(glGetError() == GL_NO_ERROR);
+	}
+#endif
+
+	struct Test {
+		const char *name;
+		void (*run)();
+	};
+
+	const Test kTests[] = {
+		{ "spatialQueries", spatialQueries },
+		{ "incrementalNormals", incrementalNormals },
+		{ "envelopeCholesky", envelopeCholesky },
+		{ "rigidSystem", rigidSystem },
+		{ "rigidSolver", rigidSolver },
+		{ "editJournal", editJournal },
+		{ "undoRedo", undoRedo },
+		{ "floatText", floatText },
+		{ "parseChunks", parseChunks },
+		{ "saveRoundTrip", saveRoundTrip },
+		{ "reload", reload },
+		{ "lodBudgets", lodBudgets },
+		{ "lodCache", lodCache },
+		{ "sceneFile", sceneFile },
+		{ "sceneErrors", sceneErrors },
+#ifdef TVO_EGL
+		{ "renderPaths", renderPaths }
+#endif
+	};
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<std::string> names;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--mesh-dir") && i + 1 < argc)
+			gMeshDir = argv[++i];
+		else
+			names.push_back(argv[i]);
+	}
+
+	size_t count = sizeof(kTests) / sizeof(kTests[0]);
+	for (size_t n = 0; n < names.size(); n++) {
+		bool known = false;
+		for (size_t t = 0; t < count; t++)
+			known = known || names[n] == kTests[t].name;
+		if (!known) {
+			fprintf(stderr, "No test called %s\n", names[n].c_str());
+			return 2;
+		}
+	}
+
+	for (size_t t = 0; t < count; t++) {
+		bool selected = names.empty();
+		for (size_t n = 0; n < names.size(); n++)
+			selected = selected || names[n] == kTests[t].name;
+		if (!selected)
+			continue;
+		int failures = gFailures;
+		kTests[t].run();
+		printf("%s: %s\n", kTests[t].name, gFailures == failures ? "passed" : "FAILED");
+	}
+	return gFailures ? 1 : 0;
+}
@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include "vertexsoa.h"
+
+VertexSoA::VertexSoA() :
+mRaw(0),
+mData(0),
+mSize(0),
+mPadded(0)
+{
+}
+
+VertexSoA::VertexSoA(VertexSoA const &other) :
+mRaw(0),
+mData(0),
+mSize(0),
+mPadded(0)
+{
+	*this = other;
+}
+
+VertexSoA &VertexSoA::operator=(VertexSoA const &other)
+{
+	if (this != &other) {
+		allocate(other.mSize);
+		if (mPadded)
+			memcpy(mData, other.mData, 3 * mPadded * sizeof(float));
+	}
+	return *this;
+}
+
+VertexSoA::~VertexSoA()
+{
+	free(mRaw);
+}
+
+void VertexSoA::clear()
+{
+	free(mRaw);
+	mRaw = 0;
+	mData = 0;
+	mSize = 0;
+	mPadded = 0;
+}
+
+void VertexSoA::swap(VertexSoA &other)
+{
+	std::swap(mRaw, other.mRaw);
+	std::swap(mData, other.mData);
+	std::swap(mSize, other.mSize);
+	std::swap(mPadded, other.mPadded);
+}
+
+// Keeps the current block if it already has the right padded size, so a
+// per-frame assign() does not go back to the allocator.
+void VertexSoA::allocate(size_t n)
+{
+	size_t padded = (n + kVertexSoALanes - 1) / kVertexSoALanes * kVertexSoALanes;
+	if (padded != mPadded || !mRaw) {
+		free(mRaw);
+		mRaw = 0;
+		mData = 0;
+		if (padded) {
+			mRaw = (char *)malloc(3 * padded * sizeof(float) + kVertexSoAAlignment);
+			uintptr_t aligned = ((uintptr_t)mRaw + kVertexSoAAlignment - 1) & ~(uintptr_t)(kVertexSoAAlignment - 1);
+			mData = (float *)aligned;
+		}
+	}
+	mSize = n;
+	mPadded = padded;
+	for (int c = 0; c < 3; c++)
+		for (size_t i = n; i < padded; i++)
+			mData[c * padded + i] = kVertexSoAPadding;
+}
+
+void VertexSoA::assign(std::vector<glm::vec3> const &points)
+{
+	allocate(points.size());
+	float *px = x(), *py = y(), *pz = z();
+	for (size_t i = 0; i < mSize; i++) {
+		px[i] = points[i].x;
+		py[i] = points[i].y;
+		pz[i] = points[i].z;
+	}
+}
+
+void VertexSoA::assignZero(size_t n)
+{
+	allocate(n);
+	for (int c = 0; c < 3; c++)
+		memset(mData + c * mPadded, 0, n * sizeof(float));
+}
+
+void VertexSoA::store(std::vector<glm::vec3> &points) const
+{
+	points.resize(mSize);
+	float const *px = x(), *py = y(), *pz = z();
+	for (size_t i = 0; i < mSize; i++)
+		points[i] = glm::vec3(px[i], py[i], pz[i]);
+}
+
+void soaBounds(VertexSoA const &points, size_t begin, size_t end, glm::vec3 &lo, glm::vec3 &hi)
+{
+	float const *blocks[3] = { points.x(), points.y(), points.z() };
+	for (int c = 0; c < 3; c++) {
+		float const *v = blocks[c];
+		float minimum = v[begin], maximum = v[begin];
+		for (size_t i = begin + 1; i < end; i++) {
+			minimum = v[i] < minimum ? v[i] : minimum;
+			maximum = v[i] > maximum ? v[i] : maximum;
+		}
+		lo[c] = minimum;
+		hi[c] = maximum;
+	}
+}
+
+void soaTranslateScale(VertexSoA &points, size_t begin, size_t end, glm::vec3 const &offset, float scale)
+{
+	float *blocks[3] = { points.x(), points.y(), points.z() };
+	for (int c = 0; c < 3; c++) {
+		float *v = blocks[c];
+		float shift = offset[c];
+		for (size_t i = begin; i < end; i++)
+			v[i] = (v[i] - shift) * scale;
+	}
+}
+
+void soaNormalize(VertexSoA &vectors, size_t begin, size_t end)
+{
+	float *x = vectors.x(), *y = vectors.y(), *z = vectors.z();
+	for (size_t i = begin; i < end; i++) {
+		float s = 1.0f / std::sqrt(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+		x[i] *= s;
+		y[i] *= s;
+		z[i] *= s;
+	}
+}
+
+void soaFaceNormals(VertexSoA const &points, int const *indices, size_t begin, size_t end, VertexSoA &faces)
+{
+	float const *x = points.x(), *y = points.y(), *z = points.z();
+	float *fx = faces.x(), *fy = faces.y(), *fz = faces.z();
+	for (size_t t = begin; t < end; t++) {
+		int a = indices[3 * t], b = indices[3 * t + 1], c = indices[3 * t + 2];
+		float ux = x[b] - x[a], uy = y[b] - y[a], uz = z[b] - z[a];
+		float vx = x[c] - x[a], vy = y[c] - y[a], vz = z[c] - z[a];
+		// Same operand order as glm::cross so the result matches the AoS path.
+		fx[t] = uy * vz - vy * uz;
+		fy[t] = uz * vx - vz * ux;
+		fz[t] = ux * vy - vx * uy;
+	}
+	soaNormalize(faces, begin, end);
+}
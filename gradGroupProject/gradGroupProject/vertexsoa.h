@@ -0,0 +1,91 @@
+#ifndef VERTEXSOA_H
+#define VERTEXSOA_H
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+
+//! Structure-of-arrays copy of a vec3 array: separate x[], y[] and z[] blocks.
+//!
+//! Each block starts on a kVertexSoAAlignment byte boundary and is padded to a
+//! multiple of kVertexSoALanes floats, so a kernel can walk all three blocks
+//! in full-width vector steps with aligned loads.  Padding lanes hold
+//! kVertexSoAPadding, which is far enough away never to win a distance test.
+class VertexSoA {
+	public:
+		VertexSoA();
+		VertexSoA(VertexSoA const &other);
+		VertexSoA &operator=(VertexSoA const &other);
+		~VertexSoA();
+
+		//! Transposes points into the three blocks.
+		//!
+		void assign(std::vector<glm::vec3> const &points);
+
+		//! Resizes to n zero vectors.
+		//!
+		void assignZero(size_t n);
+
+		//! Transposes back into an array of vec3.
+		//!
+		void store(std::vector<glm::vec3> &points) const;
+
+		void clear();
+		void swap(VertexSoA &other);
+
+		size_t size() const { return mSize; }
+		bool empty() const { return mSize == 0; }
+
+		//! Size of each block including the padding lanes.
+		//!
+		size_t paddedSize() const { return mPadded; }
+
+		float *x() { return mData; }
+		float *y() { return mData + mPadded; }
+		float *z() { return mData + 2 * mPadded; }
+		float const *x() const { return mData; }
+		float const *y() const { return mData + mPadded; }
+		float const *z() const { return mData + 2 * mPadded; }
+
+		glm::vec3 get(size_t i) const
+		{
+			return glm::vec3(mData[i], mData[mPadded + i], mData[2 * mPadded + i]);
+		}
+
+		void set(size_t i, glm::vec3 const &p)
+		{
+			mData[i] = p.x;
+			mData[mPadded + i] = p.y;
+			mData[2 * mPadded + i] = p.z;
+		}
+
+	private:
+		void allocate(size_t n);
+
+		char *mRaw;
+		float *mData;
+		size_t mSize;
+		size_t mPadded;
+	};
+
+const size_t kVertexSoALanes = 8;
+const size_t kVertexSoAAlignment = 32;
+const float kVertexSoAPadding = 1e30f;
+
+//! Component-wise bounds of points [begin, end).  The range must not be empty.
+//!
+void soaBounds(VertexSoA const &points, size_t begin, size_t end, glm::vec3 &lo, glm::vec3 &hi);
+
+//! points[i] = (points[i] - offset) * scale for i in [begin, end).
+//!
+void soaTranslateScale(VertexSoA &points, size_t begin, size_t end, glm::vec3 const &offset, float scale);
+
+//! Normalizes every vector in [begin, end), as glm::normalize does.
+//!
+void soaNormalize(VertexSoA &vectors, size_t begin, size_t end);
+
+//! Unit normals of triangles [begin, end) of indices, written to the same
+//! slots of faces, which must already hold at least end vectors.
+void soaFaceNormals(VertexSoA const &points, int const *indices, size_t begin, size_t end, VertexSoA &faces);
+
+#endif